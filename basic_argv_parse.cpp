@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "basic_argv_parse.h"
 
 
@@ -3,8 +3,6 @@
 
 #include <string>
 
-using std::string;
-
 class Basic_argv_parse {
 public:
     static char *get_option(char **begin, char **end, const std::string &option);
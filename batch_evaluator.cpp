@@ -0,0 +1,310 @@
+//
+// Non-interactive solving of newline delimited equations.
+//
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <charconv>
+#include <cstdio>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include "compiled_expression.h"
+#include "work_stealing_pool.h"
+#include "batch_evaluator.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BATCH_EVALUATOR_MMAP 1
+#endif
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+/*
+ * Batch mode answers each input line with exactly one output line: the result, or "error: " with
+ * the kind of error and its byte offset in the line. Results are written in the shortest form that
+ * reads back as the same double. Output is collected in a buffer and written in large blocks.
+ */
+namespace {
+
+const size_t chunk_size{1 << 20};
+
+// Parallel chunks are smaller so that a few long lines cannot hold up the output for long.
+const size_t parallel_chunk_size{1 << 16};
+
+// Cuts a run of whole lines of about size bytes from the front of remaining.
+string_view take_lines(string_view &remaining, size_t size) {
+    size_t end = remaining.size();
+    if (end > size) {
+        end = std::min(remaining.find('\n', size), remaining.size() - 1) + 1;
+    }
+    string_view lines = remaining.substr(0, end);
+    remaining.remove_prefix(end);
+    return lines;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+Batch_evaluator::Batch_evaluator(size_t threads) : threads(std::max<size_t>(threads, 1)) {}
+
+const Batch_evaluator::statistics &Batch_evaluator::totals() const {
+    return counted;
+}
+
+void Batch_evaluator::report(FILE *out) const {
+    std::fprintf(out, "Solved %zu equations (%zu errors) in %.3f s: %.0f equations/s\n",
+                 counted.equations, counted.errors, counted.seconds,
+                 counted.seconds > 0 ? counted.equations / counted.seconds : 0.0);
+    if (cache) {
+        auto cached = cache->counters();
+        std::fprintf(out, "Cache: %zu hits, %zu misses, %zu evictions\n", cached.hits,
+                     cached.misses, cached.evictions);
+    }
+}
+
+void Batch_evaluator::use_cache(Expression_cache *cache) {
+    this->cache = cache;
+}
+
+void Batch_evaluator::write_error(Infix_lexer::error_kind error, size_t offset, string &output) {
+    ++counted.errors;
+    output += "error: ";
+    output += Infix_lexer::describe(error);
+    output += " at ";
+    output += std::to_string(offset);
+    output += '\n';
+}
+
+void Batch_evaluator::write_result(double result, string &output) {
+    char digits[32];
+#if defined(__cpp_lib_to_chars)
+    auto written = std::to_chars(digits, digits + sizeof(digits), result);
+    output.append(digits, written.ptr);
+#else
+    output.append(digits, std::snprintf(digits, sizeof(digits), "%.17g", result));
+#endif
+    output += '\n';
+}
+
+void Batch_evaluator::solve_line(string_view equation, string &output) {
+    ++counted.equations;
+    if (cache) {
+        Infix_lexer::error_kind error;
+        size_t offset;
+        auto cached = cache->compile(equation, error, offset);
+        if (not cached) {
+            write_error(error, offset, output);
+            return;
+        }
+        if (cached->constant) {
+            write_result(cached->result, output);
+            return;
+        }
+        if (cached->compiled.valid() and cached->compiled.variables().empty()) {
+            write_result(cached->compiled.evaluate(), output);
+            return;
+        }
+        // Equations with variables fall through so that the unknown name is located.
+    }
+    // Batch equations have no bindings, so every name is reported as an unknown variable.
+    static const vector<string> no_variables;
+    Compiled_expression compiled{equation, no_variables};
+    if (not compiled.valid()) {
+        write_error(compiled.error(), compiled.error_offset(), output);
+        return;
+    }
+    write_result(compiled.evaluate(), output);
+}
+
+void Batch_evaluator::solve(string_view lines, string &output) {
+    while (not lines.empty()) {
+        size_t end = lines.find('\n');
+        string_view line = lines.substr(0, end);
+        lines.remove_prefix(end == string_view::npos ? lines.size() : end + 1);
+        if (not line.empty() and line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        solve_line(line, output);
+    }
+}
+
+bool Batch_evaluator::flush(string &output, FILE *out) {
+    bool written = std::fwrite(output.data(), 1, output.size(), out) == output.size();
+    output.clear();
+    return written;
+}
+
+bool Batch_evaluator::solve_buffer(string_view lines, FILE *out) {
+    auto start = std::chrono::steady_clock::now();
+    bool written{true};
+    if (threads > 1) {
+        written = solve_chunks([&lines](chunk &next) {
+            next.lines = take_lines(lines, parallel_chunk_size);
+            return not next.lines.empty();
+        }, out);
+    } else {
+        string output;
+        output.reserve(chunk_size);
+        while (not lines.empty() and written) {
+            solve(take_lines(lines, chunk_size), output);
+            written = flush(output, out);
+        }
+    }
+    counted.seconds += seconds_since(start);
+    return written;
+}
+
+bool Batch_evaluator::solve_file(const char *path, FILE *out) {
+#ifdef BATCH_EVALUATOR_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status{};
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = size_t(status.st_size);
+    void *mapped{nullptr};
+    if (size > 0) {
+        mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    bool written = solve_buffer(string_view(static_cast<const char *>(mapped), size), out);
+    if (mapped) {
+        munmap(mapped, size);
+    }
+    return written;
+#else
+    FILE *in = std::fopen(path, "rb");
+    if (in == nullptr) {
+        return false;
+    }
+    bool solved = solve_stream(in, out);
+    std::fclose(in);
+    return solved;
+#endif
+}
+
+bool Batch_evaluator::solve_stream(FILE *in, FILE *out) {
+    auto start = std::chrono::steady_clock::now();
+    if (threads > 1) {
+        string carried;    // An incomplete last line carried over from the previous read.
+        bool written = solve_chunks([&carried, in](chunk &next) {
+            // Reads on after the carried bytes until a read brings a line end, searching only
+            // what it brought, so a line longer than a chunk is neither copied nor scanned again.
+            size_t end{0};
+            while (true) {
+                size_t kept = carried.size();
+                carried.resize(kept + parallel_chunk_size);
+                size_t read = std::fread(&carried[kept], 1, parallel_chunk_size, in);
+                carried.resize(kept + read);
+                if (read == 0) {
+                    end = carried.size();
+                    break;
+                }
+                size_t newline = string_view(carried).substr(kept).rfind('\n');
+                if (newline not_eq string_view::npos) {
+                    end = kept + newline + 1;
+                    break;
+                }
+            }
+            next.input.swap(carried);
+            carried.assign(next.input, end, string::npos);
+            next.input.resize(end);
+            next.lines = next.input;
+            return not next.input.empty();
+        }, out);
+        counted.seconds += seconds_since(start);
+        return written and not std::ferror(in);
+    }
+    string buffer;
+    string output;
+    output.reserve(chunk_size);
+    size_t kept{0};    // Bytes of an incomplete last line carried over from the previous read.
+    bool written{true};
+    while (written) {
+        buffer.resize(kept + chunk_size);
+        size_t read = std::fread(&buffer[kept], 1, chunk_size, in);
+        size_t filled = kept + read;
+        if (read == 0) {
+            solve(string_view(buffer.data(), filled), output);
+            written = flush(output, out);
+            break;
+        }
+        size_t end = string_view(buffer.data(), filled).rfind('\n');
+        end = end == string_view::npos ? 0 : end + 1;
+        solve(string_view(buffer.data(), end), output);
+        written = flush(output, out);
+        kept = filled - end;
+        buffer.erase(0, end);
+    }
+    counted.seconds += seconds_since(start);
+    return written and not std::ferror(in);
+}
+
+/*
+ * The calling thread keeps a window of chunks in flight on the pool and writes each chunk's output
+ * as soon as it and every chunk before it are done, so the output is in input order.
+ */
+bool Batch_evaluator::solve_chunks(const std::function<bool(chunk &)> &next, FILE *out) {
+    std::mutex done_lock;
+    std::condition_variable done;
+    std::deque<std::unique_ptr<chunk>> window;
+    // Declared last, so it finishes any chunks still in flight before the window is destroyed.
+    Work_stealing_pool pool{threads};
+    const size_t window_size{4 * threads};
+    bool more{true};
+    bool written{true};
+    while (written) {
+        while (more and window.size() < window_size) {
+            std::unique_ptr<chunk> pending{new chunk};
+            more = next(*pending);
+            if (not more) {
+                break;
+            }
+            chunk *task = pending.get();
+            pool.submit([this, task, &done_lock, &done]() {
+                Batch_evaluator solver;
+                solver.use_cache(cache);
+                solver.solve(task->lines, task->output);
+                task->counted = solver.totals();
+                std::lock_guard<std::mutex> guard{done_lock};
+                task->done = true;
+                done.notify_all();
+            });
+            window.push_back(std::move(pending));
+        }
+        if (window.empty()) {
+            break;
+        }
+        chunk &first = *window.front();
+        {
+            std::unique_lock<std::mutex> guard{done_lock};
+            done.wait(guard, [&first] { return first.done.load(); });
+        }
+        counted.equations += first.counted.equations;
+        counted.errors += first.counted.errors;
+        written = flush(first.output, out);
+        window.pop_front();
+    }
+    return written;
+}
@@ -0,0 +1,69 @@
+//
+// Non-interactive solving of newline delimited equations.
+//
+
+#ifndef INC_9_CALCULATOR_BATCH_EVALUATOR_H
+#define INC_9_CALCULATOR_BATCH_EVALUATOR_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdio>
+#include <atomic>
+#include <functional>
+#include "infix_lexer.h"
+#include "expression_cache.h"
+
+class Batch_evaluator {
+
+public:
+    struct statistics {
+        size_t equations{0};
+        size_t errors{0};
+        double seconds{0.0};
+    };
+
+    // With more than one thread, equations are solved in parallel and written in input order.
+    explicit Batch_evaluator(size_t threads = 1);
+
+    // Solves each line of lines, appending one result line per equation to output.
+    void solve(std::string_view lines, std::string &output);
+
+    // Solves each line of lines, writing the results to out.
+    bool solve_buffer(std::string_view lines, FILE *out);
+
+    // Solves every line of a file, which is memory-mapped where the platform allows.
+    bool solve_file(const char *path, FILE *out);
+
+    // Solves every line read from in, a buffer at a time.
+    bool solve_stream(FILE *in, FILE *out);
+
+    // Looks equations up in cache before compiling them. The cache must outlive the evaluator.
+    void use_cache(Expression_cache *cache);
+
+    const statistics &totals() const;
+
+    // Writes the equation count, error count, equations per second and any cache counters.
+    void report(FILE *out) const;
+
+private:
+    size_t threads{1};
+    statistics counted;
+    Expression_cache *cache{nullptr};
+
+    // A run of whole lines, solved by one task of the parallel pipeline.
+    struct chunk {
+        std::string input;     // Owns the lines when they were read from a stream.
+        std::string_view lines;
+        std::string output;
+        statistics counted;
+        std::atomic<bool> done{false};
+    };
+    bool solve_chunks(const std::function<bool(chunk &)> &next, FILE *out);
+    void solve_line(std::string_view equation, std::string &output);
+    void write_error(Infix_lexer::error_kind error, size_t offset, std::string &output);
+    static void write_result(double result, std::string &output);
+    static bool flush(std::string &output, FILE *out);
+};
+
+#endif //INC_9_CALCULATOR_BATCH_EVALUATOR_H
@@ -0,0 +1,321 @@
+//
+// Column kernels for batch evaluation.
+//
+
+#include <cmath>
+#include <algorithm>
+#include "batch_kernels.h"
+#include "elementary_functions.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define BATCH_KERNELS_SSE2 1
+#if defined(__GNUC__)
+#define BATCH_KERNELS_AVX 1
+#endif
+#endif
+
+/*
+ * Each operator has a scalar loop, an SSE2 loop for x86-64 (where SSE2 is always present) and an
+ * AVX loop compiled with the target attribute, so the default build flags still run everywhere.
+ * The widest supported set is chosen once, at first use. Exponentiation and exp, log, sin, cos and
+ * tan are loops over Elementary_functions that the compiler packs, for AVX2 or the default target.
+ */
+#define BATCH_SCALAR_KERNEL(name, call)                                                            \
+    void name##_scalar(const double *x, const double *y, double *out, size_t n) {                \
+        for (size_t i = 0; i < n; ++i) {                                                         \
+            out[i] = call(x[i], y[i]);                                                           \
+        }                                                                                        \
+    }
+
+#define BATCH_SSE2_KERNEL(name, call, intrinsic)                                                   \
+    void name##_sse2(const double *x, const double *y, double *out, size_t n) {                  \
+        size_t i = 0;                                                                            \
+        for (; i + 2 <= n; i += 2) {                                                             \
+            _mm_storeu_pd(out + i, intrinsic(_mm_loadu_pd(x + i), _mm_loadu_pd(y + i)));         \
+        }                                                                                        \
+        for (; i < n; ++i) {                                                                     \
+            out[i] = call(x[i], y[i]);                                                           \
+        }                                                                                        \
+    }
+
+#define BATCH_AVX_KERNEL(name, call, intrinsic)                                                    \
+    __attribute__((target("avx")))                                                               \
+    void name##_avx(const double *x, const double *y, double *out, size_t n) {                   \
+        size_t i = 0;                                                                            \
+        for (; i + 4 <= n; i += 4) {                                                             \
+            _mm256_storeu_pd(out + i, intrinsic(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i))); \
+        }                                                                                        \
+        for (; i < n; ++i) {                                                                     \
+            out[i] = call(x[i], y[i]);                                                           \
+        }                                                                                        \
+    }
+
+// The same for functions of one argument.
+#define BATCH_SCALAR_UNARY_KERNEL(name, call)                                                    \
+    void name##_scalar(const double *x, double *out, size_t n) {                                 \
+        for (size_t i = 0; i < n; ++i) {                                                         \
+            out[i] = call(x[i]);                                                                 \
+        }                                                                                        \
+    }
+
+#define BATCH_SSE2_UNARY_KERNEL(name, call, intrinsic)                                           \
+    void name##_sse2(const double *x, double *out, size_t n) {                                   \
+        size_t i = 0;                                                                            \
+        for (; i + 2 <= n; i += 2) {                                                             \
+            _mm_storeu_pd(out + i, intrinsic(_mm_loadu_pd(x + i)));                              \
+        }                                                                                        \
+        for (; i < n; ++i) {                                                                     \
+            out[i] = call(x[i]);                                                                 \
+        }                                                                                        \
+    }
+
+#define BATCH_AVX_UNARY_KERNEL(name, call, intrinsic)                                            \
+    __attribute__((target("avx")))                                                               \
+    void name##_avx(const double *x, double *out, size_t n) {                                    \
+        size_t i = 0;                                                                            \
+        for (; i + 4 <= n; i += 4) {                                                             \
+            _mm256_storeu_pd(out + i, intrinsic(_mm256_loadu_pd(x + i)));                        \
+        }                                                                                        \
+        for (; i < n; ++i) {                                                                     \
+            out[i] = call(x[i]);                                                                 \
+        }                                                                                        \
+    }
+
+#define BATCH_PLUS(x, y) ((x) + (y))
+#define BATCH_MINUS(x, y) ((x) - (y))
+#define BATCH_MULTIPLY(x, y) ((x) * (y))
+#define BATCH_DIVIDE(x, y) ((x) / (y))
+
+/*
+ * min and max keep the first operand unless the second is smaller (larger), as minpd and maxpd do,
+ * so packed and scalar results agree even for NaN and signed zeros.
+ */
+#define BATCH_MIN(x, y) ((x) < (y) ? (x) : (y))
+#define BATCH_MAX(x, y) ((x) > (y) ? (x) : (y))
+#define BATCH_SQRT(x) std::sqrt(x)
+#define BATCH_ABS(x) std::fabs(x)
+#define BATCH_FLOOR(x) std::floor(x)
+#define BATCH_CEIL(x) std::ceil(x)
+
+namespace {
+
+#ifdef BATCH_KERNELS_SSE2
+__m128d abs_pd(__m128d x) {
+    return _mm_andnot_pd(_mm_set1_pd(-0.0), x);
+}
+
+// SSE2 has no packed rounding, so floor and ceil only go packed with AVX.
+BATCH_SCALAR_UNARY_KERNEL(floor, BATCH_FLOOR)
+BATCH_SCALAR_UNARY_KERNEL(ceil, BATCH_CEIL)
+#endif
+
+#ifdef BATCH_KERNELS_AVX
+__attribute__((target("avx")))
+__m256d abs_pd(__m256d x) {
+    return _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+}
+#endif
+
+#ifndef BATCH_KERNELS_SSE2
+BATCH_SCALAR_KERNEL(plus, BATCH_PLUS)
+BATCH_SCALAR_KERNEL(minus, BATCH_MINUS)
+BATCH_SCALAR_KERNEL(multiply, BATCH_MULTIPLY)
+BATCH_SCALAR_KERNEL(divide, BATCH_DIVIDE)
+BATCH_SCALAR_UNARY_KERNEL(sqrt, BATCH_SQRT)
+BATCH_SCALAR_UNARY_KERNEL(abs, BATCH_ABS)
+BATCH_SCALAR_UNARY_KERNEL(floor, BATCH_FLOOR)
+BATCH_SCALAR_UNARY_KERNEL(ceil, BATCH_CEIL)
+BATCH_SCALAR_KERNEL(min, BATCH_MIN)
+BATCH_SCALAR_KERNEL(max, BATCH_MAX)
+#endif
+
+#ifdef BATCH_KERNELS_SSE2
+BATCH_SSE2_KERNEL(plus, BATCH_PLUS, _mm_add_pd)
+BATCH_SSE2_KERNEL(minus, BATCH_MINUS, _mm_sub_pd)
+BATCH_SSE2_KERNEL(multiply, BATCH_MULTIPLY, _mm_mul_pd)
+BATCH_SSE2_KERNEL(divide, BATCH_DIVIDE, _mm_div_pd)
+BATCH_SSE2_UNARY_KERNEL(sqrt, BATCH_SQRT, _mm_sqrt_pd)
+BATCH_SSE2_UNARY_KERNEL(abs, BATCH_ABS, abs_pd)
+BATCH_SSE2_KERNEL(min, BATCH_MIN, _mm_min_pd)
+BATCH_SSE2_KERNEL(max, BATCH_MAX, _mm_max_pd)
+#endif
+
+#ifdef BATCH_KERNELS_AVX
+BATCH_AVX_KERNEL(plus, BATCH_PLUS, _mm256_add_pd)
+BATCH_AVX_KERNEL(minus, BATCH_MINUS, _mm256_sub_pd)
+BATCH_AVX_KERNEL(multiply, BATCH_MULTIPLY, _mm256_mul_pd)
+BATCH_AVX_KERNEL(divide, BATCH_DIVIDE, _mm256_div_pd)
+BATCH_AVX_UNARY_KERNEL(sqrt, BATCH_SQRT, _mm256_sqrt_pd)
+BATCH_AVX_UNARY_KERNEL(abs, BATCH_ABS, abs_pd)
+BATCH_AVX_UNARY_KERNEL(floor, BATCH_FLOOR, _mm256_floor_pd)
+BATCH_AVX_UNARY_KERNEL(ceil, BATCH_CEIL, _mm256_ceil_pd)
+BATCH_AVX_KERNEL(min, BATCH_MIN, _mm256_min_pd)
+BATCH_AVX_KERNEL(max, BATCH_MAX, _mm256_max_pd)
+#endif
+
+/*
+ * The branch-free part of an elementary function runs over a block of rows into a buffer, which
+ * the compiler packs, and the rows it leaves NaN are then given to the C library, as
+ * Elementary_functions does for one number. The buffer keeps the packed loop from writing over
+ * its arguments. It is packed only where floating point is compiled not to trap, so that both
+ * sides of a choice may be computed.
+ */
+const size_t elementary_block{256};
+
+#define BATCH_ELEMENTARY_KERNEL(name, function, suffix, attributes)                             \
+    attributes                                                                                   \
+    void name##_##suffix(const double *x, const double *y, double *out, size_t n) {              \
+        double fast[elementary_block];                                                           \
+        for (size_t start = 0; start < n; start += elementary_block) {                           \
+            size_t m = std::min(elementary_block, n - start);                                    \
+            for (size_t i = 0; i < m; ++i) {                                                     \
+                fast[i] = Elementary_functions::function##_or_nan(x[start + i], y[start + i]);   \
+            }                                                                                    \
+            for (size_t i = 0; i < m; ++i) {                                                     \
+                out[start + i] = fast[i] == fast[i] ? fast[i]                                    \
+                                                    : std::function(x[start + i], y[start + i]); \
+            }                                                                                    \
+        }                                                                                        \
+    }
+
+#define BATCH_ELEMENTARY_UNARY_KERNEL(function, suffix, attributes)                             \
+    attributes                                                                                   \
+    void function##_##suffix(const double *x, double *out, size_t n) {                           \
+        double fast[elementary_block];                                                           \
+        for (size_t start = 0; start < n; start += elementary_block) {                           \
+            size_t m = std::min(elementary_block, n - start);                                    \
+            for (size_t i = 0; i < m; ++i) {                                                     \
+                fast[i] = Elementary_functions::function##_or_nan(x[start + i]);                 \
+            }                                                                                    \
+            for (size_t i = 0; i < m; ++i) {                                                     \
+                out[start + i] = fast[i] == fast[i] ? fast[i] : std::function(x[start + i]);    \
+            }                                                                                    \
+        }                                                                                        \
+    }
+
+BATCH_ELEMENTARY_KERNEL(exponent, pow, default, )
+BATCH_ELEMENTARY_UNARY_KERNEL(exp, default, )
+BATCH_ELEMENTARY_UNARY_KERNEL(log, default, )
+BATCH_ELEMENTARY_UNARY_KERNEL(sin, default, )
+BATCH_ELEMENTARY_UNARY_KERNEL(cos, default, )
+BATCH_ELEMENTARY_UNARY_KERNEL(tan, default, )
+
+// The integer steps of the elementary functions only pack into 256 bits with AVX2.
+#ifdef BATCH_KERNELS_AVX
+BATCH_ELEMENTARY_KERNEL(exponent, pow, avx2, __attribute__((target("avx2"))))
+BATCH_ELEMENTARY_UNARY_KERNEL(exp, avx2, __attribute__((target("avx2"))))
+BATCH_ELEMENTARY_UNARY_KERNEL(log, avx2, __attribute__((target("avx2"))))
+BATCH_ELEMENTARY_UNARY_KERNEL(sin, avx2, __attribute__((target("avx2"))))
+BATCH_ELEMENTARY_UNARY_KERNEL(cos, avx2, __attribute__((target("avx2"))))
+BATCH_ELEMENTARY_UNARY_KERNEL(tan, avx2, __attribute__((target("avx2"))))
+#endif
+
+typedef void (*unary_kernel)(const double *x, double *out, size_t n);
+
+struct Kernel_table {
+    const char *instruction_set;
+    Batch_kernels::kernel plus, minus, multiply, divide;
+    unary_kernel sqrt, abs, floor, ceil;
+    Batch_kernels::kernel min, max;
+    Batch_kernels::kernel exponent;
+    unary_kernel exp, log, sin, cos, tan;
+};
+
+Kernel_table select_kernels() {
+#ifdef BATCH_KERNELS_AVX
+    if (__builtin_cpu_supports("avx2")) {
+        return {"avx", plus_avx, minus_avx, multiply_avx, divide_avx,
+                sqrt_avx, abs_avx, floor_avx, ceil_avx, min_avx, max_avx,
+                exponent_avx2, exp_avx2, log_avx2, sin_avx2, cos_avx2, tan_avx2};
+    }
+    if (__builtin_cpu_supports("avx")) {
+        return {"avx", plus_avx, minus_avx, multiply_avx, divide_avx,
+                sqrt_avx, abs_avx, floor_avx, ceil_avx, min_avx, max_avx,
+                exponent_default, exp_default, log_default, sin_default, cos_default, tan_default};
+    }
+#endif
+#ifdef BATCH_KERNELS_SSE2
+    return {"sse2", plus_sse2, minus_sse2, multiply_sse2, divide_sse2,
+            sqrt_sse2, abs_sse2, floor_scalar, ceil_scalar, min_sse2, max_sse2,
+            exponent_default, exp_default, log_default, sin_default, cos_default, tan_default};
+#else
+    return {"scalar", plus_scalar, minus_scalar, multiply_scalar, divide_scalar,
+            sqrt_scalar, abs_scalar, floor_scalar, ceil_scalar, min_scalar, max_scalar,
+            exponent_default, exp_default, log_default, sin_default, cos_default, tan_default};
+#endif
+}
+
+const Kernel_table &kernels() {
+    static const Kernel_table table = select_kernels();
+    return table;
+}
+
+// Functions of one argument, packed where the instruction set allows.
+#define BATCH_UNARY_FUNCTION(name)                                                               \
+    void name##_function(const double *const *arguments, size_t, double *out, size_t n) {       \
+        kernels().name(arguments[0], out, n);                                                    \
+    }
+
+BATCH_UNARY_FUNCTION(sqrt)
+BATCH_UNARY_FUNCTION(abs)
+BATCH_UNARY_FUNCTION(floor)
+BATCH_UNARY_FUNCTION(ceil)
+BATCH_UNARY_FUNCTION(exp)
+BATCH_UNARY_FUNCTION(log)
+BATCH_UNARY_FUNCTION(sin)
+BATCH_UNARY_FUNCTION(cos)
+BATCH_UNARY_FUNCTION(tan)
+
+// min and max of any number of arguments, folded from the left one column at a time.
+#define BATCH_FOLD_FUNCTION(name)                                                                \
+    void name##_function(const double *const *arguments, size_t count, double *out, size_t n) { \
+        if (count == 1) {                                                                        \
+            std::copy_n(arguments[0], n, out);                                                   \
+        }                                                                                        \
+        for (size_t k = 1; k < count; ++k) {                                                     \
+            kernels().name(k == 1 ? arguments[0] : out, arguments[k], out, n);                   \
+        }                                                                                        \
+    }
+
+BATCH_FOLD_FUNCTION(min)
+BATCH_FOLD_FUNCTION(max)
+
+} // namespace
+
+Batch_kernels::kernel Batch_kernels::for_operator(char operator_) {
+    switch (operator_) {
+        case '+' : return kernels().plus;
+        case '-' : return kernels().minus;
+        case '*' : return kernels().multiply;
+        case '/' : return kernels().divide;
+        case '^' : return kernels().exponent;
+        default : return nullptr;
+    }
+}
+
+Batch_kernels::function_kernel Batch_kernels::for_function(std::string_view name) {
+    static const struct {
+        std::string_view name;
+        function_kernel kernel;
+    } functions[] = {
+            {"sqrt", sqrt_function}, {"abs", abs_function}, {"floor", floor_function},
+            {"ceil", ceil_function}, {"min", min_function}, {"max", max_function},
+            {"exp", exp_function}, {"log", log_function}, {"sin", sin_function},
+            {"cos", cos_function}, {"tan", tan_function},
+    };
+    for (auto &function : functions) {
+        if (function.name == name) {
+            return function.kernel;
+        }
+    }
+    return nullptr;
+}
+
+void Batch_kernels::fill(double *out, double value, size_t n) {
+    std::fill_n(out, n, value);
+}
+
+const char *Batch_kernels::instruction_set() {
+    return kernels().instruction_set;
+}
@@ -0,0 +1,36 @@
+//
+// Column kernels for batch evaluation.
+//
+
+#ifndef INC_9_CALCULATOR_BATCH_KERNELS_H
+#define INC_9_CALCULATOR_BATCH_KERNELS_H
+
+#include <cstddef>
+#include <string_view>
+
+class Batch_kernels {
+
+public:
+    // out[i] = x[i] op y[i] for i < n. out may alias x or y.
+    typedef void (*kernel)(const double *x, const double *y, double *out, size_t n);
+
+    // The kernel for one of the operators in Infix_calculator::operators, or nullptr.
+    static kernel for_operator(char operator_);
+
+    /*
+     * out[i] = f(arguments[0][i], ..., arguments[count - 1][i]) for i < n. out may alias
+     * arguments[0], but no other argument.
+     */
+    typedef void (*function_kernel)(const double *const *arguments, size_t count, double *out,
+                                    size_t n);
+
+    // The kernel for a built-in function of Function_registry, or nullptr.
+    static function_kernel for_function(std::string_view name);
+
+    static void fill(double *out, double value, size_t n);
+
+    // The instruction set the kernels were selected for: "avx", "sse2" or "scalar".
+    static const char *instruction_set();
+};
+
+#endif //INC_9_CALCULATOR_BATCH_KERNELS_H
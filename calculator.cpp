@@ -4,147 +4,36 @@
 
 #include <iostream>
 #include <string>
-#include <list>
-#include <regex>
+#include <cmath>
+#include <limits>
 #include <map>
-#include <stdexcept>
-#include <system_error>
 #include <utility>
-#include "boost/lexical_cast.hpp"
 #include "calculator.h"
+#include "calculator_profile.h"
+#include "function_registry.h"
 
-using std::cerr;
 using std::cout;
 using std::endl;
 using std::function;
 using std::string;
-using std::regex;
-using std::regex_replace;
-using std::regex_search;
-using std::sregex_iterator;
-using std::distance;
-using std::move;
-using std::make_tuple;
+using std::map;
+using std::vector;
 
 /*
- * The intent of the format_* functions is to transform the input equation into a proper white-space
- * delimited string that can be trivially tokenized into the operator and value stacks. Pasting
- * from the Mac OS Numbers application or Microsoft Excel is supported.
- *
- * The intent of the validate_* functions is to check for invalid equations.
+ * Equations are tokenized in a single pass by Infix_lexer. Pasting from the Mac OS Numbers
+ * application or Microsoft Excel is supported. The tokens are kept so that format() can pretty-print
+ * the equation on demand.
  */
-
-// Format
-// The Mac OS Numbers application uses a look-alike minus sign. This function replaces it with '-'.
-regex Infix_calculator::rgx_looks_like_minus(R"(−)");
-
-Infix_calculator &Infix_calculator::format_fix_minus() {
-    equation = regex_replace(equation, rgx_looks_like_minus, "-");
-    return *this;
-}
-
-/*
- * The Mac OS Numbers application uses an alternate division character. This function replaces it
- * with '/'.
- */
-regex Infix_calculator::rgx_div_char(R"(÷)");
-
-Infix_calculator &Infix_calculator::format_fix_divide() {
-    equation = regex_replace(equation, rgx_div_char, "/");
-    return *this;
-}
-
-/*
- * The Mac OS Numbers application uses an alternate multiplication character. This function
- * replaces it with '*'.
- */
-regex Infix_calculator::rgx_times_char(R"(×)");
-
-Infix_calculator &Infix_calculator::format_fix_multiply() {
-    equation = regex_replace(equation, rgx_times_char, "*");
-    return *this;
-}
-
-// Make operators distinct from signs. -1+-1 becomes -1 + -1.
-regex Infix_calculator::rgx_operator_sign("([+\\-*\\/^])([+-]\\d+\\.?\\d*)");
-regex Infix_calculator::rgx_digit_operator("([\\d()])([+\\-*\\/^])");
-regex Infix_calculator::rgx_only_sign("(\\d\\s*)([+\\-])(\\s*\\d)");
-
-Infix_calculator &Infix_calculator::format_pad_operators() {
-    equation = regex_replace(equation, rgx_operator_sign, "$1 $2");
-    equation = regex_replace(equation, rgx_digit_operator, "$1 $2 ");
-    equation = regex_replace(equation, rgx_only_sign, "$1 $2 $3");
-    return *this;
-}
-
-// Adds spaces around parentheses to support tokenization by white space.
-regex Infix_calculator::rgx_parentheses("([()])");
-
-Infix_calculator &Infix_calculator::format_pad_parentheses() {
-    equation = regex_replace(equation, rgx_parentheses, " $1 ");
-    return *this;
-}
-
-// Remove leading and trailing spaces.
-regex Infix_calculator::rgx_trim("^\\s|\\s$");
-Infix_calculator &Infix_calculator::format_trim() {
-    equation = regex_replace(equation, rgx_trim, "");
-    return *this;
-}
-
-// Multiple spaces are condensed to one. Improves readability for humans.
-regex Infix_calculator::rgx_spaces("(\\s{2,})");
-
-Infix_calculator &Infix_calculator::format_condense_spaces() {
-    equation = regex_replace(equation, rgx_spaces, " ");
-    return *this;
-}
-
-// Validate
-regex Infix_calculator::rgx_allowed_chars("([^()\\s\\d+\\-*\\/.^])", std::regex_constants::icase);
-
-bool Infix_calculator::validate_characters() {
-    bool result{false};
-    if (regex_search(equation, rgx_allowed_chars)) {
-        cerr << endl << "Detected invalid characters in: " << equation << endl;
-        result = true;
+void Infix_calculator::scan() {
+    if (not scanned) {
+        Calculator_profile::timer timed{Calculator_profile::parse};
+        Infix_lexer lexer{equation};
+        error = lexer.scan(tokens);
+        error_at = lexer.error_offset();
+        Calculator_profile::count_tokens(tokens.size());
+        names = lexer.variables();
+        scanned = true;
     }
-    return result;
-}
-
-/*
- * Finds sequences of 3 or more operators, and doubled * or /. Also finds more than one operator
- * between sets of parentheses. The algorithm gets this wrong so its excluded. The Mac OS Numbers
- * application and MS Excel get these right so these's room for improvement.
- */
-regex Infix_calculator::rgx_excess_operators
-        ("([+\\-*\\/]\\s{0,}){3,}|([*\\/^]\\s*){2,}|\\)\\s*([+\\-*\\/^]\\s*[+\\-*\\/^])\\s*\\(");
-
-bool Infix_calculator::validate_operator_sequence() {
-    bool result{false};
-    if (regex_search(equation, rgx_excess_operators)) {
-        cerr << endl << "Detected invalid sequence of operators in: " << equation << endl;
-        result = true;
-    }
-    return result;
-}
-
-regex Infix_calculator::rgx_left_parenthesis("(\\()");
-regex Infix_calculator::rgx_right_parenthesis("(\\))");
-
-bool Infix_calculator::validate_balanced_parentheses() {
-    auto it_l = sregex_iterator(equation.begin(), equation.end(), rgx_left_parenthesis);
-    long left = distance(it_l, sregex_iterator());
-
-    auto it_r = sregex_iterator(equation.begin(), equation.end(), rgx_right_parenthesis);
-    long right = distance(it_r, sregex_iterator());
-
-    bool result{false};
-    if (left not_eq right) {
-        cerr << endl << "Detected unbalanced parentheses in: " << equation << std::endl;
-        result = true;
-    }
-    return result;
 }
 
 // Calculate
@@ -168,7 +57,7 @@ double Infix_calculator::exponent(const double &x, const double &y) {
     return std::pow(x, y);
 };
 
-map<char, function<double(const double &, const double &)>> Infix_calculator::operators = {
+const map<char, function<double(const double &, const double &)>> Infix_calculator::operators = {
         {'+', &Infix_calculator::plus},
         {'-', &Infix_calculator::minus},
         {'*', &Infix_calculator::multiply},
@@ -182,7 +71,7 @@ map<char, function<double(const double &, const double &)>> Infix_calculator::op
  * 2. Multiplication, Division
  * 3. Addition, Subtraction
  */
-map<const char, const int> Infix_calculator::operator_precedence = {
+const map<const char, const int> Infix_calculator::operator_precedence = {
         {'(', 1},
         {')', 1},
         {'^', 1},
@@ -202,111 +91,122 @@ void Infix_calculator::calculate() {
     operator_ = operator_stack.front();
     operator_stack.pop_front();
     // 2 Pop the value stack twice, getting two operands.
-    if (int(value_stack.size()) > 1) {
-        operand = value_stack.front();
-        value_stack.pop_front();
-        operand_l = value_stack.front();
-        value_stack.pop_front();
-    } else {
-        cerr << "Equation lacks sufficient values." << std::endl;
-        auto err = std::make_error_condition(std::errc::operation_canceled);
-        throw std::runtime_error(err.message());
+    if (int(value_stack.size()) < 2) {
+        // The lexer rejects an operator without an operand on each side, so this is not reached.
+        error = Infix_lexer::operator_sequence;
+        error_at = equation.size();
+        return;
     }
+    operand = value_stack.front();
+    value_stack.pop_front();
+    operand_l = value_stack.front();
+    value_stack.pop_front();
     // 3 Apply the operator to the operands, in the correct order.
+    Calculator_profile::count_operator();
     debug ? cout << "operator " << operator_ << ", operand_l " << operand_l << ", operand "
                  << operand << std::endl : cout;
-    result = Infix_calculator::operators[operator_](operand_l, operand);
+    result = Infix_calculator::operators.at(operator_)(operand_l, operand);
     // 4 Push the result onto the value stack.
     value_stack.emplace_front(result);
     debug ? cout << "Pushing " << result << " onto value stack. Size = "<< int(value_stack.size())
                  << std::endl : cout;
 };
 
-bool Infix_calculator::is_double(const string &token) {
-    try {
-        boost::lexical_cast<double>(token);
-    }
-    catch (boost::bad_lexical_cast &) {
-        return false;
-    }
-    return true;
-};
+// Replaces the arguments of the innermost function call on the value stack with its result.
+void Infix_calculator::call() {
+    auto called = calls.front();
+    calls.pop_front();
+    auto &function = Function_registry::at(called.function);
+    Calculator_profile::count_call();
+    double result = function.apply(value_stack.front_items(called.arguments), called.arguments);
+    value_stack.pop_front(called.arguments);
+    value_stack.emplace_front(result);
+    debug ? cout << "function " << function.name << ", " << called.arguments << " arguments"
+                 << std::endl << "Pushing " << result << " onto value stack. Size = "
+                 << int(value_stack.size()) << std::endl : cout;
+}
 
-void Infix_calculator::parse() {
-    parsed_equation.clear();
-    string token;                      // Equation will be parsed into grammatical tokens.
-    equation = format();
-    if (not validate()) {
-        regex token_regex(R"(\S+)");
-        auto tokens_begin = sregex_iterator(equation.begin(), equation.end(), token_regex);
-        auto tokens_end = sregex_iterator();
-        for (sregex_iterator it = tokens_begin; it != tokens_end; ++it) {
-            std::smatch match = *it;
-            token = match.str();
-            if (is_double(token)) {
-                parsed_equation.push_front(make_tuple(token_type::number, token));
-            } else if (token == "(") {
-                parsed_equation.push_front(make_tuple(token_type::left_parenthesis, token));
-            } else if (token == ")") {
-                parsed_equation.push_front(make_tuple(token_type::right_parenthesis, token));
-            } else {
-                auto search = operators.find(*token.c_str());
-                if (search != operators.end()) {
-                    parsed_equation.push_front(make_tuple(token_type::arithmetic_operator, token));
-                }
-            }
-        }
-        parsed_equation.reverse();
-    }
+// Scans and validates the equation. Returns true when it can be computed.
+bool Infix_calculator::parse() {
+    operator_stack.clear();
+    value_stack.clear();
+    calls.clear();
+    return not validate();
 };
 
 // Public Interface.
-Infix_calculator::Infix_calculator(string equation, bool debug) : debug(debug) {
-    this->equation = move(equation);
+Infix_calculator::Infix_calculator(std::string_view equation, bool debug)
+        : debug(debug), equation(equation) {
+};
+
+Infix_calculator &Infix_calculator::bind(const double *values) {
+    this->values = values;
+    return *this;
+};
+
+const vector<string> &Infix_calculator::variables() {
+    scan();
+    return names;
 };
 
 string Infix_calculator::format() {
-    this->format_fix_minus()
-            .format_fix_divide()
-            .format_fix_multiply()
-            .format_pad_operators()
-            .format_pad_parentheses()
-            .format_condense_spaces()
-            .format_trim();
-    return equation;
+    scan();
+    if (error not_eq Infix_lexer::none) {
+        return equation;
+    }
+    Calculator_profile::timer timed{Calculator_profile::format};
+    return Infix_lexer::format(tokens);
 };
 
+// The scan is timed as parse as well, when this is what runs it.
 bool Infix_calculator::validate() {
-    return this->validate_characters() or
-           this->validate_operator_sequence() or
-           this->validate_balanced_parentheses();
+    Calculator_profile::timer timed{Calculator_profile::validate};
+    scan();
+    return error not_eq Infix_lexer::none;
+};
+
+/*
+ * An invalid equation costs a scan and nothing more: the error kind and offset found by the lexer
+ * are returned as they are, so bad rows in a batch are as cheap as good ones.
+ */
+Infix_calculator::result Infix_calculator::solve() {
+    double value = compute();
+    return {value, error, error == Infix_lexer::none ? 0 : error_at};
 };
 
 double Infix_calculator::compute() {
-    parse();
+    if (not parse()) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    Calculator_profile::timer timed{Calculator_profile::evaluate};
     char operator_;    // operator is a reserved word.
     // All algorithm credit to David Matuszek. U Penn CIT 594, 2002.
     // 1. While there are still tokens to be read in,
-    debug ? cout << endl << equation << endl : cout;
-    for (auto token : parsed_equation) {
+    debug ? cout << endl << format() << endl : cout;
+    for (auto &token : tokens) {
         // 1.1 Get the next token.
-        int type = static_cast<int>(std::get<0>(token));
-        string value = boost::lexical_cast<string>(std::get<1>(token));
         // 1.2 If the token is:
-        switch (type) {
+        switch (token.type) {
             // 1.2.1 A number: push it onto the value stack.
             case token_type::number : {
-                value_stack.emplace_front(std::atof(value.c_str()));
+                value_stack.emplace_front(token.value);
+                Calculator_profile::stack_depth(value_stack.size(), operator_stack.size());
                 debug ? cout << "Pushing " << value_stack.front() << " onto value stack. Size = "
                              << int(value_stack.size()) << endl : cout;
                 break;
-            } // 1.2.2 A variable: get its value, and push onto the value stack. (Not implemented.)
+            } // 1.2.2 A variable: get its value, and push onto the value stack.
             case token_type::variable : {
-                // Do nothing. Not implemented.
+                value_stack.emplace_front(values ? values[token.slot]
+                                                 : std::numeric_limits<double>::quiet_NaN());
+                Calculator_profile::stack_depth(value_stack.size(), operator_stack.size());
+                debug ? cout << "Pushing " << token.text << " = " << value_stack.front()
+                             << " onto value stack. Size = " << int(value_stack.size()) << endl
+                      : cout;
                 break;
             } // 1.2.3 A left parenthesis: push it onto the operator stack.
             case token_type::left_parenthesis : {
-                operator_stack.emplace_front(*value.c_str());
+                operator_stack.emplace_front(token.operator_);
+                Calculator_profile::stack_depth(value_stack.size(), operator_stack.size());
                 debug ? cout << "Pushed " << operator_stack.front() << " onto operator stack. Size"
                         " = " << int(operator_stack.size()) << endl : cout;
                 break;
@@ -318,28 +218,48 @@ double Infix_calculator::compute() {
                 }
                 // 2 Pop the left parenthesis from the operator stack, and discard it.
                 operator_stack.pop_front();
+                // 3 If it opened the arguments of a function, call the function.
+                if (int(operator_stack.size()) > 0 and operator_stack.front() == 'f') {
+                    operator_stack.pop_front();
+                    call();
+                }
                 break;
             } // 1.2.5 An operator (call it operator_):
             case token_type::arithmetic_operator : {
-                auto search = operators.find(*value.c_str());
+                auto search = operators.find(token.operator_);
                 if (search != operators.end()) {
-                    operator_ = *value.c_str();
+                    operator_ = token.operator_;
                     // 1 While the operator stack is not empty, and the top thing on the
                     //   operator stack has the same or greater precedence as operator_,
                     //   and that thing is not a left parenthesis:
                     while (int(operator_stack.size()) > 0 and
                            int(value_stack.size()) >= 2 and
-                           operator_precedence[operator_stack.front()] <=
-                           operator_precedence[operator_] and
+                           operator_precedence.at(operator_stack.front()) <=
+                           operator_precedence.at(operator_) and
                            operator_stack.front() != '(') {
                         calculate();
                     }
                     // 2 Push operator_ onto the operator stack.
                     operator_stack.emplace_front(operator_);
+                    Calculator_profile::stack_depth(value_stack.size(), operator_stack.size());
                     debug ? cout << "Pushed " << operator_ << " onto the operator stack. Size = "
                                  << int(operator_stack.size()) << endl : cout;
                 }
                 break;
+            } // 1.2.6 A function name: push a marker onto the operator stack, under the left
+              //       parenthesis that follows, and start counting its arguments.
+            case token_type::function_name : {
+                operator_stack.emplace_front('f');
+                calls.emplace_front({token.slot, 1});
+                debug ? cout << "Calling " << token.text << "." << endl : cout;
+                break;
+            } // 1.2.7 A comma: finish the argument before it.
+            case token_type::comma : {
+                while (operator_stack.front() != '(') {
+                    calculate();
+                }
+                ++calls.front().arguments;
+                break;
             }
         }
     }
@@ -349,6 +269,9 @@ double Infix_calculator::compute() {
     }
     // 3. At this point the operator stack should be empty, and the value stack should have
     // only one value in it, which is the final result.
+    if (error not_eq Infix_lexer::none) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
     return value_stack.front();
 }
 
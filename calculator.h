@@ -6,90 +6,85 @@
 #define INC_9_CALCULATOR_CALCULATOR_H
 
 #include <string>
+#include <string_view>
 #include <map>
-#include <list>
-#include <tuple>
-#include <regex>
-
-using std::string;
-using std::map;
-using std::regex;
-using std::function;
-using std::list;
-using std::tuple;
+#include <vector>
+#include <functional>
+#include "infix_lexer.h"
+#include "small_stack.h"
 
 class Infix_calculator {
 
 public:
-    explicit Infix_calculator(string equation, bool debug = false);
-
-    string format();
-
-    bool validate();
+    // The equation is copied, so the caller's buffer need not outlive the calculator.
+    explicit Infix_calculator(std::string_view equation, bool debug = false);
 
-    double solve();
+    // Tokens refer into the equation held by this object, so it is not copied.
+    Infix_calculator(const Infix_calculator &) = delete;
 
-    double compute();
-
-private:
-    // Format
-    static regex rgx_looks_like_minus;
-    Infix_calculator &format_fix_minus();
+    Infix_calculator &operator=(const Infix_calculator &) = delete;
 
-    static regex rgx_div_char;
-    Infix_calculator &format_fix_divide();
+    // The outcome of solving an equation: its value, or the kind of error and its byte offset.
+    struct result {
+        double value;
+        Infix_lexer::error_kind error;
+        size_t offset;
 
-    static regex rgx_times_char;
-    Infix_calculator &format_fix_multiply();
+        bool valid() const {
+            return error == Infix_lexer::none;
+        }
+    };
 
-    static regex rgx_operator_sign;
-    static regex rgx_digit_operator;
-    static regex rgx_only_sign;
-    Infix_calculator &format_pad_operators();
+    std::string format();
 
-    static regex rgx_parentheses;
-    Infix_calculator &format_pad_parentheses();
+    // True when the equation is invalid. Nothing is printed; solve() says what is wrong and where.
+    bool validate();
 
-    static regex rgx_trim;
-    Infix_calculator &format_trim();
+    // Solves the equation. An invalid one is reported in the result, without I/O or exceptions.
+    result solve();
 
-    static regex rgx_spaces;
-    Infix_calculator &format_condense_spaces();
+    // The value of the equation, or NaN when it is invalid.
+    double compute();
 
-    // Validate
-    static regex rgx_allowed_chars;
-    bool validate_characters();
+    // values[i] is the value of variables()[i]. The array must outlive compute().
+    Infix_calculator &bind(const double *values);
 
-    static regex rgx_excess_operators;
-    bool validate_operator_sequence();
+    const std::vector<std::string> &variables();
 
-    static regex rgx_left_parenthesis;
-    static regex rgx_right_parenthesis;
-    bool validate_balanced_parentheses();
+private:
+    friend class Compiled_expression;
+    friend class Incremental_expression;
+
+    // Scan
+    typedef Infix_lexer::token_type token_type;
+    std::vector<Infix_lexer::token> tokens;
+    std::vector<std::string> names;
+    Infix_lexer::error_kind error{Infix_lexer::none};
+    size_t error_at{0};
+    bool scanned{false};
+    void scan();
 
     // Calculate
     bool debug{false};
-    string equation;
-    list<char> operator_stack;
-    list<double> value_stack;
+    std::string equation;
+    Small_stack<char, 32> operator_stack;
+    Small_stack<double, 32> value_stack;
+    // The function calls whose arguments are being read, innermost at the front.
+    struct pending_call {
+        size_t function;
+        size_t arguments;
+    };
+    Small_stack<pending_call, 8> calls;
+    const double *values{nullptr};
     static double plus(const double &x, const double &y);
     static double minus(const double &x, const double &y);
     static double multiply(const double &x, const double &y);
     static double divide(const double &x, const double &y);
     static double exponent(const double &x, const double &y);
-    static map<char, function<double(const double &, const double &)>> operators;
-    static map<const char, const int> operator_precedence;
+    static const std::map<char, std::function<double(const double &, const double &)>> operators;
+    static const std::map<const char, const int> operator_precedence;
     void calculate();
-    bool is_double(const string &token);
-    // These integers align to the outline used in compute(), e.g.; 123 means outline section 1.2.3.
-    enum token_type: int {
-        number              = 121,
-        variable            = 122,
-        left_parenthesis    = 123,
-        right_parenthesis   = 124,
-        arithmetic_operator = 125,
-    };
-    list<tuple<token_type, string>> parsed_equation;
-    void parse();
+    void call();
+    bool parse();
 };
 #endif //INC_9_CALCULATOR_CALCULATOR_H
@@ -0,0 +1,98 @@
+//
+// The C interface of libcalculator.
+//
+
+#include <limits>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "batch_kernels.h"
+#include "calculator.h"
+#include "calculator_api.h"
+#include "compiled_expression.h"
+
+static_assert(int(CALCULATOR_ARGUMENT_COUNT) == int(Infix_lexer::argument_count),
+              "calculator_error must be numbered as Infix_lexer::error_kind");
+
+/*
+ * No C++ exception may cross into C. The only one the library raises is std::bad_alloc, which is
+ * reported as NULL, NaN or -1.
+ */
+struct calculator_expression {
+    Compiled_expression compiled;
+};
+
+const char *calculator_describe(calculator_error error) {
+    return Infix_lexer::describe(Infix_lexer::error_kind(error));
+}
+
+double calculator_solve(const char *equation, size_t length, calculator_error *error,
+                        size_t *offset) {
+    Infix_calculator::result solved{std::numeric_limits<double>::quiet_NaN(), Infix_lexer::none, 0};
+    try {
+        solved = Infix_calculator{std::string_view{equation, length}}.solve();
+    } catch (const std::bad_alloc &) {
+    }
+    if (error) {
+        *error = calculator_error(solved.error);
+    }
+    if (offset) {
+        *offset = solved.offset;
+    }
+    return solved.value;
+}
+
+calculator_expression *calculator_compile(const char *equation, size_t length,
+                                          const char *const *variables, size_t count) {
+    try {
+        std::string_view text{equation, length};
+        if (variables == nullptr) {
+            return new calculator_expression{Compiled_expression{text}};
+        }
+        std::vector<std::string> names{variables, variables + count};
+        return new calculator_expression{Compiled_expression{text, names}};
+    } catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+}
+
+void calculator_free(calculator_expression *expression) {
+    delete expression;
+}
+
+calculator_error calculator_compile_error(const calculator_expression *expression,
+                                          size_t *offset) {
+    if (offset) {
+        *offset = expression->compiled.error_offset();
+    }
+    return calculator_error(expression->compiled.error());
+}
+
+size_t calculator_variable_count(const calculator_expression *expression) {
+    return expression->compiled.variables().size();
+}
+
+const char *calculator_variable(const calculator_expression *expression, size_t slot) {
+    auto &names = expression->compiled.variables();
+    return slot < names.size() ? names[slot].c_str() : nullptr;
+}
+
+double calculator_evaluate(const calculator_expression *expression, const double *values) {
+    try {
+        return expression->compiled.evaluate(values);
+    } catch (const std::bad_alloc &) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+int calculator_evaluate_batch(const calculator_expression *expression,
+                              const double *const *columns, size_t rows, double *result) {
+    try {
+        expression->compiled.evaluate_batch(columns, rows, result);
+        return expression->compiled.valid() ? 0 : -1;
+    } catch (const std::bad_alloc &) {
+        Batch_kernels::fill(result, std::numeric_limits<double>::quiet_NaN(), rows);
+        return -1;
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ * The C interface of libcalculator.
+ */
+
+#ifndef INC_9_CALCULATOR_CALCULATOR_API_H
+#define INC_9_CALCULATOR_CALCULATOR_API_H
+
+#include <stddef.h>
+
+/* The shared library exports these functions and nothing else. */
+#if defined(__GNUC__)
+#define CALCULATOR_API __attribute__((visibility("default")))
+#else
+#define CALCULATOR_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The kinds of error in an equation, numbered as Infix_lexer::error_kind. */
+typedef enum {
+    CALCULATOR_OK,
+    CALCULATOR_INVALID_CHARACTER,
+    CALCULATOR_OPERATOR_SEQUENCE,
+    CALCULATOR_UNBALANCED_PARENTHESES,
+    CALCULATOR_EMPTY_EQUATION,
+    CALCULATOR_UNKNOWN_VARIABLE,
+    CALCULATOR_UNKNOWN_FUNCTION,
+    CALCULATOR_ARGUMENT_COUNT,
+} calculator_error;
+
+/* A compiled equation. It may be evaluated on many threads at once. */
+typedef struct calculator_expression calculator_expression;
+
+/* A short English description of an error, e.g.; "unbalanced parentheses". */
+CALCULATOR_API const char *calculator_describe(calculator_error error);
+
+/*
+ * Solves an equation of length bytes of UTF-8, which need not be null terminated. Returns NaN for
+ * an invalid equation, and sets *error and *offset, the byte offset of the error, when they are
+ * not NULL.
+ */
+CALCULATOR_API double calculator_solve(const char *equation, size_t length,
+                                       calculator_error *error, size_t *offset);
+
+/*
+ * Compiles an equation. variables names the count variables in the order their values will be
+ * passed, or is NULL to take them in order of first appearance. An invalid equation still gives an
+ * expression, whose calculator_compile_error() says what is wrong. Returns NULL only when memory
+ * runs out.
+ */
+CALCULATOR_API calculator_expression *calculator_compile(const char *equation, size_t length,
+                                                         const char *const *variables,
+                                                         size_t count);
+
+CALCULATOR_API void calculator_free(calculator_expression *expression);
+
+/* CALCULATOR_OK, or the kind of error, and its byte offset in *offset when it is not NULL. */
+CALCULATOR_API calculator_error calculator_compile_error(const calculator_expression *expression,
+                                                         size_t *offset);
+
+CALCULATOR_API size_t calculator_variable_count(const calculator_expression *expression);
+
+/* The null terminated name of variable slot, valid as long as the expression, or NULL. */
+CALCULATOR_API const char *calculator_variable(const calculator_expression *expression,
+                                               size_t slot);
+
+/* values[i] is the value of variable i. Returns NaN for an invalid expression. */
+CALCULATOR_API double calculator_evaluate(const calculator_expression *expression,
+                                          const double *values);
+
+/*
+ * Evaluates rows of values held by the caller in columns: columns[i] points to rows values of
+ * variable i, and rows results are written to result. Nothing is copied in or out, so the buffers
+ * of, e.g.; a NumPy array or an Arrow column can be passed as they are, and result may be one of
+ * the columns. Returns 0, or -1 when the expression is invalid or memory runs out, in which case
+ * result is filled with NaN.
+ */
+CALCULATOR_API int calculator_evaluate_batch(const calculator_expression *expression,
+                                             const double *const *columns, size_t rows,
+                                             double *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_9_CALCULATOR_CALCULATOR_API_H */
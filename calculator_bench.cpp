@@ -0,0 +1,727 @@
+//
+// Benchmarks for the calculator, built as the calculator_bench target on Google Benchmark.
+//
+// ./calculator_bench --benchmark_format=json > results.json
+//
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <map>
+#include <filesystem>
+#include "benchmark/benchmark.h"
+#include "boost/lexical_cast.hpp"
+#include "calculator.h"
+#include "infix_lexer.h"
+#include "compiled_expression.h"
+#include "batch_kernels.h"
+#include "batch_evaluator.h"
+#include "calculator_cases.h"
+#include "native_expression.h"
+#include "numeric_expression.h"
+#include "incremental_expression.h"
+#include "program_catalog.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// Equations from Infix_calculator_testing::cases, from short to long.
+const vector<string> stage_equations{
+        "5+2*3",
+        "5÷(2×(3^3))",
+        "(8.4 −+7.1)-(9.9× +1.0) −+3.4 + 4.6 ÷ 7.3",
+        "(8−−7)+(9×+1) −−3.4 − 4 ÷ 7*2^2",
+};
+
+// A sum of terms, each a small parenthesized product. Its length grows linearly with terms.
+string long_equation(int64_t terms) {
+    string equation;
+    for (int64_t term = 0; term < terms; ++term) {
+        equation += term ? " + " : "";
+        equation += "(" + std::to_string(term % 89) + ".25 × 3 − " + std::to_string(term % 7) + ")";
+    }
+    return equation;
+}
+
+// 1 × (2 × (3 × ...)) nested depth parentheses deep.
+string nested_equation(int64_t depth) {
+    string equation;
+    for (int64_t level = 0; level < depth; ++level) {
+        equation += std::to_string(level % 9 + 1) + " × (";
+    }
+    equation += "1";
+    equation += string(size_t(depth), ')');
+    return equation;
+}
+
+// Stages of Infix_calculator, one equation per argument.
+void format(benchmark::State &state) {
+    const string &equation = stage_equations[state.range(0)];
+    for (auto _ : state) {
+        Infix_calculator c{equation};
+        benchmark::DoNotOptimize(c.format());
+    }
+    state.SetLabel(equation);
+}
+
+void validate(benchmark::State &state) {
+    const string &equation = stage_equations[state.range(0)];
+    for (auto _ : state) {
+        Infix_calculator c{equation};
+        benchmark::DoNotOptimize(c.validate());
+    }
+    state.SetLabel(equation);
+}
+
+void parse(benchmark::State &state) {
+    const string &equation = stage_equations[state.range(0)];
+    vector<Infix_lexer::token> tokens;
+    for (auto _ : state) {
+        Infix_lexer lexer{equation};
+        benchmark::DoNotOptimize(lexer.scan(tokens));
+    }
+    state.SetLabel(equation);
+}
+
+// compute() on an equation that is already scanned, so only the evaluation is timed.
+void compute(benchmark::State &state) {
+    const string &equation = stage_equations[state.range(0)];
+    Infix_calculator c{equation};
+    c.validate();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(c.compute());
+    }
+    state.SetLabel(equation);
+}
+
+void compile(benchmark::State &state) {
+    const string &equation = stage_equations[state.range(0)];
+    for (auto _ : state) {
+        Compiled_expression compiled{equation};
+        benchmark::DoNotOptimize(compiled.instructions().data());
+    }
+    state.SetLabel(equation);
+}
+
+void evaluate(benchmark::State &state) {
+    const string &equation = stage_equations[state.range(0)];
+    Compiled_expression compiled{equation};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(compiled.evaluate());
+    }
+    state.SetLabel(equation);
+}
+
+BENCHMARK(format)->DenseRange(0, int(stage_equations.size()) - 1);
+BENCHMARK(validate)->DenseRange(0, int(stage_equations.size()) - 1);
+BENCHMARK(parse)->DenseRange(0, int(stage_equations.size()) - 1);
+BENCHMARK(compute)->DenseRange(0, int(stage_equations.size()) - 1);
+BENCHMARK(compile)->DenseRange(0, int(stage_equations.size()) - 1);
+BENCHMARK(evaluate)->DenseRange(0, int(stage_equations.size()) - 1);
+
+/*
+ * solve() from input string to result on each stage equation and on the same equation with a
+ * mistake in it. An invalid equation is reported in the result, so it should cost no more.
+ */
+const vector<string> invalid_equations{
+        "5+2*",
+        "5÷(2×(3^3)",
+        "(8.4 −+7.1)-(9.9× +1.0) −+3.4 + 4.6 ÷ 7.3 $",
+        "(8−−7)+(9×+1) −−3.4 − 4 ÷÷ 7*2^2",
+};
+
+void solve_valid(benchmark::State &state) {
+    const string &equation = stage_equations[state.range(0)];
+    for (auto _ : state) {
+        Infix_calculator c{equation};
+        benchmark::DoNotOptimize(c.solve());
+    }
+    state.SetLabel(equation);
+}
+
+void solve_invalid(benchmark::State &state) {
+    const string &equation = invalid_equations[state.range(0)];
+    for (auto _ : state) {
+        Infix_calculator c{equation};
+        benchmark::DoNotOptimize(c.solve());
+    }
+    state.SetLabel(equation);
+}
+
+BENCHMARK(solve_valid)->DenseRange(0, int(stage_equations.size()) - 1);
+BENCHMARK(solve_invalid)->DenseRange(0, int(invalid_equations.size()) - 1);
+
+// Whole equations of growing length and nesting depth, from input string to result.
+void solve_length(benchmark::State &state) {
+    string equation = long_equation(state.range(0));
+    for (auto _ : state) {
+        Infix_calculator c{equation};
+        benchmark::DoNotOptimize(c.compute());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * equation.size()));
+    state.SetComplexityN(state.range(0));
+}
+
+void compile_length(benchmark::State &state) {
+    string equation = long_equation(state.range(0));
+    for (auto _ : state) {
+        Compiled_expression compiled{equation};
+        benchmark::DoNotOptimize(compiled.evaluate());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * equation.size()));
+    state.SetComplexityN(state.range(0));
+}
+
+void solve_depth(benchmark::State &state) {
+    string equation = nested_equation(state.range(0));
+    for (auto _ : state) {
+        Infix_calculator c{equation};
+        benchmark::DoNotOptimize(c.compute());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * equation.size()));
+    state.SetComplexityN(state.range(0));
+}
+
+void compile_depth(benchmark::State &state) {
+    string equation = nested_equation(state.range(0));
+    for (auto _ : state) {
+        Compiled_expression compiled{equation};
+        benchmark::DoNotOptimize(compiled.evaluate());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * equation.size()));
+    state.SetComplexityN(state.range(0));
+}
+
+BENCHMARK(solve_length)->RangeMultiplier(8)->Range(8, 32768)->Complexity();
+BENCHMARK(compile_length)->RangeMultiplier(8)->Range(8, 32768)->Complexity();
+BENCHMARK(solve_depth)->RangeMultiplier(8)->Range(8, 32768)->Complexity();
+BENCHMARK(compile_depth)->RangeMultiplier(8)->Range(8, 32768)->Complexity();
+
+/*
+ * Machine generated equations of up to eight megabytes, sized in bytes: a long sum, deep nesting
+ * and a sum of distinct variables. Both the calculator and the compiled expression are timed from
+ * input string to result, and the fitted complexity should come out as linear.
+ */
+string stress_equation(int shape, int64_t bytes) {
+    if (shape == 0) {
+        return long_equation(bytes / 22);
+    }
+    if (shape == 1) {
+        return nested_equation(bytes / 7);
+    }
+    string equation{"v0"};
+    for (int64_t i = 1; int64_t(equation.size()) < bytes; ++i) {
+        equation += " + v" + std::to_string(i);
+    }
+    return equation;
+}
+
+void stress(benchmark::State &state, int shape) {
+    string equation = stress_equation(shape, state.range(0));
+    Infix_calculator names{equation};
+    vector<double> values(names.variables().size(), 1.0);
+    for (auto _ : state) {
+        Infix_calculator c{equation};
+        benchmark::DoNotOptimize(c.bind(values.data()).compute());
+        Compiled_expression compiled{equation};
+        benchmark::DoNotOptimize(compiled.evaluate(values.data()));
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * equation.size()));
+    state.SetComplexityN(int64_t(equation.size()));
+}
+
+BENCHMARK_CAPTURE(stress, sum, 0)->RangeMultiplier(4)->Range(1 << 14, 1 << 23)
+        ->Complexity(benchmark::oN)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(stress, nested, 1)->RangeMultiplier(4)->Range(1 << 14, 1 << 23)
+        ->Complexity(benchmark::oN)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(stress, variables, 2)->RangeMultiplier(4)->Range(1 << 14, 1 << 23)
+        ->Complexity(benchmark::oN)->Unit(benchmark::kMillisecond);
+
+/*
+ * The test cases with every number replaced by a variable bound to the same value, so that constant
+ * folding leaves the whole program to the interpreter. compute() walks the tokens with its two
+ * stacks; evaluate() runs the threaded program.
+ */
+struct Interpreted_case {
+    string equation;
+    vector<string> names;
+    vector<double> values;
+};
+
+const vector<Interpreted_case> &interpreted_cases() {
+    static const vector<Interpreted_case> cases = [] {
+        vector<Interpreted_case> cases;
+        for (auto &test : calculator_cases) {
+            Interpreted_case variable;
+            vector<Infix_lexer::token> tokens;
+            Infix_lexer lexer{test.equation};
+            lexer.scan(tokens);
+            for (auto &token : tokens) {
+                variable.equation += variable.equation.empty() ? "" : " ";
+                if (token.type == Infix_lexer::number) {
+                    variable.names.push_back("v" + std::to_string(variable.names.size()));
+                    variable.values.push_back(token.value);
+                    variable.equation += variable.names.back();
+                } else {
+                    variable.equation += token.operator_;
+                }
+            }
+            cases.push_back(variable);
+        }
+        return cases;
+    }();
+    return cases;
+}
+
+void compute_cases(benchmark::State &state) {
+    vector<std::unique_ptr<Infix_calculator>> calculators;
+    for (auto &test : interpreted_cases()) {
+        calculators.emplace_back(new Infix_calculator(test.equation));
+        calculators.back()->bind(test.values.data()).validate();
+    }
+    for (auto _ : state) {
+        for (auto &c : calculators) {
+            benchmark::DoNotOptimize(c->compute());
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * calculators.size()));
+}
+
+void evaluate_cases(benchmark::State &state) {
+    vector<Compiled_expression> compiled;
+    for (auto &test : interpreted_cases()) {
+        compiled.emplace_back(test.equation, test.names);
+    }
+    auto &cases = interpreted_cases();
+    for (auto _ : state) {
+        for (size_t i = 0; i < compiled.size(); ++i) {
+            benchmark::DoNotOptimize(compiled[i].evaluate(cases[i].values.data()));
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * compiled.size()));
+}
+
+void native_cases(benchmark::State &state) {
+    vector<std::unique_ptr<Native_expression>> native;
+    for (auto &test : interpreted_cases()) {
+        native.emplace_back(new Native_expression(Compiled_expression{test.equation, test.names}));
+    }
+    auto &cases = interpreted_cases();
+    for (auto _ : state) {
+        for (size_t i = 0; i < native.size(); ++i) {
+            benchmark::DoNotOptimize(native[i]->evaluate(cases[i].values.data()));
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * native.size()));
+    state.SetLabel(Native_expression::supported() ? "x86-64" : "interpreted");
+}
+
+BENCHMARK(compute_cases);
+BENCHMARK(evaluate_cases);
+BENCHMARK(native_cases);
+
+/*
+ * The test cases evaluated in each number type, to price exactness against speed. Numeric
+ * expressions are not optimized, so double here is the baseline for the others rather than
+ * evaluate_cases.
+ */
+template<typename Number>
+void numeric_cases(benchmark::State &state) {
+    vector<Numeric_expression<Number>> expressions;
+    for (auto &test : calculator_cases) {
+        expressions.emplace_back(test.equation);
+    }
+    for (auto _ : state) {
+        for (auto &expression : expressions) {
+            benchmark::DoNotOptimize(expression.evaluate());
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * expressions.size()));
+}
+
+BENCHMARK_TEMPLATE(numeric_cases, double);
+BENCHMARK_TEMPLATE(numeric_cases, long double);
+BENCHMARK_TEMPLATE(numeric_cases, Fixed_decimal);
+BENCHMARK_TEMPLATE(numeric_cases, Rational);
+
+/*
+ * One equation over a table of variable values, solved row by row with Infix_calculator::compute(),
+ * row by row with Compiled_expression::evaluate(), and a column at a time with evaluate_batch().
+ */
+struct Variable_table {
+    const string equation{"(x−y)÷rate + x*x - y^2 + 3.5*(x+y)"};
+    const vector<string> names{"x", "y", "rate"};
+    static const size_t rows{200000};
+    vector<vector<double>> columns;
+
+    Variable_table() : columns(names.size(), vector<double>(rows)) {
+        for (size_t row = 0; row < rows; ++row) {
+            columns[0][row] = 1.0 + row % 97;
+            columns[1][row] = -2.5 + row % 13;
+            columns[2][row] = 0.01 * (1 + row % 50);
+        }
+    }
+
+    static const Variable_table &instance() {
+        static const Variable_table table;
+        return table;
+    }
+};
+
+void compute_per_row(benchmark::State &state) {
+    auto &table = Variable_table::instance();
+    size_t row{0};
+    double values[3];
+    for (auto _ : state) {
+        for (size_t i = 0; i < 3; ++i) {
+            values[i] = table.columns[i][row];
+        }
+        Infix_calculator c{table.equation};
+        benchmark::DoNotOptimize(c.bind(values).compute());
+        row = (row + 1) % table.rows;
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+void evaluate_per_row(benchmark::State &state) {
+    auto &table = Variable_table::instance();
+    Compiled_expression compiled{table.equation, table.names};
+    size_t row{0};
+    double values[3];
+    for (auto _ : state) {
+        for (size_t i = 0; i < 3; ++i) {
+            values[i] = table.columns[i][row];
+        }
+        benchmark::DoNotOptimize(compiled.evaluate(values));
+        row = (row + 1) % table.rows;
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+void native_per_row(benchmark::State &state) {
+    auto &table = Variable_table::instance();
+    Native_expression native{Compiled_expression{table.equation, table.names}};
+    auto function = native.entry();
+    size_t row{0};
+    double values[3];
+    for (auto _ : state) {
+        for (size_t i = 0; i < 3; ++i) {
+            values[i] = table.columns[i][row];
+        }
+        benchmark::DoNotOptimize(function ? function(values) : native.evaluate(values));
+        row = (row + 1) % table.rows;
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+void evaluate_batch(benchmark::State &state) {
+    auto &table = Variable_table::instance();
+    Compiled_expression compiled{table.equation, table.names};
+    const double *pointers[] = {table.columns[0].data(), table.columns[1].data(),
+                                table.columns[2].data()};
+    vector<double> result(table.rows);
+    for (auto _ : state) {
+        compiled.evaluate_batch(pointers, table.rows, result.data());
+        benchmark::DoNotOptimize(result.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * table.rows));
+    state.SetLabel(Batch_kernels::instruction_set());
+}
+
+BENCHMARK(compute_per_row);
+BENCHMARK(evaluate_per_row);
+BENCHMARK(native_per_row);
+BENCHMARK(evaluate_batch);
+
+// Each built-in function over the columns of Variable_table, in batch and row by row.
+const vector<string> function_equations{
+        "sqrt(x)", "abs(y)", "floor(rate)", "min(x, y, rate)", "max(x, y)", "exp(rate)", "log(x)",
+        "sin(y)",
+};
+
+void function_batch(benchmark::State &state) {
+    auto &table = Variable_table::instance();
+    Compiled_expression compiled{function_equations[state.range(0)], table.names};
+    const double *pointers[] = {table.columns[0].data(), table.columns[1].data(),
+                                table.columns[2].data()};
+    vector<double> result(table.rows);
+    for (auto _ : state) {
+        compiled.evaluate_batch(pointers, table.rows, result.data());
+        benchmark::DoNotOptimize(result.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * table.rows));
+    state.SetLabel(function_equations[state.range(0)] + " " + Batch_kernels::instruction_set());
+}
+
+void function_per_row(benchmark::State &state) {
+    auto &table = Variable_table::instance();
+    Compiled_expression compiled{function_equations[state.range(0)], table.names};
+    size_t row{0};
+    double values[3];
+    for (auto _ : state) {
+        for (size_t i = 0; i < 3; ++i) {
+            values[i] = table.columns[i][row];
+        }
+        benchmark::DoNotOptimize(compiled.evaluate(values));
+        row = (row + 1) % table.rows;
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()));
+    state.SetLabel(function_equations[state.range(0)]);
+}
+
+BENCHMARK(function_batch)->DenseRange(0, int(function_equations.size()) - 1);
+BENCHMARK(function_per_row)->DenseRange(0, int(function_equations.size()) - 1);
+
+/*
+ * Long decimal literals converted the way parse() and compute() used to (boost::lexical_cast to
+ * test the token, then atof), with strtod(), and with the lexer's from_chars based parse_number().
+ */
+const vector<string> long_literals{
+        "3.14159265358979323846264338327950288419716939937510",
+        "271828182845904523536028747135266249775724709369995.9",
+        "0.000000000000000000000000000000000000001234567890123456789",
+        "1.7976931348623157081452742373170435679807056752584",
+        "123456789012345678901234567890.123456789012345678901234567890",
+        "0.30000000000000000000000000000000000000000000000001",
+};
+
+void number_lexical_cast_atof(benchmark::State &state) {
+    for (auto _ : state) {
+        for (auto &literal : long_literals) {
+            benchmark::DoNotOptimize(boost::lexical_cast<double>(literal));
+            benchmark::DoNotOptimize(std::atof(literal.c_str()));
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * long_literals.size()));
+}
+
+void number_strtod(benchmark::State &state) {
+    for (auto _ : state) {
+        for (auto &literal : long_literals) {
+            benchmark::DoNotOptimize(std::strtod(literal.c_str(), nullptr));
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * long_literals.size()));
+}
+
+void number_parse_number(benchmark::State &state) {
+    for (auto _ : state) {
+        for (auto &literal : long_literals) {
+            benchmark::DoNotOptimize(Infix_lexer::parse_number(literal));
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * long_literals.size()));
+}
+
+BENCHMARK(number_lexical_cast_atof);
+BENCHMARK(number_strtod);
+BENCHMARK(number_parse_number);
+
+/*
+ * A dashboard equation of many inputs with one input changed at a time, evaluated in full with
+ * Compiled_expression and incrementally with Incremental_expression. Range is the number of terms.
+ */
+string dashboard_equation(int64_t terms) {
+    string equation{"0"};
+    for (int64_t i = 0; i < terms; ++i) {
+        auto n = std::to_string(i);
+        equation += " + w" + n + " * max(0, x" + n + " - 1) ^ 2";
+    }
+    return equation;
+}
+
+void what_if_full(benchmark::State &state) {
+    Compiled_expression compiled{dashboard_equation(state.range(0))};
+    vector<double> values(compiled.variables().size(), 1.5);
+    size_t slot{0};
+    for (auto _ : state) {
+        values[slot] += 1.0;
+        benchmark::DoNotOptimize(compiled.evaluate(values.data()));
+        slot = (slot + 1) % values.size();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+void what_if_incremental(benchmark::State &state) {
+    Compiled_expression compiled{dashboard_equation(state.range(0))};
+    Incremental_expression incremental{compiled};
+    vector<double> values(compiled.variables().size(), 1.5);
+    incremental.evaluate(values.data());
+    size_t slot{0};
+    size_t recomputed{0};
+    for (auto _ : state) {
+        values[slot] += 1.0;
+        benchmark::DoNotOptimize(incremental.update(slot, values[slot]));
+        recomputed += incremental.recomputed();
+        slot = (slot + 1) % values.size();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()));
+    state.counters["recomputed"] = double(recomputed) / double(state.iterations());
+}
+
+BENCHMARK(what_if_full)->RangeMultiplier(8)->Range(8, 4096);
+BENCHMARK(what_if_incremental)->RangeMultiplier(8)->Range(8, 4096);
+
+/*
+ * The value and gradient of an equation of eight variables: by forward differences, nine
+ * evaluations of the compiled program, or by one evaluation of the same program in Dual<8>. The
+ * bounds over a box, in Interval, are priced alongside.
+ */
+const string sensitivity_equation{"a * (1 + b)^c - d / (e + f^2) + sqrt(g) * exp(0 - h) + "
+                                  "max(a, b, c) * log(1 + d * e)"};
+
+void sensitivity_differences(benchmark::State &state) {
+    Compiled_expression compiled{sensitivity_equation};
+    vector<double> values(compiled.variables().size(), 1.5);
+    vector<double> gradient(values.size());
+    for (auto _ : state) {
+        double value = compiled.evaluate(values.data());
+        for (size_t i = 0; i < values.size(); ++i) {
+            double saved = values[i];
+            values[i] += 1e-7;
+            gradient[i] = (compiled.evaluate(values.data()) - value) / 1e-7;
+            values[i] = saved;
+        }
+        benchmark::DoNotOptimize(gradient.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+void sensitivity_dual(benchmark::State &state) {
+    Compiled_expression compiled{sensitivity_equation};
+    Numeric_expression<Dual<8>> dual{compiled};
+    vector<Dual<8>> values;
+    for (size_t i = 0; i < compiled.variables().size(); ++i) {
+        values.push_back(Dual<8>::variable(1.5, i));
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(dual.evaluate(values.data()));
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+void sensitivity_interval(benchmark::State &state) {
+    Compiled_expression compiled{sensitivity_equation};
+    Numeric_expression<Interval> bounds{compiled};
+    vector<Interval> values(compiled.variables().size(), Interval{1.4, 1.6});
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(bounds.evaluate(values.data()));
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+BENCHMARK(sensitivity_differences);
+BENCHMARK(sensitivity_dual);
+BENCHMARK(sensitivity_interval);
+
+/*
+ * Service start-up with a catalog of range stored formulas: compiling each from its text, against
+ * opening a saved Program_catalog and loading every expression, or opening it alone, where
+ * expressions would be loaded as they are first used.
+ */
+struct Formula_catalog {
+    std::vector<string> names;
+    std::vector<string> formulas;
+    string path;
+
+    explicit Formula_catalog(int64_t size) {
+        vector<Compiled_expression> compiled;
+        for (int64_t i = 0; i < size; ++i) {
+            auto n = std::to_string(i);
+            names.push_back("formula_" + n);
+            formulas.push_back("principal_" + n + " * (1 + rate) ^ years - max(0, fee - " + n +
+                               ".25) * sqrt(volume) / (1 + exp(-0.5 * score_" + n + "))");
+            compiled.emplace_back(formulas.back());
+        }
+        path = (std::filesystem::temp_directory_path() /
+                ("calculator_bench_" + std::to_string(size) + ".catalog")).string();
+        Program_catalog::save(path, names, compiled);
+    }
+
+    ~Formula_catalog() {
+        std::remove(path.c_str());
+    }
+
+    static const Formula_catalog &of(int64_t size) {
+        static std::map<int64_t, std::unique_ptr<Formula_catalog>> made;
+        auto &catalog = made[size];
+        if (not catalog) {
+            catalog = std::make_unique<Formula_catalog>(size);
+        }
+        return *catalog;
+    }
+};
+
+void startup_parse(benchmark::State &state) {
+    auto &formulas = Formula_catalog::of(state.range(0)).formulas;
+    for (auto _ : state) {
+        vector<Compiled_expression> loaded;
+        loaded.reserve(formulas.size());
+        for (auto &formula : formulas) {
+            loaded.emplace_back(formula);
+        }
+        benchmark::DoNotOptimize(loaded.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+void startup_catalog(benchmark::State &state) {
+    auto &path = Formula_catalog::of(state.range(0)).path;
+    for (auto _ : state) {
+        Program_catalog catalog;
+        catalog.open(path);
+        vector<Compiled_expression> loaded;
+        loaded.reserve(catalog.size());
+        for (size_t i = 0; i < catalog.size(); ++i) {
+            loaded.push_back(catalog.expression(i));
+        }
+        benchmark::DoNotOptimize(loaded.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+void startup_open(benchmark::State &state) {
+    auto &path = Formula_catalog::of(state.range(0)).path;
+    for (auto _ : state) {
+        Program_catalog catalog;
+        benchmark::DoNotOptimize(catalog.open(path));
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * state.range(0));
+}
+
+BENCHMARK(startup_parse)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(startup_catalog)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(startup_open)->RangeMultiplier(10)->Range(100, 10000)->Unit(benchmark::kMicrosecond);
+
+/*
+ * Batch mode over equations of very uneven length, with 1 to N threads where N is the number of
+ * hardware threads. Every tenth equation is twenty times longer than the rest.
+ */
+void parallel_batch(benchmark::State &state) {
+    const size_t equations{100000};
+    string lines;
+    for (size_t i = 0; i < equations; ++i) {
+        lines += long_equation(i % 10 == 0 ? 80 : 4) + '\n';
+    }
+    FILE *out = std::tmpfile();
+    for (auto _ : state) {
+        Batch_evaluator batch{size_t(state.range(0))};
+        batch.solve_buffer(lines, out);
+        std::rewind(out);
+    }
+    std::fclose(out);
+    state.SetItemsProcessed(int64_t(state.iterations() * equations));
+}
+
+BENCHMARK(parallel_batch)->DenseRange(1, std::max(1, int(std::thread::hardware_concurrency())))
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
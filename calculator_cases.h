@@ -0,0 +1,51 @@
+//
+// Equations with known results, shared by the tests and the benchmarks.
+//
+
+#ifndef INC_9_CALCULATOR_CALCULATOR_CASES_H
+#define INC_9_CALCULATOR_CALCULATOR_CASES_H
+
+struct Calculator_case {
+    const char *equation;
+    double expected;
+};
+
+// Results are given to 15 significant digits.
+inline constexpr Calculator_case calculator_cases[] = {
+        {"8--7   +8++7",                              30.0},
+        {"(8−−7)+(9×+1) −−3.4 − 4 ÷ 7",               26.8285714285714},
+        {"(8−−7)+(9×+1) −−3.4 − 4 ÷ 7+2^2",           30.8285714285714},
+        {"(8−−7)+(9×+1) −−3.4 − 4 ÷ 7*2^2",           25.1142857142857},
+        {"(8−−7)+(9×+1) −−3.4 − 4 ÷ 7/2^2",           27.2571428571429},
+        {"(8−−7)+(9×+1)−−3.4−4÷7",                    26.8285714285714},
+        {"(8−−7)+(9×+1)−−3.4−4÷7+2^2",                30.8285714285714},
+        {"(8−−7)+(9×+1)−−3.4−4÷7*2^2",                25.1142857142857},
+        {"(8−−7)+(9×+1)−−3.4−4÷7/2^2",                27.2571428571429},
+        {"(8.4 −+7.1)-(9.9× +1.0) −+3.4 + 4.6 ÷ 7.3", -11.3698630136986},
+        {"(8+−7) + (9×-1) +−3.4 − 4 ÷ 7+2^2",         -7.97142857142857},
+        {"(8−−7) *(9×+1) * −3.4 − 4 ÷ 7*2^2",         -461.285714285714},
+        {"(8−−7)/ (9×+1) /−3.4 − 4 ÷ 7/2^2",          -0.633053221288515},
+        {"-1+-1",                                     -2.0},
+        {"-1++1",                                     0.0},
+        {"-(1+2)",                                    -3.0},
+        {"(1+2)+-(3+4)",                              -4.0},
+        {"2^-(1+1)",                                  0.25},
+        {"-(2)^2",                                    4.0},
+        {"8-−(1-3)",                                  6.0},
+        {"5+2*3",                                     11.0},
+        {"5^2*3",                                     75.0},
+        {"5/2*3",                                     7.5},
+        {"2.3^2.2",                                   6.24886639474804},
+        {"5÷2×3^3",                                   67.5},
+        {"5÷(2×(3^3))",                               0.0925925925925926},
+        {"1-2-3",                                     -4.0},
+        {"1+2+3",                                     6.0},
+        {"(1+2)+3",                                   6.0},
+        {"1+(2+3)",                                   6.0},
+        {"1.1-2.2-3.3",                               -4.4},
+        {"1.1+2.2+3.3",                               6.6},
+        {"(1.1+2.2)+3.3",                             6.6},
+        {"1.1+(2.2+3.3)",                             6.6},
+};
+
+#endif //INC_9_CALCULATOR_CALCULATOR_CASES_H
@@ -0,0 +1,146 @@
+//
+// Per-stage timers and counters for Infix_calculator.
+//
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include "calculator_profile.h"
+
+using std::string;
+
+namespace {
+
+const char *const stage_names[Calculator_profile::stage_count] = {
+        "format", "validate", "parse", "evaluate"
+};
+
+} // namespace
+
+const char *Calculator_profile::describe(stage stage_) {
+    return stage_names[stage_];
+}
+
+void Calculator_profile::counters::merge(const counters &other) {
+    for (int i = 0; i < stage_count; ++i) {
+        calls[i] += other.calls[i];
+        nanoseconds[i] += other.nanoseconds[i];
+    }
+    tokens += other.tokens;
+    operators += other.operators;
+    function_calls += other.function_calls;
+    value_stack_high_water = std::max(value_stack_high_water, other.value_stack_high_water);
+    operator_stack_high_water = std::max(operator_stack_high_water, other.operator_stack_high_water);
+}
+
+#if CALCULATOR_PROFILE
+std::mutex Calculator_profile::registry_lock;
+Calculator_profile::accumulator *Calculator_profile::registry{nullptr};
+Calculator_profile::counters Calculator_profile::retired;
+
+// A thread that exits folds its counts into retired.
+Calculator_profile::accumulator::accumulator() {
+    std::lock_guard<std::mutex> guard{registry_lock};
+    next = registry;
+    registry = this;
+}
+
+Calculator_profile::accumulator::~accumulator() {
+    std::lock_guard<std::mutex> guard{registry_lock};
+    retired.merge(snapshot());
+    for (accumulator **link = &registry; *link; link = &(*link)->next) {
+        if (*link == this) {
+            *link = next;
+            break;
+        }
+    }
+}
+
+Calculator_profile::counters Calculator_profile::accumulator::snapshot() const {
+    counters counted;
+    for (int i = 0; i < stage_count; ++i) {
+        counted.calls[i] = calls[i].load(std::memory_order_relaxed);
+        counted.nanoseconds[i] = nanoseconds[i].load(std::memory_order_relaxed);
+    }
+    counted.tokens = tokens.load(std::memory_order_relaxed);
+    counted.operators = operators.load(std::memory_order_relaxed);
+    counted.function_calls = function_calls.load(std::memory_order_relaxed);
+    counted.value_stack_high_water = value_stack_high_water.load(std::memory_order_relaxed);
+    counted.operator_stack_high_water = operator_stack_high_water.load(std::memory_order_relaxed);
+    return counted;
+}
+
+// Racing with the owning thread may keep an increment made during the reset, which is harmless.
+void Calculator_profile::accumulator::clear() {
+    for (int i = 0; i < stage_count; ++i) {
+        calls[i].store(0, std::memory_order_relaxed);
+        nanoseconds[i].store(0, std::memory_order_relaxed);
+    }
+    tokens.store(0, std::memory_order_relaxed);
+    operators.store(0, std::memory_order_relaxed);
+    function_calls.store(0, std::memory_order_relaxed);
+    value_stack_high_water.store(0, std::memory_order_relaxed);
+    operator_stack_high_water.store(0, std::memory_order_relaxed);
+}
+
+Calculator_profile::counters Calculator_profile::collect() {
+    std::lock_guard<std::mutex> guard{registry_lock};
+    counters counted = retired;
+    for (accumulator *live = registry; live; live = live->next) {
+        counted.merge(live->snapshot());
+    }
+    return counted;
+}
+
+void Calculator_profile::reset() {
+    std::lock_guard<std::mutex> guard{registry_lock};
+    retired = counters{};
+    for (accumulator *live = registry; live; live = live->next) {
+        live->clear();
+    }
+}
+#else
+Calculator_profile::counters Calculator_profile::collect() {
+    return counters{};
+}
+
+void Calculator_profile::reset() {}
+#endif
+
+void Calculator_profile::summary(const counters &counted, FILE *out) {
+    if (not enabled) {
+        std::fprintf(out, "Profiling is disabled. Build with -DCALCULATOR_PROFILE=ON.\n");
+        return;
+    }
+    std::fprintf(out, "%-10s %12s %16s %10s\n", "stage", "calls", "nanoseconds", "ns/call");
+    for (int i = 0; i < stage_count; ++i) {
+        std::fprintf(out, "%-10s %12llu %16llu %10.1f\n", stage_names[i],
+                     (unsigned long long) counted.calls[i],
+                     (unsigned long long) counted.nanoseconds[i],
+                     counted.calls[i] ? double(counted.nanoseconds[i]) / counted.calls[i] : 0.0);
+    }
+    std::fprintf(out, "tokens %llu, operators %llu, function calls %llu, value stack high water "
+                      "%llu, operator stack high water %llu\n",
+                 (unsigned long long) counted.tokens, (unsigned long long) counted.operators,
+                 (unsigned long long) counted.function_calls,
+                 (unsigned long long) counted.value_stack_high_water,
+                 (unsigned long long) counted.operator_stack_high_water);
+}
+
+string Calculator_profile::json(const counters &counted) {
+    string out{"{\"enabled\":"};
+    out += enabled ? "true" : "false";
+    out += ",\"stages\":{";
+    for (int i = 0; i < stage_count; ++i) {
+        out += i ? "," : "";
+        out += string("\"") + stage_names[i] + "\":{\"calls\":" + std::to_string(counted.calls[i]) +
+               ",\"nanoseconds\":" + std::to_string(counted.nanoseconds[i]) + "}";
+    }
+    out += "},\"tokens\":" + std::to_string(counted.tokens);
+    out += ",\"operators\":" + std::to_string(counted.operators);
+    out += ",\"function_calls\":" + std::to_string(counted.function_calls);
+    out += ",\"value_stack_high_water\":" + std::to_string(counted.value_stack_high_water);
+    out += ",\"operator_stack_high_water\":" + std::to_string(counted.operator_stack_high_water);
+    out += "}";
+    return out;
+}
@@ -0,0 +1,166 @@
+//
+// Per-stage timers and counters for Infix_calculator.
+//
+
+#ifndef INC_9_CALCULATOR_CALCULATOR_PROFILE_H
+#define INC_9_CALCULATOR_CALCULATOR_PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#ifndef CALCULATOR_PROFILE
+#define CALCULATOR_PROFILE 0
+#endif
+
+#if CALCULATOR_PROFILE
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#endif
+
+/*
+ * Each thread adds to its own accumulator, so the hot path takes no lock and shares no cache line.
+ * collect() sums every thread's accumulator, including those of threads that have exited. Built
+ * without CALCULATOR_PROFILE, the timers and counters are empty inline functions and collect()
+ * returns zeros.
+ */
+class Calculator_profile {
+
+public:
+    enum stage {
+        format, validate, parse, evaluate, stage_count
+    };
+
+    struct counters {
+        uint64_t calls[stage_count]{};
+        uint64_t nanoseconds[stage_count]{};
+        uint64_t tokens{0};
+        uint64_t operators{0};
+        uint64_t function_calls{0};
+        uint64_t value_stack_high_water{0};
+        uint64_t operator_stack_high_water{0};
+
+        void merge(const counters &other);
+    };
+
+    static constexpr bool enabled{CALCULATOR_PROFILE != 0};
+
+    static const char *describe(stage stage_);
+
+    // The totals of every thread so far.
+    static counters collect();
+
+    static void reset();
+
+    // A table of calls, nanoseconds per call and counters.
+    static void summary(const counters &counted, FILE *out);
+
+    static std::string json(const counters &counted);
+
+#if CALCULATOR_PROFILE
+    // Times its own lifetime as one call of a stage.
+    class timer {
+
+    public:
+        explicit timer(stage stage_) : stage_(stage_), start(std::chrono::steady_clock::now()) {}
+
+        ~timer();
+
+        timer(const timer &) = delete;
+
+        timer &operator=(const timer &) = delete;
+
+    private:
+        stage stage_;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    static void count_tokens(size_t tokens) {
+        add(local().tokens, tokens);
+    }
+
+    static void count_operator(size_t operators = 1) {
+        add(local().operators, operators);
+    }
+
+    static void count_call(size_t calls = 1) {
+        add(local().function_calls, calls);
+    }
+
+    static void stack_depth(size_t values, size_t operators) {
+        auto &counted = local();
+        raise(counted.value_stack_high_water, values);
+        raise(counted.operator_stack_high_water, operators);
+    }
+
+private:
+    struct accumulator {
+        std::atomic<uint64_t> calls[stage_count]{};
+        std::atomic<uint64_t> nanoseconds[stage_count]{};
+        std::atomic<uint64_t> tokens{0};
+        std::atomic<uint64_t> operators{0};
+        std::atomic<uint64_t> function_calls{0};
+        std::atomic<uint64_t> value_stack_high_water{0};
+        std::atomic<uint64_t> operator_stack_high_water{0};
+        accumulator *next{nullptr};
+
+        accumulator();
+
+        ~accumulator();
+
+        counters snapshot() const;
+
+        void clear();
+    };
+
+    // Only the owning thread writes, so relaxed loads and stores suffice and collect() sees no tear.
+    static void add(std::atomic<uint64_t> &counter, uint64_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static void raise(std::atomic<uint64_t> &counter, uint64_t value) {
+        if (value > counter.load(std::memory_order_relaxed)) {
+            counter.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    static accumulator &local();
+
+    // Live accumulators form an intrusive list, so registering a thread does not allocate.
+    static std::mutex registry_lock;
+    static accumulator *registry;
+    static counters retired;
+#else
+    class timer {
+
+    public:
+        explicit timer(stage) {}
+    };
+
+    static void count_tokens(size_t) {}
+
+    static void count_operator(size_t = 1) {}
+
+    static void count_call(size_t = 1) {}
+
+    static void stack_depth(size_t, size_t) {}
+#endif
+};
+
+#if CALCULATOR_PROFILE
+inline Calculator_profile::accumulator &Calculator_profile::local() {
+    static thread_local accumulator counted;
+    return counted;
+}
+
+inline Calculator_profile::timer::~timer() {
+    auto &counted = local();
+    add(counted.calls[stage_], 1);
+    add(counted.nanoseconds[stage_], uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count()));
+}
+#endif
+
+#endif //INC_9_CALCULATOR_CALCULATOR_PROFILE_H
@@ -0,0 +1,550 @@
+//
+// A long-lived evaluation daemon on a Unix domain socket.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "compiled_expression.h"
+#include "calculator_server.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define CALCULATOR_SERVER_SOCKETS 1
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace {
+
+template<typename T>
+void put(string &out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+void put_text(string &out, string_view text) {
+    put<uint32_t>(out, uint32_t(text.size()));
+    out.append(text);
+}
+
+// Starts a frame whose length end_frame() fills in.
+size_t begin_frame(string &out) {
+    size_t start = out.size();
+    put<uint32_t>(out, 0);
+    return start;
+}
+
+void end_frame(string &out, size_t start) {
+    uint32_t length = uint32_t(out.size() - start - sizeof(uint32_t));
+    std::memcpy(&out[start], &length, sizeof(length));
+}
+
+// Reads a payload front to back, failing rather than reading past its end.
+struct reader {
+    string_view in;
+
+    template<typename T>
+    bool get(T &value) {
+        if (in.size() < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, in.data(), sizeof(T));
+        in.remove_prefix(sizeof(T));
+        return true;
+    }
+
+    bool get_text(string &text) {
+        uint32_t length;
+        if (not get(length) or in.size() < length) {
+            return false;
+        }
+        text.assign(in.data(), length);
+        in.remove_prefix(length);
+        return true;
+    }
+};
+
+// The length of the frame starting buffer, once its length has arrived.
+bool frame_length(string_view buffer, uint32_t &length) {
+    if (buffer.size() < sizeof(length)) {
+        return false;
+    }
+    std::memcpy(&length, buffer.data(), sizeof(length));
+    return true;
+}
+
+#ifdef CALCULATOR_SERVER_SOCKETS
+bool make_nonblocking(int descriptor) {
+    int flags = fcntl(descriptor, F_GETFL, 0);
+    return flags >= 0 and fcntl(descriptor, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+bool socket_address(const string &path, sockaddr_un &address) {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+#endif
+
+} // namespace
+
+void Calculator_server::encode_request(uint32_t id, const vector<query> &queries, string &out) {
+    size_t start = begin_frame(out);
+    put<uint32_t>(out, id);
+    put<uint32_t>(out, uint32_t(queries.size()));
+    for (auto &q : queries) {
+        put_text(out, q.equation);
+        put<uint32_t>(out, uint32_t(q.bindings.size()));
+        for (auto &b : q.bindings) {
+            put_text(out, b.name);
+            put<double>(out, b.value);
+        }
+    }
+    end_frame(out, start);
+}
+
+void Calculator_server::encode_response(uint32_t id, const vector<outcome> &outcomes, string &out) {
+    size_t start = begin_frame(out);
+    put<uint32_t>(out, id);
+    put<uint32_t>(out, uint32_t(outcomes.size()));
+    for (auto &o : outcomes) {
+        put<uint32_t>(out, uint32_t(o.error));
+        put<uint32_t>(out, o.offset);
+        put<double>(out, o.value);
+    }
+    end_frame(out, start);
+}
+
+size_t Calculator_server::next_frame(string_view buffer, string_view &payload) {
+    uint32_t length;
+    if (not frame_length(buffer, length) or buffer.size() - sizeof(length) < length) {
+        return 0;
+    }
+    payload = buffer.substr(sizeof(length), length);
+    return sizeof(length) + length;
+}
+
+/*
+ * Counts are checked against the bytes left before anything is reserved, so a damaged count
+ * cannot make a huge allocation.
+ */
+bool Calculator_server::decode_request(string_view payload, uint32_t &id, vector<query> &queries) {
+    reader r{payload};
+    uint32_t count;
+    if (not r.get(id) or not r.get(count) or count > r.in.size() / (2 * sizeof(uint32_t))) {
+        return false;
+    }
+    queries.resize(count);
+    for (auto &q : queries) {
+        uint32_t bindings;
+        if (not r.get_text(q.equation) or not r.get(bindings) or
+            bindings > r.in.size() / (sizeof(uint32_t) + sizeof(double))) {
+            return false;
+        }
+        q.bindings.resize(bindings);
+        for (auto &b : q.bindings) {
+            if (not r.get_text(b.name) or not r.get(b.value)) {
+                return false;
+            }
+        }
+    }
+    return r.in.empty();
+}
+
+bool Calculator_server::decode_response(string_view payload, uint32_t &id,
+                                        vector<outcome> &outcomes) {
+    reader r{payload};
+    uint32_t count;
+    if (not r.get(id) or not r.get(count) or
+        count > r.in.size() / (2 * sizeof(uint32_t) + sizeof(double))) {
+        return false;
+    }
+    outcomes.resize(count);
+    for (auto &o : outcomes) {
+        uint32_t error;
+        if (not r.get(error) or not r.get(o.offset) or not r.get(o.value) or
+            error > Infix_lexer::argument_count) {
+            return false;
+        }
+        o.error = Infix_lexer::error_kind(error);
+    }
+    return r.in.empty();
+}
+
+Calculator_server::Calculator_server(size_t threads, size_t cache_capacity)
+        : cache(cache_capacity),
+          pool(new Work_stealing_pool(threads ? threads : std::thread::hardware_concurrency())) {
+#ifdef CALCULATOR_SERVER_SOCKETS
+    if (pipe(wake) == 0) {
+        make_nonblocking(wake[0]);
+        make_nonblocking(wake[1]);
+    }
+#endif
+}
+
+Calculator_server::~Calculator_server() {
+    // The workers write to the wake pipe, so they finish before it is closed.
+    pool.reset();
+#ifdef CALCULATOR_SERVER_SOCKETS
+    for (auto &open : connections) {
+        ::close(open.first);
+    }
+    if (listener >= 0) {
+        ::close(listener);
+        ::unlink(path.c_str());
+    }
+    for (int end : wake) {
+        if (end >= 0) {
+            ::close(end);
+        }
+    }
+#endif
+}
+
+bool Calculator_server::listen(const string &socket_path) {
+#ifdef CALCULATOR_SERVER_SOCKETS
+    sockaddr_un address{};
+    if (listener >= 0 or wake[0] < 0 or not socket_address(socket_path, address)) {
+        return false;
+    }
+    // A socket left by a server that did not exit cleanly is replaced. Other files are not.
+    struct stat status{};
+    if (::stat(socket_path.c_str(), &status) == 0 and S_ISSOCK(status.st_mode)) {
+        ::unlink(socket_path.c_str());
+    }
+    int opened = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (opened < 0) {
+        return false;
+    }
+    if (::bind(opened, reinterpret_cast<sockaddr *>(&address), sizeof(address)) not_eq 0 or
+        ::listen(opened, SOMAXCONN) not_eq 0 or not make_nonblocking(opened)) {
+        ::close(opened);
+        return false;
+    }
+    listener = opened;
+    path = socket_path;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Calculator_server::stop() {
+    stopping = true;
+    signal();
+}
+
+void Calculator_server::signal() {
+#ifdef CALCULATOR_SERVER_SOCKETS
+    // A full pipe already wakes the loop, so a failed write is of no consequence.
+    char byte{0};
+    ssize_t written = ::write(wake[1], &byte, 1);
+    (void) written;
+#endif
+}
+
+Calculator_server::statistics Calculator_server::counters() const {
+    return {accepted, requests, equations, errors};
+}
+
+Expression_cache::statistics Calculator_server::cache_counters() const {
+    return cache.counters();
+}
+
+/*
+ * The cache compiles the canonical form of an equation, so that differently spaced copies share
+ * an entry, and its offsets refer to that form. An invalid equation is therefore compiled again
+ * to locate the error in the equation as it was sent, as is one with a variable left unbound.
+ */
+Calculator_server::outcome Calculator_server::solve(const query &q) {
+    ++equations;
+    thread_local vector<double> values;
+    auto bind = [&q](const vector<string> &names) {
+        values.resize(names.size());
+        for (size_t i = 0; i < names.size(); ++i) {
+            auto found = std::find_if(q.bindings.begin(), q.bindings.end(),
+                                      [&names, i](const binding &b) { return b.name == names[i]; });
+            if (found == q.bindings.end()) {
+                return false;
+            }
+            values[i] = found->value;
+        }
+        return true;
+    };
+    Infix_lexer::error_kind error;
+    size_t offset;
+    auto cached = cache.compile(q.equation, error, offset);
+    if (cached and cached->compiled.valid() and bind(cached->compiled.variables())) {
+        return {cached->constant ? cached->result : cached->compiled.evaluate(values.data()),
+                Infix_lexer::none, 0};
+    }
+    if (cached) {
+        vector<string> names;
+        for (auto &b : q.bindings) {
+            names.push_back(b.name);
+        }
+        Compiled_expression located{q.equation, names};
+        if (located.valid() and bind(names)) {
+            return {located.evaluate(values.data()), Infix_lexer::none, 0};
+        }
+        error = located.error();
+        offset = located.error_offset();
+    }
+    ++errors;
+    return {std::numeric_limits<double>::quiet_NaN(), error, uint32_t(offset)};
+}
+
+/*
+ * One pass of the loop polls the wake pipe, the listening socket and every connection, reads and
+ * decodes whatever requests have arrived and hands them to the pool, then writes every reply that
+ * is done and not waiting behind one that is not.
+ */
+void Calculator_server::run() {
+#ifdef CALCULATOR_SERVER_SOCKETS
+    vector<pollfd> polled;
+    while (not stopping) {
+        polled.clear();
+        polled.push_back({wake[0], POLLIN, 0});
+        polled.push_back({listener, POLLIN, 0});
+        for (auto &open : connections) {
+            auto &c = *open.second;
+            short events = c.reading ? POLLIN : 0;
+            if (c.written < c.output.size()) {
+                events |= POLLOUT;
+            }
+            polled.push_back({c.socket, events, 0});
+        }
+        if (::poll(polled.data(), polled.size(), -1) < 0 and errno not_eq EINTR) {
+            break;
+        }
+        if (polled[0].revents & POLLIN) {
+            char drained[256];
+            while (::read(wake[0], drained, sizeof(drained)) > 0) {}
+        }
+        if (polled[1].revents & POLLIN) {
+            accept_connections();
+        }
+        for (size_t i = 2; i < polled.size(); ++i) {
+            auto &c = *connections.at(polled[i].fd);
+            if (c.reading and polled[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                read_requests(c);
+            } else if (polled[i].revents & (POLLHUP | POLLERR)) {
+                c.failed = true;
+            }
+        }
+        for (auto open = connections.begin(); open not_eq connections.end();) {
+            auto &c = *open->second;
+            if (not c.failed) {
+                write_replies(c);
+            }
+            if (c.failed or (not c.reading and c.replies.empty() and c.output.empty())) {
+                ::close(c.socket);
+                open = connections.erase(open);
+            } else {
+                ++open;
+            }
+        }
+    }
+#endif
+}
+
+void Calculator_server::accept_connections() {
+#ifdef CALCULATOR_SERVER_SOCKETS
+    int accepted_socket;
+    while ((accepted_socket = ::accept(listener, nullptr, nullptr)) >= 0) {
+        if (not make_nonblocking(accepted_socket)) {
+            ::close(accepted_socket);
+            continue;
+        }
+        auto opened = std::make_unique<connection>();
+        opened->socket = accepted_socket;
+        connections.emplace(accepted_socket, std::move(opened));
+        ++accepted;
+    }
+#endif
+}
+
+void Calculator_server::read_requests(connection &c) {
+#ifdef CALCULATOR_SERVER_SOCKETS
+    char buffer[64 * 1024];
+    for (;;) {
+        ssize_t count = ::read(c.socket, buffer, sizeof(buffer));
+        if (count > 0) {
+            c.input.append(buffer, size_t(count));
+            if (size_t(count) < sizeof(buffer)) {
+                break;
+            }
+        } else if (count == 0) {
+            c.reading = false;
+            break;
+        } else if (errno not_eq EINTR) {
+            c.failed = errno not_eq EAGAIN and errno not_eq EWOULDBLOCK;
+            break;
+        }
+    }
+    size_t used{0};
+    string_view payload;
+    while (size_t size = next_frame(string_view(c.input).substr(used), payload)) {
+        used += size;
+        uint32_t id;
+        vector<query> queries;
+        if (size - sizeof(uint32_t) > max_frame or not decode_request(payload, id, queries)) {
+            c.failed = true;
+            return;
+        }
+        ++requests;
+        auto next = std::make_shared<reply>();
+        c.replies.push_back(next);
+        pool->submit([this, next, id, queries = std::move(queries)]() {
+            vector<outcome> outcomes;
+            outcomes.reserve(queries.size());
+            for (auto &q : queries) {
+                outcomes.push_back(solve(q));
+            }
+            encode_response(id, outcomes, next->frame);
+            next->done.store(true, std::memory_order_release);
+            signal();
+        });
+    }
+    c.input.erase(0, used);
+    uint32_t length;
+    if (frame_length(c.input, length) and length > max_frame) {
+        c.failed = true;
+    }
+#endif
+}
+
+void Calculator_server::write_replies(connection &c) {
+#ifdef CALCULATOR_SERVER_SOCKETS
+    while (not c.replies.empty() and c.replies.front()->done.load(std::memory_order_acquire)) {
+        c.output += c.replies.front()->frame;
+        c.replies.pop_front();
+    }
+    while (c.written < c.output.size()) {
+        ssize_t count = ::send(c.socket, c.output.data() + c.written, c.output.size() - c.written,
+                               MSG_NOSIGNAL);
+        if (count > 0) {
+            c.written += size_t(count);
+        } else if (count < 0 and errno == EINTR) {
+            continue;
+        } else {
+            c.failed = count == 0 or (errno not_eq EAGAIN and errno not_eq EWOULDBLOCK);
+            break;
+        }
+    }
+    if (c.written == c.output.size()) {
+        c.output.clear();
+        c.written = 0;
+    }
+#endif
+}
+
+Calculator_client::~Calculator_client() {
+    close();
+}
+
+bool Calculator_client::connect(const string &path) {
+#ifdef CALCULATOR_SERVER_SOCKETS
+    close();
+    sockaddr_un address{};
+    if (not socket_address(path, address)) {
+        return false;
+    }
+    socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket < 0 or
+        ::connect(socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) not_eq 0) {
+        close();
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Calculator_client::close() {
+#ifdef CALCULATOR_SERVER_SOCKETS
+    if (socket >= 0) {
+        ::close(socket);
+    }
+#endif
+    socket = -1;
+    input.clear();
+    consumed = 0;
+}
+
+bool Calculator_client::send(uint32_t id, const vector<Calculator_server::query> &queries) {
+#ifdef CALCULATOR_SERVER_SOCKETS
+    frame.clear();
+    Calculator_server::encode_request(id, queries, frame);
+    size_t sent{0};
+    while (sent < frame.size()) {
+        ssize_t count = ::send(socket, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+        if (count > 0) {
+            sent += size_t(count);
+        } else if (count == 0 or errno not_eq EINTR) {
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Calculator_client::receive(uint32_t &id, vector<Calculator_server::outcome> &outcomes) {
+#ifdef CALCULATOR_SERVER_SOCKETS
+    for (;;) {
+        string_view payload;
+        if (size_t size = Calculator_server::next_frame(string_view(input).substr(consumed),
+                                                        payload)) {
+            consumed += size;
+            bool decoded = Calculator_server::decode_response(payload, id, outcomes);
+            if (consumed == input.size()) {
+                input.clear();
+                consumed = 0;
+            }
+            return decoded;
+        }
+        uint32_t length;
+        if (frame_length(string_view(input).substr(consumed), length) and
+            length > Calculator_server::max_frame) {
+            return false;
+        }
+        input.erase(0, consumed);
+        consumed = 0;
+        char buffer[64 * 1024];
+        ssize_t count = ::recv(socket, buffer, sizeof(buffer), 0);
+        if (count > 0) {
+            input.append(buffer, size_t(count));
+        } else if (count == 0 or errno not_eq EINTR) {
+            return false;
+        }
+    }
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,177 @@
+//
+// A long-lived evaluation daemon on a Unix domain socket.
+//
+
+#ifndef INC_9_CALCULATOR_CALCULATOR_SERVER_H
+#define INC_9_CALCULATOR_CALCULATOR_SERVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "infix_lexer.h"
+#include "expression_cache.h"
+#include "work_stealing_pool.h"
+
+/*
+ * A Calculator_server solves batches of equations sent over a Unix domain socket, so that clients
+ * pay for neither process startup nor compiling an equation they have sent before: compiled
+ * expressions are kept in an Expression_cache for the life of the server.
+ *
+ * Every message is a frame: a 32-bit length and that many bytes of payload. Integers are 32 bits
+ * and numbers are doubles, in the byte order of the machine, as the socket is local.
+ *
+ *     request  := id, count, count × (equation length, equation, bindings,
+ *                                     bindings × (name length, name, value))
+ *     response := id, count, count × (error, offset, value)
+ *
+ * error is an Infix_lexer::error_kind, numbered as calculator_error in calculator_api.h, and the
+ * value of an invalid equation is NaN. A variable without a binding is an unknown variable.
+ *
+ * Requests may be pipelined: a client can send many before reading any response. One thread runs
+ * the event loop, reading and writing every connection without blocking, and each request is
+ * solved by a task of a Work_stealing_pool. Responses are written in the order of the requests on
+ * that connection. A frame that cannot be decoded, or is longer than max_frame, closes it.
+ */
+class Calculator_server {
+
+public:
+    static constexpr uint32_t max_frame{64u << 20u};
+
+    struct binding {
+        std::string name;
+        double value;
+    };
+
+    struct query {
+        std::string equation;
+        std::vector<binding> bindings;
+    };
+
+    struct outcome {
+        double value;
+        Infix_lexer::error_kind error;
+        uint32_t offset;
+    };
+
+    struct statistics {
+        size_t connections;
+        size_t requests;
+        size_t equations;
+        size_t errors;
+    };
+
+    // Appends a request frame to out.
+    static void encode_request(uint32_t id, const std::vector<query> &queries, std::string &out);
+
+    // Appends a response frame to out.
+    static void encode_response(uint32_t id, const std::vector<outcome> &outcomes,
+                                std::string &out);
+
+    /*
+     * The payload of the first frame in buffer. Returns the bytes the frame takes, or 0 when it is
+     * not all there yet.
+     */
+    static size_t next_frame(std::string_view buffer, std::string_view &payload);
+
+    // Decodes a payload, returning false when it is malformed.
+    static bool decode_request(std::string_view payload, uint32_t &id, std::vector<query> &queries);
+
+    static bool decode_response(std::string_view payload, uint32_t &id,
+                                std::vector<outcome> &outcomes);
+
+    // Solves requests on threads workers, caching up to cache_capacity compiled expressions.
+    Calculator_server(size_t threads, size_t cache_capacity);
+
+    // Finishes the requests in progress and closes the socket and every connection.
+    ~Calculator_server();
+
+    Calculator_server(const Calculator_server &) = delete;
+
+    Calculator_server &operator=(const Calculator_server &) = delete;
+
+    // Listens on a socket at path, replacing any socket left there. Returns false on failure.
+    bool listen(const std::string &path);
+
+    // Runs the event loop until stop() is called.
+    void run();
+
+    // Safe from another thread and from a signal handler.
+    void stop();
+
+    statistics counters() const;
+
+    Expression_cache::statistics cache_counters() const;
+
+    // Solves one equation, as a request does.
+    outcome solve(const query &q);
+
+private:
+    // A response, filled in by a worker and written by the event loop once those before it are.
+    struct reply {
+        std::string frame;
+        std::atomic<bool> done{false};
+    };
+    struct connection {
+        int socket;
+        std::string input;
+        std::string output;
+        size_t written{0};
+        std::deque<std::shared_ptr<reply>> replies;
+        bool reading{true};
+        bool failed{false};
+    };
+    std::string path;
+    int listener{-1};
+    int wake[2]{-1, -1};     // A pipe that wakes the event loop when a reply is done or on stop().
+    std::atomic<bool> stopping{false};
+    Expression_cache cache;
+    std::unique_ptr<Work_stealing_pool> pool;
+    std::unordered_map<int, std::unique_ptr<connection>> connections;
+    std::atomic<size_t> accepted{0};
+    std::atomic<size_t> requests{0};
+    std::atomic<size_t> equations{0};
+    std::atomic<size_t> errors{0};
+    void accept_connections();
+    void read_requests(connection &c);
+    void write_replies(connection &c);
+    void signal();
+};
+
+/*
+ * A blocking client of a Calculator_server, one connection per object. Requests can be sent
+ * ahead of their responses, which arrive in the same order.
+ */
+class Calculator_client {
+
+public:
+    Calculator_client() = default;
+
+    ~Calculator_client();
+
+    Calculator_client(const Calculator_client &) = delete;
+
+    Calculator_client &operator=(const Calculator_client &) = delete;
+
+    bool connect(const std::string &path);
+
+    bool send(uint32_t id, const std::vector<Calculator_server::query> &queries);
+
+    // Waits for the next response. Returns false when the connection closes or it is malformed.
+    bool receive(uint32_t &id, std::vector<Calculator_server::outcome> &outcomes);
+
+    void close();
+
+private:
+    int socket{-1};
+    std::string frame;
+    std::string input;
+    size_t consumed{0};
+};
+
+#endif //INC_9_CALCULATOR_CALCULATOR_SERVER_H
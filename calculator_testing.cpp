@@ -7,51 +7,1196 @@
 #include <map>
 #include <cmath>
 #include <iomanip>
+#include <limits>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <functional>
+#include <filesystem>
+#include <random>
 #include "calculator.h"
+#include "compiled_expression.h"
+#include "batch_evaluator.h"
+#include "expression_cache.h"
+#include "calculator_profile.h"
+#include "constexpr_calculator.h"
+#include "elementary_functions.h"
+#include "calculator_cases.h"
+#include "native_expression.h"
+#include "numeric_expression.h"
+#include "incremental_expression.h"
+#include "function_registry.h"
+#include "calculator_api.h"
+#include "program_catalog.h"
+#include "expression_fuzzer.h"
+#include "calculator_server.h"
 #include "calculator_testing.h"
 
 using std::map;
 using std::string;
+using std::string_view;
+using std::vector;
 using std::fabs;
 
-map<string, double> Infix_calculator_testing::cases = {
-        {"8--7   +8++7",                              30.0},
-        {"(8−−7)+(9×+1) −−3.4 − 4 ÷ 7",               26.8285714285714},
-        {"(8−−7)+(9×+1) −−3.4 − 4 ÷ 7+2^2",           30.8285714285714},
-        {"(8−−7)+(9×+1) −−3.4 − 4 ÷ 7*2^2",           25.1142857142857},
-        {"(8−−7)+(9×+1) −−3.4 − 4 ÷ 7/2^2",           27.2571428571429},
-        {"(8−−7)+(9×+1)−−3.4−4÷7",                    26.8285714285714},
-        {"(8−−7)+(9×+1)−−3.4−4÷7+2^2",                30.8285714285714},
-        {"(8−−7)+(9×+1)−−3.4−4÷7*2^2",                25.1142857142857},
-        {"(8−−7)+(9×+1)−−3.4−4÷7/2^2",                27.2571428571429},
-        {"(8.4 −+7.1)-(9.9× +1.0) −+3.4 + 4.6 ÷ 7.3", -11.3698630136986},
-        {"(8+−7) + (9×-1) +−3.4 − 4 ÷ 7+2^2",         -7.97142857142857},
-        {"(8−−7) *(9×+1) * −3.4 − 4 ÷ 7*2^2",         -461.285714285714},
-        {"(8−−7)/ (9×+1) /−3.4 − 4 ÷ 7/2^2",          -0.633053221288515},
-        {"-1+-1",                                     -2.0},
-        {"-1++1",                                     0.0},
-        {"5+2*3",                                     11.0},
-        {"5^2*3",                                     75.0},
-        {"5/2*3",                                     7.5},
-        {"2.3^2.2",                                   6.24886639474804},
-        {"5÷2×3^3",                                   67.5},
-        {"5÷(2×(3^3))",                               0.0925925925925926},
-        {"1-2-3",                                     -4.0},
-        {"1+2+3",                                     6.0},
-        {"(1+2)+3",                                   6.0},
-        {"1+(2+3)",                                   6.0},
-        {"1.1-2.2-3.3",                               -4.4},
-        {"1.1+2.2+3.3",                               6.6},
-        {"(1.1+2.2)+3.3",                             6.6},
-        {"1.1+(2.2+3.3)",                             6.6},
+namespace {
+
+// Counts every call to the global operator new so that allocation-free paths can be checked, and
+// the bytes asked for so that the memory of long equations can be.
+std::atomic<size_t> allocations{0};
+std::atomic<size_t> allocated{0};
+
+// Every form of operator new comes here and every form of operator delete calls std::free(), so any
+// new matches any delete.
+void *allocate(std::size_t size, std::size_t alignment = 0) noexcept {
+    ++allocations;
+    allocated += size;
+    size = size ? size : 1;
+    if (alignment <= alignof(std::max_align_t)) {
+        return std::malloc(size);
+    }
+    // aligned_alloc() takes a multiple of the alignment.
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void *allocate_or_throw(std::size_t size, std::size_t alignment = 0) {
+    if (void *p = allocate(size, alignment)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+void *operator new(std::size_t size) {
+    return allocate_or_throw(size);
+}
+
+void *operator new[](std::size_t size) {
+    return allocate_or_throw(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    return allocate_or_throw(size, std::size_t(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocate_or_throw(size, std::size_t(alignment));
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return allocate(size, std::size_t(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+    return allocate(size, std::size_t(alignment));
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+constexpr bool approximately_equal(double a, double b) {
+    double difference = a < b ? b - a : a - b;
+    double smaller = a < b ? a : b;
+    smaller = smaller < 0.0 ? -smaller : smaller;
+    return a == b or difference < smaller * std::numeric_limits<double>::epsilon() * 12.0;
+}
+
+constexpr bool solved_at_compile_time() {
+    for (auto &test : calculator_cases) {
+        auto solved = Constexpr_calculator::solve(test.equation);
+        if (not solved.valid() or not approximately_equal(solved.value, test.expected)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(solved_at_compile_time(), "Constexpr_calculator does not solve every case.");
+static_assert(Constexpr_calculator::calc("5÷(2×(3^3))") == 5.0 / 54.0, "5÷(2×(3^3))");
+static_assert(Constexpr_calculator::calc("10^-5") == 1e-5, "10^-5");
+static_assert(Constexpr_calculator::compile("-x^2 * -(x+1)", {"x"})(3.0) == -36.0, "-x^2 * -(x+1)");
+static_assert(Constexpr_calculator::compile("principal_2*(1+rate)^x", {"principal_2", "rate", "x"})
+                      (100.0, 0.25, 2.0) == 156.25, "principal_2*(1+rate)^x");
+static_assert(Constexpr_calculator::solve("((1+2)").error == Infix_lexer::unbalanced_parentheses,
+              "((1+2)");
+
+} // namespace
+
+// The equations of calculator_cases, which the compiler has already checked.
+map<string, double> Infix_calculator_testing::cases = [] {
+    map<string, double> cases;
+    for (auto &test : calculator_cases) {
+        cases.emplace(test.equation, test.expected);
+    }
+    return cases;
+}();
+
+map<string, Infix_lexer::error_kind> Infix_calculator_testing::invalid_cases = {
+        {"5 + #",                                     Infix_lexer::invalid_character},
+        {"5 $ 2",                                     Infix_lexer::invalid_character},
+        {"5 ≠ 2",                                     Infix_lexer::invalid_character},
+        {"8---7",                                     Infix_lexer::operator_sequence},
+        {"5**2",                                      Infix_lexer::operator_sequence},
+        {"5÷×2",                                      Infix_lexer::operator_sequence},
+        {"- (1+2)",                                   Infix_lexer::operator_sequence},
+        {"8---(7)",                                   Infix_lexer::operator_sequence},
+        {"-(",                                        Infix_lexer::operator_sequence},
+        {"2(3)",                                      Infix_lexer::operator_sequence},
+        {"5+",                                        Infix_lexer::operator_sequence},
+        {"((1+2)",                                    Infix_lexer::unbalanced_parentheses},
+        {"(1+2))",                                    Infix_lexer::unbalanced_parentheses},
+        {")1+2(",                                     Infix_lexer::operator_sequence},
+        {"   ",                                       Infix_lexer::empty_equation},
+        {"2x",                                        Infix_lexer::operator_sequence},
+};
+
+map<string, string> Infix_calculator_testing::format_cases = {
+        {"(8−−7)+(9×+1)−−3.4−4÷7*2^2",  "( 8 - -7 ) + ( 9 * +1 ) - -3.4 - 4 / 7 * 2 ^ 2"},
+        {"8--7   +8++7",                "8 - -7 + 8 + +7"},
+        {"  -1+-1 ",                    "-1 + -1"},
+        {"max( 1,-2 )*sqrt(x)",         "max ( 1 , -2 ) * sqrt ( x )"},
+        {"-x × −(1+2)",                 "( -1 * x ) * ( -1 * ( 1 + 2 ) )"},
 };
 
+map<string, double> Infix_calculator_testing::variable_cases = {
+        {"x",                                         2.0},
+        {"x*x - y",                                   7.5},
+        {"(x−y)÷rate",                                22.0},
+        {"rate^x + x^rate",                           1.25170711500272},
+        {"principal_2*(1+rate)^x",                    156.25},
+        {"x^3 - y/2 + rate*4",                        10.75},
+        {"y - x ÷ rate ^ 2",                          -35.5},
+        {"-x",                                        -2.0},
+        {"-x^2 + +x",                                 6.0},
+        {"y*-x",                                      7.0},
+        {"x/-(y+rate)",                               0.615384615384615},
+};
+
+// Calls of the built-in functions, with the variables of bindings.
+map<string, double> Infix_calculator_testing::function_cases = {
+        {"sqrt(16) + abs(-2)",                        6.0},
+        {"sqrt (x * 8)",                              4.0},
+        {"max(1, x, y)",                              2.0},
+        {"min(x, y, rate)",                           -3.5},
+        {"floor(y) + ceil(rate)",                     -3.0},
+        {"exp(log(x))",                               2.0},
+        {"sin(0) + cos(0) + tan(0)",                  1.0},
+        {"2 * max(x ^ 2, 3) - min(1)",                7.0},
+        {"max(min(x, 3), sqrt(max(y, 9)))",           3.0},
+        {"principal_2 * max(-1, (1 + rate) ^ x)",     156.25},
+        {"-sqrt(x * 8) - -max(y)",                    -7.5},
+};
+
+map<string, double> Infix_calculator_testing::bindings = {
+        {"x",                                         2.0},
+        {"y",                                         -3.5},
+        {"rate",                                      0.25},
+        {"principal_2",                               100.0},
+};
+
+// The number of instructions left after optimization.
+map<string, size_t> Infix_calculator_testing::optimization_cases = {
+        {"(8−−7)+(9×+1)",                             1},
+        {"x*1-0",                                     1},
+        {"1*x/1",                                     1},
+        {"-0+x^1",                                    1},
+        {"x+0",                                       3},
+        {"x^2",                                       3},
+        {"(x+y)^2",                                   5},
+        {"2*3*x",                                     3},
+        {"x*2*3",                                     5},
+        {"x*(2^3-7)",                                 1},
+        {"rate*(1+2*3)-y*(4÷4)",                      5},
+        {"sqrt(16) * x",                              3},
+        {"max(x, 1, 2)",                              4},
+};
+
+// Conversions must be correctly rounded, so these are compared exactly.
+map<string, double> Infix_calculator_testing::number_cases = {
+        {"0.1",                                                    0.1},
+        {".5",                                                     0.5},
+        {"7.",                                                     7.0},
+        {"3.14159265358979323846264338327950288419716939937510",   3.14159265358979323846},
+        {"9007199254740993",                                       9007199254740992.0},
+        {"0.000000000000000000000000000000000000001234567890123",  1.234567890123e-39},
+        {"179769313486231570814527423731704356798070567525844996598917476803157260780028538760589"
+         "558632766878171540458953514382464234321326889464182768467546703537516986049910576551282"
+         "076245490090389328944075868508455133942304583236903222948165808559332123348274797826204"
+         "144723168738177180919299881250404026184124858368",       1.7976931348623157e308},
+        {string(401, '9'),                                         HUGE_VAL},
+        {"0." + string(400, '0') + "1",                            0.0},
+        {"0." + string(310, '0') + "1",                            1e-311},
+};
 
 // Credit to Michael Goldshteyn on SO.
 bool Infix_calculator_testing::approximately_equal(double a, double b, double error_factor = 12.0) {
     return a == b || fabs(a - b) < fabs(std::min(a, b)) * std::numeric_limits<double>::epsilon() * error_factor;
 }
 
+void Infix_calculator_testing::fail(const string &message) {
+    std::cerr << message << std::endl;
+    auto err = std::make_error_condition(std::errc::operation_canceled);
+    throw std::runtime_error(err.message());
+}
+
+/*
+ * Once an equation is scanned, computing it must not allocate. Neither may evaluating a compiled
+ * expression, nor batch evaluation once its per-thread buffers have grown.
+ */
+void Infix_calculator_testing::check_allocations() {
+    vector<double> columns(4096, 1.5);
+    vector<double> result(columns.size());
+    const double *pointers[] = {columns.data(), columns.data(), columns.data(), columns.data()};
+    for (auto &test : cases) {
+        Infix_calculator c{test.first};
+        c.validate();
+        Compiled_expression compiled{test.first};
+        compiled.evaluate_batch(pointers, columns.size(), result.data());
+        size_t before = allocations;
+        c.compute();
+        compiled.evaluate();
+        compiled.evaluate_batch(pointers, columns.size(), result.data());
+        if (allocations != before) {
+            fail("Testing allocations of " + test.first + " failed. " +
+                 std::to_string(allocations - before) + " allocations were made.");
+        }
+    }
+}
+
+// Glyph and spacing variants share an entry, and the cache stays within its capacity.
+void Infix_calculator_testing::check_cache() {
+    Expression_cache cache{16};
+    Infix_lexer::error_kind error;
+    size_t offset;
+    auto first = cache.compile("5÷2×3", error, offset);
+    auto second = cache.compile(" 5 / 2 * 3", error, offset);
+    if (not first or first != second or not first->constant or first->result != 7.5) {
+        fail("Testing cache failed. 5÷2×3 and 5 / 2 * 3 do not share a cached result.");
+    }
+    auto variable = cache.compile("x + 1", error, offset);
+    if (not variable or variable->constant or variable->compiled.variables().size() != 1) {
+        fail("Testing cache failed. x + 1 was cached as a constant.");
+    }
+    // An impure call is made again on every hit, though the equation has no variables.
+    static double ticks{0.0};
+    static long tick_index = Function_registry::add("cache_tick", 1, 1, [](const double *a, size_t) {
+        return a[0] + ++ticks;
+    });
+    auto ticked = cache.compile("cache_tick(0)", error, offset);
+    double before = ticked ? ticked->compiled.evaluate() : 0.0;
+    auto hit = cache.compile("cache_tick( 0 )", error, offset);
+    if (tick_index < 0 or not ticked or ticked->constant or hit != ticked or
+        hit->compiled.evaluate() == before) {
+        fail("Testing cache failed. cache_tick(0) was cached as a constant.");
+    }
+    Batch_evaluator batch;
+    batch.use_cache(&cache);
+    string output;
+    batch.solve("cache_tick(0)\ncache_tick(0)\n", output);
+    size_t half = output.size() / 2;
+    if (output.compare(0, half, output, half, string::npos) == 0) {
+        fail("Testing cache failed. A batch gave one result for cache_tick(0) twice.");
+    }
+    if (cache.compile("1 +* 2", error, offset) or error not_eq Infix_lexer::operator_sequence) {
+        fail("Testing cache failed. 1 +* 2 was cached.");
+    }
+    for (int i = 0; i < 100; ++i) {
+        cache.compile(std::to_string(i) + " + 1", error, offset);
+    }
+    auto counted = cache.counters();
+    if (counted.hits != 4 or counted.misses != 103 or counted.misses - counted.evictions > 16) {
+        fail("Testing cache failed. Counted " + std::to_string(counted.hits) + " hits, " +
+             std::to_string(counted.misses) + " misses and " + std::to_string(counted.evictions) +
+             " evictions.");
+    }
+    // Every capacity is a bound on the whole cache, however it divides among the shards.
+    for (size_t capacity : {1, 3, 17, 40}) {
+        Expression_cache bounded{capacity};
+        for (int i = 0; i < 200; ++i) {
+            bounded.compile(std::to_string(i) + " * 2", error, offset);
+        }
+        auto bounded_counted = bounded.counters();
+        if (bounded_counted.misses - bounded_counted.evictions > capacity) {
+            fail("Testing cache failed. A cache of capacity " + std::to_string(capacity) +
+                 " held " + std::to_string(bounded_counted.misses - bounded_counted.evictions) +
+                 " entries.");
+        }
+    }
+}
+
+// Counters add up across threads, and builds without CALCULATOR_PROFILE count nothing.
+void Infix_calculator_testing::check_profile() {
+    Calculator_profile::reset();
+    std::thread worker([] {
+        Infix_calculator c{"(1 + 2) × 3 ^ 2"};
+        c.compute();
+    });
+    worker.join();
+    Infix_calculator c{"1 - 2 * (3 + (4 - 5))"};
+    c.compute();
+    c.format();
+    auto counted = Calculator_profile::collect();
+    if (not Calculator_profile::enabled) {
+        if (counted.calls[Calculator_profile::evaluate] != 0 or counted.tokens != 0) {
+            fail("Testing profile failed. A build without CALCULATOR_PROFILE counted calls.");
+        }
+        return;
+    }
+    if (counted.calls[Calculator_profile::parse] != 2 or
+        counted.calls[Calculator_profile::evaluate] != 2 or
+        counted.calls[Calculator_profile::format] != 1 or counted.tokens != 22 or
+        counted.operators != 7 or counted.value_stack_high_water != 5 or
+        counted.operator_stack_high_water != 6) {
+        fail("Testing profile failed. Counted " + Calculator_profile::json(counted));
+    }
+    // validate() times the scan it runs, which is timed as parse inside it.
+    Calculator_profile::reset();
+    Infix_calculator{"1 + (2 - 3) * 4 / 5 ^ 6"}.validate();
+    counted = Calculator_profile::collect();
+    if (counted.calls[Calculator_profile::validate] != 1 or
+        counted.calls[Calculator_profile::parse] != 1 or
+        counted.nanoseconds[Calculator_profile::validate] <
+                counted.nanoseconds[Calculator_profile::parse]) {
+        fail("Testing profile failed. Counted " + Calculator_profile::json(counted));
+    }
+    // Function calls are counted apart from operators.
+    Calculator_profile::reset();
+    double x{4.0};
+    Infix_calculator{"max(x, 2 + x) * sqrt(x)"}.bind(&x).compute();
+    Compiled_expression{"max(x, 2 + x) * sqrt(x)"}.evaluate(&x);
+    counted = Calculator_profile::collect();
+    if (counted.operators != 4 or counted.function_calls != 4) {
+        fail("Testing profile failed. Counted " + Calculator_profile::json(counted));
+    }
+}
+
+/*
+ * Machine code must agree with the interpreter bit for bit. Stacks deeper than the registers, and
+ * platforms without the code generator, fall back to the interpreter.
+ */
+void Infix_calculator_testing::check_native() {
+    auto same = [](double a, double b) {
+        return a == b or (std::isnan(a) and std::isnan(b));
+    };
+    map<string, double> equations = cases;
+    equations.insert(variable_cases.begin(), variable_cases.end());
+    equations.insert({{"x ^ y ^ rate * (x - (y ^ 2 + rate ^ (x * (y + 1))))", 0.0},
+                      {"1 / (x - 2) + 0 / (x - 2) - -0.0 * y",                 0.0}});
+    for (auto &test : equations) {
+        Compiled_expression compiled{test.first};
+        vector<double> values;
+        for (auto &name : compiled.variables()) {
+            values.push_back(bindings[name]);
+        }
+        Native_expression native{compiled};
+        if (native.native() not_eq Native_expression::supported()) {
+            fail("Testing native " + test.first + " failed. No machine code was generated.");
+        }
+        double expected = compiled.evaluate(values.data());
+        double result = native.evaluate(values.data());
+        if (not same(result, expected)) {
+            fail("Testing native " + test.first + " failed. Result " + std::to_string(result) +
+                 " not equal to interpreted result " + std::to_string(expected) + ".");
+        }
+    }
+    string deep{"x"};
+    for (int i = 0; i < 20; ++i) {
+        deep = "x - (" + deep + ") ^ 1.0001";
+    }
+    Compiled_expression compiled{deep};
+    Native_expression native{compiled};
+    double x{1.5};
+    if (native.native() or not same(native.evaluate(&x), compiled.evaluate(&x))) {
+        fail("Testing native " + deep + " failed. It did not fall back to the interpreter.");
+    }
+}
+
+/*
+ * Every number type solves the test cases. double matches Compiled_expression bit for bit, and the
+ * exact types give 0.1 + 0.2 as 0.3 and 1.1 + 2.2 + 3.3 as 6.6 with no rounding error. Where a type cannot represent a
+ * result it says so rather than throwing or wrapping around.
+ */
+void Infix_calculator_testing::check_numeric() {
+    auto check = [this](const string &type, const string &equation, double value, double expected) {
+        if (not (std::fabs(value - expected) <= 1e-8 * std::max(1.0, std::fabs(expected)))) {
+            fail("Testing " + type + " " + equation + " failed. Result " + std::to_string(value) +
+                 " not equal to expected result " + std::to_string(expected) + ".");
+        }
+    };
+    for (auto &test : cases) {
+        double compiled = Compiled_expression{test.first}.evaluate();
+        auto as_double = Numeric_expression<double>{test.first}.evaluate();
+        if (not as_double.defined or as_double.value != compiled) {
+            fail("Testing double " + test.first + " failed. Result " +
+                 std::to_string(as_double.value) + " not equal to compiled result " +
+                 std::to_string(compiled) + ".");
+        }
+        auto as_long = Numeric_expression<long double>{test.first}.evaluate();
+        check("long double", test.first, double(as_long.value), test.second);
+        auto as_fixed = Numeric_expression<Fixed_decimal>{test.first}.evaluate();
+        check("fixed decimal", test.first, as_fixed.value.to_double(), test.second);
+        auto as_rational = Numeric_expression<Rational>{test.first}.evaluate();
+        check("rational", test.first, as_rational.value.convert_to<double>(), test.second);
+    }
+    const string sum{"1.1+2.2+3.3"};
+    if (Numeric_expression<double>{"0.1+0.2"}.evaluate().value == 0.3 or
+        Numeric_expression<Fixed_decimal>{"0.1+0.2"}.evaluate().value.to_string() != "0.3" or
+        Numeric_expression<Fixed_decimal>{sum}.evaluate().value.to_string() != "6.6" or
+        Numeric_expression<Rational>{sum}.evaluate().value != Rational(33, 5)) {
+        fail("Testing exact " + sum + " failed.");
+    }
+    Fixed_decimal x, y;
+    Fixed_decimal::parse("2.5", true, x);
+    Fixed_decimal::parse("0.000000001", false, y);
+    double values[] = {2.0, 0.25};
+    Fixed_decimal fixed_values[] = {Fixed_decimal::from_units(2 * Fixed_decimal::scale), y};
+    Rational rational_values[] = {Rational(1, 3), Rational(3)};
+    if (x.to_string() != "-2.5" or y.units() != 1 or
+        Numeric_expression<double>{"x ^ (0 - y)"}.evaluate(values).value != std::pow(2.0, -0.25) or
+        Numeric_expression<Fixed_decimal>{"x / y"}.evaluate(fixed_values).value.to_string() !=
+        "2000000000" or
+        Numeric_expression<Rational>{"x ^ y * 3 ^ -2"}.evaluate(rational_values).value !=
+        Rational(1, 243) or
+        Numeric_expression<Rational>{"1 / (2 - 2)"}.evaluate().defined or
+        Numeric_expression<Fixed_decimal>{"1 / 0"}.evaluate().defined or
+        Numeric_expression<Fixed_decimal>{"99999 * 99999"}.evaluate().defined or
+        Numeric_expression<Fixed_decimal>{"10000000000"}.evaluate().defined or
+        not std::isinf(Numeric_expression<long double>{"1 / 0"}.evaluate().value) or
+        Numeric_expression<Rational>{"x + 1"}.evaluate().defined or
+        Numeric_expression<Rational>{"(1 +"}.error() != Infix_lexer::operator_sequence) {
+        fail("Testing number types failed.");
+    }
+}
+
+/*
+ * From one compiled program, Dual<4> gives the value of the double evaluation bit for bit and a
+ * gradient that agrees with central differences, and Interval gives bounds that hold the value at
+ * the corners and the middle of a box of variables, and at random points in it.
+ */
+void Infix_calculator_testing::check_derivatives() {
+    const vector<string> equations = {
+            "principal_2*(1+rate)^x", "x^y + y^x", "x/y - log(x)^2 + 3*x^-2",
+            "sqrt(x)*sin(y) + max(x, 2*y, 1)", "exp(0 - x*y) + tan(x)/cos(y) - min(x, y)",
+            "abs(x - y) + floor(x)*ceil(y) + 0.1*x", "(x - 1)^2 * (y + 2)^3 / (1 + x^2)",
+            "2^x * rate - principal_2/(x + y)"};
+    const double at[] = {1.3, 0.7, 0.05, 250.0};
+    for (auto &equation : equations) {
+        Compiled_expression compiled{equation};
+        if (not compiled.valid()) {
+            fail("Testing dual " + equation + " failed. It did not compile.");
+            continue;
+        }
+        auto &names = compiled.variables();
+        vector<double> values;
+        vector<Dual<4>> seeded;
+        for (size_t i = 0; i < names.size(); ++i) {
+            values.push_back(names[i] == "x" ? at[0] : names[i] == "y" ? at[1] :
+                             names[i] == "rate" ? at[2] : at[3]);
+            seeded.push_back(Dual<4>::variable(values.back(), i));
+        }
+        auto dual = Numeric_expression<Dual<4>>{compiled}.evaluate(seeded.data());
+        double expected = compiled.evaluate(values.data());
+        if (not dual.defined or dual.value.value != expected) {
+            fail("Testing dual " + equation + " failed. Value " +
+                 std::to_string(dual.value.value) + " not equal to " + std::to_string(expected) +
+                 ".");
+        }
+        for (size_t i = 0; i < names.size(); ++i) {
+            double step = 1e-6 * std::max(1.0, std::fabs(values[i]));
+            auto moved = values;
+            moved[i] = values[i] + step;
+            double above = compiled.evaluate(moved.data());
+            moved[i] = values[i] - step;
+            double below = compiled.evaluate(moved.data());
+            double difference = (above - below) / (2.0 * step);
+            double derivative = dual.value.gradient[i];
+            if (not (std::fabs(derivative - difference) <=
+                     1e-5 * std::max(1.0, std::fabs(difference)))) {
+                fail("Testing dual " + equation + " failed. Derivative by " + names[i] + " " +
+                     std::to_string(derivative) + " not equal to " + std::to_string(difference) +
+                     ".");
+            }
+        }
+        vector<Interval> box;
+        for (double value : values) {
+            box.push_back({value * 0.9, value * 1.1});
+        }
+        auto bounds = Numeric_expression<Interval>{compiled}.evaluate(box.data()).value;
+        std::mt19937_64 random{2017};
+        for (size_t sample = 0; sample < 200; ++sample) {
+            vector<double> inside;
+            for (size_t i = 0; i < box.size(); ++i) {
+                double t = sample == 0 ? 0.5 : sample <= 2 ? double(sample - 1) :
+                                               std::uniform_real_distribution<double>(0, 1)(random);
+                inside.push_back(box[i].lower + t * (box[i].upper - box[i].lower));
+            }
+            double value = compiled.evaluate(inside.data());
+            if (not bounds.contains(value)) {
+                fail("Testing interval " + equation + " failed. " + std::to_string(value) +
+                     " is outside " + bounds.to_string() + ".");
+                break;
+            }
+        }
+    }
+    Interval x{-1.0, 2.0};
+    auto squared = Numeric_expression<Interval>{"x^2"}.evaluate(&x).value;
+    auto compiled_square = Numeric_expression<Interval>{Compiled_expression{"x^2"}};
+    auto halved = Numeric_expression<Interval>{"0.5"}.evaluate().value;
+    auto sine = Numeric_expression<Interval>{"sin(x * 3)"}.evaluate(&x).value;
+    if (squared.lower != 0.0 or not squared.contains(4.0) or squared.upper > 4.000001 or
+        compiled_square.evaluate(&x).value != squared or
+        not halved.contains(0.5) or halved.lower == halved.upper or
+        sine != Interval(-1.0, 1.0) or
+        not std::isinf(Numeric_expression<Interval>{"1 / x"}.evaluate(&x).value.upper) or
+        not std::isnan(Numeric_expression<Interval>{"sqrt(x - 3)"}.evaluate(&x).value.lower)) {
+        fail("Testing interval bounds failed. x^2 over [-1, 2] is " + squared.to_string() + ".");
+    }
+}
+
+/*
+ * Function calls give the same results through Infix_calculator, Compiled_expression, its batch
+ * kernels and Native_expression, which falls back to the interpreter for them. The batch kernels
+ * must agree with the scalar functions bit for bit, NaN and signed zeros included, except that
+ * those of exp, log, sin, cos, tan and ^ may be an ulp from the library.
+ */
+void Infix_calculator_testing::check_functions() {
+    auto same = [](double a, double b) {
+        return (a == b and std::signbit(a) == std::signbit(b)) or (std::isnan(a) and std::isnan(b));
+    };
+    auto within_ulp = [&same](double a, double b) {
+        const double infinity = std::numeric_limits<double>::infinity();
+        return same(a, b) or a == std::nextafter(b, infinity) or a == std::nextafter(b, -infinity);
+    };
+    for (auto &test : function_cases) {
+        Compiled_expression compiled{test.first};
+        vector<double> values;
+        for (auto &name : compiled.variables()) {
+            values.push_back(bindings[name]);
+        }
+        Infix_calculator c{test.first, true};
+        Native_expression native{compiled};
+        for (auto result : {compiled.evaluate(values.data()), c.bind(values.data()).compute(),
+                            native.evaluate(values.data())}) {
+            if (not approximately_equal(test.second, result)) {
+                fail("Testing " + test.first + " failed. Result " + std::to_string(result) +
+                     " not equal to expected result " + std::to_string(test.second) + ".");
+            }
+        }
+    }
+    const double samples[] = {-2.5, -0.0, 0.0, 1.5, std::numeric_limits<double>::quiet_NaN(), 7.0,
+                              1e300, -std::numeric_limits<double>::infinity(), 0.5, -1e-300};
+    const size_t rows{37};
+    vector<double> x(rows), y(rows), result(rows);
+    for (size_t row = 0; row < rows; ++row) {
+        x[row] = samples[row % 10];
+        y[row] = samples[(row * 7 + 3) % 10];
+    }
+    const double *columns[] = {x.data(), y.data()};
+    const std::pair<string, bool> kernels[] = {
+            {"sqrt(x)", true}, {"abs(x)", true}, {"floor(x)", true}, {"ceil(x)", true},
+            {"exp(x)", false}, {"log(x)", false}, {"sin(x)", false}, {"cos(x)", false},
+            {"tan(x)", false}, {"min(x, y)", true}, {"max(x, y)", true}, {"min(x)", true},
+            {"max(y, x, 0, y)", true}, {"min(x, -0, y) + max(0, x)", true}};
+    for (auto &[equation, exact] : kernels) {
+        Compiled_expression compiled{equation, {"x", "y"}};
+        compiled.evaluate_batch(columns, rows, result.data());
+        for (size_t row = 0; row < rows; ++row) {
+            double values[] = {x[row], y[row]};
+            double single = compiled.evaluate(values);
+            if (exact ? not same(result[row], single) : not within_ulp(result[row], single)) {
+                fail("Testing batch " + equation + " failed at row " + std::to_string(row) + ".");
+            }
+        }
+    }
+    // The packed elementary functions agree with Elementary_functions bit for bit, both in the
+    // rows they compute and in those they leave to the library, and are within an ulp of the
+    // library, which single evaluation calls.
+    const struct {
+        const char *equation;
+        double (*library)(double, double);
+        double (*packed)(double, double);
+    } elementary[] = {
+            {"exp(x)", [](double a, double) { return std::exp(a); },
+                    [](double a, double) { return Elementary_functions::exp(a); }},
+            {"log(x)", [](double a, double) { return std::log(a); },
+                    [](double a, double) { return Elementary_functions::log(a); }},
+            {"sin(x)", [](double a, double) { return std::sin(a); },
+                    [](double a, double) { return Elementary_functions::sin(a); }},
+            {"cos(x)", [](double a, double) { return std::cos(a); },
+                    [](double a, double) { return Elementary_functions::cos(a); }},
+            {"tan(x)", [](double a, double) { return std::tan(a); },
+                    [](double a, double) { return Elementary_functions::tan(a); }},
+            {"x ^ y", [](double a, double b) { return std::pow(a, b); },
+                    Elementary_functions::pow},
+    };
+    const size_t sweep{4099};
+    vector<double> u(sweep), v(sweep), swept(sweep);
+    std::mt19937_64 random{19};
+    std::uniform_real_distribution<double> significand{1.0, 2.0};
+    for (size_t row = 0; row < sweep; ++row) {
+        int scale = row % 11 == 0 ? int(random() % 2100) - 1075 : int(random() % 48) - 24;
+        double sign = random() & 1 ? -1.0 : 1.0;
+        u[row] = row % 7 == 0 ? samples[row % 10] : sign * std::ldexp(significand(random), scale);
+        v[row] = row % 3 == 0 ? double(int(random() % 41) - 20) : 80.0 * significand(random) - 120;
+    }
+    const double *swept_columns[] = {u.data(), v.data()};
+    for (auto &function : elementary) {
+        Compiled_expression compiled{function.equation, {"x", "y"}};
+        compiled.evaluate_batch(swept_columns, sweep, swept.data());
+        for (size_t row = 0; row < sweep; ++row) {
+            double values[] = {u[row], v[row]};
+            double library = function.library(u[row], v[row]);
+            if (not same(swept[row], function.packed(u[row], v[row])) or
+                not same(compiled.evaluate(values), library) or not within_ulp(swept[row], library)) {
+                fail(string("Testing batch ") + function.equation + " failed at row " +
+                     std::to_string(row) + ".");
+            }
+        }
+    }
+    // A variable squared, which the compiled program multiplies out, is x*x, within an ulp of
+    // compute(), and the packed pow() gives x*x too.
+    Compiled_expression squared{"x ^ 2", vector<string>{"x"}};
+    Infix_calculator square{"x ^ 2"};
+    for (size_t row = 0; row < sweep; ++row) {
+        if (not same(squared.evaluate(&u[row]), u[row] * u[row]) or
+            not within_ulp(squared.evaluate(&u[row]), square.bind(&u[row]).compute()) or
+            not same(Elementary_functions::pow(u[row], 2.0), u[row] * u[row])) {
+            fail("Testing x ^ 2 failed at row " + std::to_string(row) + ".");
+        }
+    }
+    map<string, std::pair<Infix_lexer::error_kind, size_t>> errors = {
+            {"1 + foo(1)",    {Infix_lexer::unknown_function, 4}},
+            {"x (1)",         {Infix_lexer::unknown_function, 0}},
+            {"2 * sqrt(1, 2)", {Infix_lexer::argument_count, 4}},
+            {"max()",         {Infix_lexer::operator_sequence, 4}},
+            {"max(1,)",       {Infix_lexer::operator_sequence, 6}},
+            {"1, 2",          {Infix_lexer::invalid_character, 1}},
+            {"(1, 2)",        {Infix_lexer::invalid_character, 2}},
+            {"sqrt(max(1, 2), 3)", {Infix_lexer::argument_count, 0}},
+    };
+    for (auto &test : errors) {
+        auto solved = Infix_calculator{test.first}.solve();
+        if (solved.error not_eq test.second.first or solved.offset not_eq test.second.second) {
+            fail("Testing " + test.first + " failed. Error kind " + std::to_string(solved.error) +
+                 " at " + std::to_string(solved.offset) + " not equal to expected kind " +
+                 std::to_string(test.second.first) + " at " + std::to_string(test.second.second) +
+                 ".");
+        }
+    }
+    // A call whose arguments reach the deepest level, on either side of the inline value stack.
+    for (size_t depth = 28; depth < 40; ++depth) {
+        string equation;
+        for (size_t i = 0; i + 2 < depth; ++i) {
+            equation += "x + (";
+        }
+        equation += "max(x, y)" + string(depth - 2, ')');
+        Compiled_expression compiled{equation, {"x", "y"}};
+        double values[] = {0.5, 2.0};
+        double expected = Infix_calculator{equation}.bind(values).compute();
+        if (compiled.stack_depth() not_eq depth or compiled.evaluate(values) != expected) {
+            fail("Testing a call at depth " + std::to_string(depth) + " failed.");
+        }
+    }
+    // A deeper batch after a shallower one whose levels it fits in, on a thread of its own so the
+    // buffers start empty.
+    std::thread deeper([&] {
+        for (size_t depth : {1024, 2000}) {
+            string equation;
+            for (size_t i = 0; i + 1 < depth; ++i) {
+                equation += "x + (";
+            }
+            equation += "y" + string(depth - 1, ')');
+            Compiled_expression compiled{equation, {"x", "y"}};
+            compiled.evaluate_batch(columns, rows, result.data());
+            for (size_t row = 0; row < rows; ++row) {
+                double values[] = {x[row], y[row]};
+                if (not same(result[row], compiled.evaluate(values))) {
+                    fail("Testing batch at depth " + std::to_string(depth) + " failed at row " +
+                         std::to_string(row) + ".");
+                }
+            }
+        }
+    });
+    deeper.join();
+    // A user function without a batch kernel is applied row by row.
+    auto clamp = [](const double *a, size_t) {
+        return std::max(a[1], std::min(a[0], a[2]));
+    };
+    static long clamp_index = Function_registry::add("clamp", 3, 3, clamp);
+    if (clamp_index < 0 or Function_registry::add("clamp", 1, 1, clamp) != -1 or
+        Function_registry::add("2x", 1, 1, clamp) != -1 or
+        Function_registry::add("nothing", 0, 1, clamp) != -1) {
+        fail("Testing function registration failed.");
+    }
+    Compiled_expression clamped{"clamp(x * 10, -1, y) + 1", {"x", "y"}};
+    clamped.evaluate_batch(columns, rows, result.data());
+    for (size_t row = 0; row < rows; ++row) {
+        double values[] = {x[row], y[row]};
+        if (not same(result[row], clamped.evaluate(values))) {
+            fail("Testing batch clamp failed at row " + std::to_string(row) + ".");
+        }
+    }
+    double values[] = {0.5, 2.0};
+    if (Infix_calculator{"clamp(x * 10, -1, y)"}.bind(values).compute() != 2.0 or
+        Numeric_expression<Rational>{"clamp(1.5, 0, 1) + 0.1"}.evaluate().value != Rational(11, 10)) {
+        fail("Testing clamp failed.");
+    }
+    // Calls of constants are folded and shared only where the function is pure.
+    static double ticks{0.0};
+    auto tick = [](const double *a, size_t) {
+        return a[0] + ++ticks;
+    };
+    auto twice = [](const double *a, size_t) {
+        return 2.0 * a[0];
+    };
+    static long tick_index = Function_registry::add("tick", 1, 1, tick);
+    static long twice_index = Function_registry::add("twice", 1, 1, twice, nullptr, true);
+    Compiled_expression ticked{"tick(0) + tick(0)"};
+    double first = ticked.evaluate();
+    Incremental_expression incremental{ticked};
+    if (tick_index < 0 or twice_index < 0 or ticked.instructions().size() != 5 or
+        ticked.evaluate() == first or incremental.nodes() != 4 or
+        Compiled_expression{"twice(2) * x"}.instructions().size() != 3) {
+        fail("Testing pure functions failed.");
+    }
+}
+
+/*
+ * Incremental_expression agrees with Compiled_expression bit for bit after any run of changes, and
+ * recomputes only the operators and calls above a changed variable. A subexpression written twice
+ * is computed once, and a node whose value does not change stops the climb.
+ */
+void Infix_calculator_testing::check_incremental() {
+    auto same = [](double a, double b) {
+        return (a == b and std::signbit(a) == std::signbit(b)) or (std::isnan(a) and std::isnan(b));
+    };
+    map<string, double> equations = variable_cases;
+    equations.insert(function_cases.begin(), function_cases.end());
+    for (auto &test : equations) {
+        Compiled_expression compiled{test.first};
+        Incremental_expression incremental{compiled};
+        vector<double> values;
+        for (auto &name : compiled.variables()) {
+            values.push_back(bindings[name]);
+        }
+        if (not same(incremental.evaluate(values.data()), compiled.evaluate(values.data()))) {
+            fail("Testing incremental " + test.first + " failed.");
+        }
+        for (size_t slot = 0; slot < values.size(); ++slot) {
+            values[slot] = values[slot] * -1.5 + 0.25;
+            double result = incremental.update(slot, values[slot]);
+            if (not same(result, compiled.evaluate(values.data()))) {
+                fail("Testing incremental " + test.first + " failed after changing " +
+                     compiled.variables()[slot] + ".");
+            }
+        }
+    }
+    string sum{"v0"};
+    for (int i = 1; i < 1000; ++i) {
+        sum += " + v" + std::to_string(i);
+    }
+    // Each check starts from every variable at one, changes one and counts what is recomputed.
+    const struct {
+        string equation;
+        size_t slot;
+        double value;
+        size_t recomputed;
+    } counts[] = {
+            {"a*b + c*d + e*f",     0, 2.0, 3},
+            {"a*b + c*d + e*f",     5, 2.0, 2},
+            {"(x+y)*(x+y)",         0, 2.0, 2},
+            {"floor(x) + y",        0, 1.5, 1},
+            {"x * 2 - y",           1, 1.0, 0},
+            {sum,                   999, 2.0, 1},
+            {sum,                   0, 2.0, 999},
+    };
+    for (auto &test : counts) {
+        Compiled_expression compiled{test.equation};
+        Incremental_expression incremental{compiled};
+        vector<double> values(compiled.variables().size(), 1.0);
+        incremental.evaluate(values.data());
+        values[test.slot] = test.value;
+        double result = incremental.update(test.slot, test.value);
+        if (incremental.recomputed() not_eq test.recomputed or
+            not same(result, compiled.evaluate(values.data()))) {
+            fail("Testing incremental " + test.equation.substr(0, 20) + " failed. " +
+                 std::to_string(incremental.recomputed()) + " nodes recomputed instead of " +
+                 std::to_string(test.recomputed) + ".");
+        }
+    }
+    Incremental_expression shared{Compiled_expression{"(x+y)*(x+y) - sqrt(x+y)"}};
+    Incremental_expression invalid{Compiled_expression{"(x+"}};
+    if (shared.nodes() not_eq 6 or invalid.valid() or not std::isnan(invalid.update(0, 1.0))) {
+        fail("Testing incremental graph failed.");
+    }
+    Incremental_expression constant{Compiled_expression{"2 * 3"}};
+    double before = shared.update(0, 2.0);
+    if (not std::isnan(shared.evaluate(nullptr)) or shared.recomputed() not_eq 0 or
+        shared.value() not_eq before or constant.evaluate(nullptr) not_eq 6.0) {
+        fail("Testing incremental failed. No values were not the same as for Compiled_expression.");
+    }
+}
+
+/*
+ * The C interface gives the results of Compiled_expression, reads caller-owned columns in place and
+ * writes to a caller-owned result, which may be one of the columns, and reports errors as codes.
+ */
+void Infix_calculator_testing::check_c_api() {
+    const string equation{"(x - y) / rate + max(x, y)"};
+    const char *names[] = {"x", "y", "rate"};
+    calculator_expression *expression = calculator_compile(equation.data(), equation.size(), names,
+                                                           3);
+    const size_t rows{100};
+    vector<double> x(rows), y(rows), rate(rows), result(rows), expected(rows);
+    for (size_t row = 0; row < rows; ++row) {
+        x[row] = 0.5 * double(row);
+        y[row] = 10.0 - double(row % 7);
+        rate[row] = 0.25 + double(row % 3);
+    }
+    Compiled_expression compiled{equation, {"x", "y", "rate"}};
+    const double *columns[] = {x.data(), y.data(), rate.data()};
+    compiled.evaluate_batch(columns, rows, expected.data());
+    bool batch = calculator_evaluate_batch(expression, columns, rows, result.data()) == 0 and
+                 result == expected;
+    bool in_place = calculator_evaluate_batch(expression, columns, rows, x.data()) == 0 and
+                    x == expected;
+    double values[] = {2.0, -3.5, 0.25};
+    size_t offset{0};
+    calculator_error error{CALCULATOR_OK};
+    double solved = calculator_solve("5÷(2×(3^3))", strlen("5÷(2×(3^3))"), &error, nullptr);
+    calculator_expression *invalid = calculator_compile("x +", 3, nullptr, 0);
+    if (not batch or not in_place or
+        calculator_evaluate(expression, values) != compiled.evaluate(values) or
+        calculator_variable_count(expression) != 3 or
+        string(calculator_variable(expression, 2)) != "rate" or
+        calculator_variable(expression, 3) != nullptr or
+        solved != 5.0 / 54.0 or error != CALCULATOR_OK or
+        not std::isnan(calculator_solve("((1", 3, &error, &offset)) or
+        error != CALCULATOR_UNBALANCED_PARENTHESES or offset != 0 or
+        calculator_compile_error(invalid, &offset) != CALCULATOR_OPERATOR_SEQUENCE or offset != 2 or
+        calculator_evaluate_batch(invalid, nullptr, rows, result.data()) != -1 or
+        not std::isnan(result[0]) or
+        string(calculator_describe(CALCULATOR_UNKNOWN_FUNCTION)) != "unknown function") {
+        fail("Testing the C interface failed.");
+    }
+    calculator_free(invalid);
+    calculator_free(expression);
+}
+
+/*
+ * A saved catalog loads the same programs, which give the same results bit for bit, and keeps the
+ * errors of invalid equations. A file that is damaged, or of another version, is refused.
+ */
+void Infix_calculator_testing::check_catalog() {
+    map<string, double> equations = cases;
+    equations.insert(variable_cases.begin(), variable_cases.end());
+    equations.insert(function_cases.begin(), function_cases.end());
+    equations.insert({"(1 +", 0.0});
+    vector<string> names;
+    vector<Compiled_expression> expressions;
+    for (auto &test : equations) {
+        names.push_back(test.first);
+        expressions.emplace_back(test.first);
+    }
+    auto path = (std::filesystem::temp_directory_path() / "calculator_testing.catalog").string();
+    Program_catalog catalog;
+    if (not Program_catalog::save(path, names, expressions) or not catalog.open(path) or
+        catalog.size() not_eq names.size()) {
+        fail("Testing catalog " + path + " failed. It could not be saved and opened.");
+        return;
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+        Compiled_expression loaded = catalog.expression(i);
+        vector<double> values;
+        for (auto &name : expressions[i].variables()) {
+            values.push_back(bindings[name]);
+        }
+        double expected = expressions[i].evaluate(values.data());
+        double result = loaded.evaluate(values.data());
+        if (catalog.name(i) not_eq names[i] or catalog.find(names[i]) not_eq long(i) or
+            loaded.variables() not_eq expressions[i].variables() or
+            loaded.error() not_eq expressions[i].error() or
+            loaded.error_offset() not_eq expressions[i].error_offset() or
+            loaded.instructions().size() not_eq expressions[i].instructions().size() or
+            not (result == expected or (std::isnan(result) and std::isnan(expected)))) {
+            fail("Testing catalog " + names[i] + " failed. Result " + std::to_string(result) +
+                 " not equal to compiled result " + std::to_string(expected) + ".");
+        }
+    }
+    string saved;
+    FILE *in = std::fopen(path.c_str(), "rb");
+    char buffer[4096];
+    for (size_t read; (read = std::fread(buffer, 1, sizeof(buffer), in)) > 0;) {
+        saved.append(buffer, read);
+    }
+    std::fclose(in);
+    string damaged[] = {saved.substr(0, saved.size() - 1), saved + '\0', saved, saved};
+    damaged[2][0] = 'X';
+    damaged[3][8] = char(Program_catalog::version + 1);
+    for (auto &file : damaged) {
+        FILE *out = std::fopen(path.c_str(), "wb");
+        std::fwrite(file.data(), 1, file.size(), out);
+        std::fclose(out);
+        if (catalog.open(path) or catalog.size() not_eq 0 or catalog.find(names[0]) not_eq -1) {
+            fail("Testing catalog failed. A damaged file was opened.");
+        }
+    }
+    // Any byte of a catalog may be damaged. Either open() refuses it or the expression is safe.
+    Program_catalog::save(path, {"small"}, {Compiled_expression{"max(x, 2) * y + 1.5"}});
+    FILE *small = std::fopen(path.c_str(), "r+b");
+    std::fseek(small, 0, SEEK_END);
+    long size = std::ftell(small);
+    for (long at = 0; at < size; ++at) {
+        int original;
+        std::fseek(small, at, SEEK_SET);
+        original = std::fgetc(small);
+        std::fseek(small, at, SEEK_SET);
+        std::fputc(original ^ 0xff, small);
+        std::fflush(small);
+        if (catalog.open(path)) {
+            Compiled_expression loaded = catalog.expression(0);
+            vector<double> values(loaded.variables().size(), 1.0);
+            loaded.evaluate(values.data());
+        }
+        std::fseek(small, at, SEEK_SET);
+        std::fputc(original, small);
+    }
+    std::fclose(small);
+    std::remove(path.c_str());
+    if (catalog.open(path) or Program_catalog::save(path, {"one"}, {})) {
+        fail("Testing catalog failed. A missing file was opened.");
+    }
+}
+
+/*
+ * Random equations, a quarter of them damaged, solved by every engine. The seed is fixed so that a
+ * failure can be repeated with calculator --fuzz 5000 --seed 2017.
+ */
+void Infix_calculator_testing::check_fuzzing() {
+    // Powers of a negative number to a large integer, and of -infinity, that it once found.
+    for (auto equation : {"-8^3193516985942478", "-2^4503599627370497", "(-37^359)^.24"}) {
+        double expected = Infix_calculator{equation}.compute();
+        if (Constexpr_calculator::solve<32>(equation).value not_eq expected) {
+            fail(string("Testing constexpr ") + equation + " failed. Not equal to " +
+                 std::to_string(expected) + ".");
+        }
+    }
+    // Large integral powers, which repeated squaring once took far from std::pow().
+    for (auto equation : {"1.0000001^100000000", "0.999999^-65", "1.5^1000"}) {
+        double expected = Infix_calculator{equation}.compute();
+        double solved = Constexpr_calculator::solve<32>(equation).value;
+        if (std::fabs(solved - expected) > 3e-13 * std::fabs(expected)) {
+            fail(string("Testing constexpr ") + equation + " failed. Not within 3e-13 of " +
+                 std::to_string(expected) + ".");
+        }
+    }
+    Expression_fuzzer fuzzer{2017};
+    auto results = fuzzer.run(5000);
+    if (not results.passed()) {
+        Expression_fuzzer::print(results, stderr);
+        fail("Testing fuzzing failed. The engines disagree with compute().");
+    }
+}
+
+/*
+ * Three requests pipelined on one connection come back in order, with variables bound by name,
+ * errors located in the equation as sent and an equation seen before answered from the cache. A
+ * request cut short anywhere does not decode.
+ */
+void Infix_calculator_testing::check_server() {
+    typedef Calculator_server::query query;
+    vector<query> first = {{"1+2", {}},
+                           {"principal_2*(1+rate)^x", {{"principal_2", 100.0}, {"rate", 0.25},
+                                                       {"x", 2.0}, {"unused", 1.0}}},
+                           {"(1 +", {}},
+                           {"x*y", {{"x", 3.0}}}};
+    vector<query> second = {{"5÷2×3", {}}, {"1 + 2", {}}};
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    vector<vector<Calculator_server::outcome>> expected = {
+            {{3.0, Infix_lexer::none, 0}, {156.25, Infix_lexer::none, 0},
+             {nan, Infix_lexer::operator_sequence, 3}, {nan, Infix_lexer::unknown_variable, 2}},
+            {{7.5, Infix_lexer::none, 0}, {3.0, Infix_lexer::none, 0}},
+            {}};
+    auto path = (std::filesystem::temp_directory_path() / "calculator_testing.sock").string();
+    Calculator_server server{2, 64};
+    if (not server.listen(path)) {
+        fail("Testing server failed. It could not listen on " + path + ".");
+        return;
+    }
+    std::thread loop{[&server]() { server.run(); }};
+    Calculator_client client;
+    if (not client.connect(path) or not client.send(1, first) or not client.send(2, second) or
+        not client.send(3, {})) {
+        fail("Testing server failed. Requests could not be sent.");
+    }
+    for (uint32_t i = 0; i < expected.size(); ++i) {
+        uint32_t id;
+        vector<Calculator_server::outcome> outcomes;
+        if (not client.receive(id, outcomes) or id not_eq i + 1 or
+            outcomes.size() not_eq expected[i].size()) {
+            fail("Testing server failed. Response " + std::to_string(i + 1) + " is missing.");
+            break;
+        }
+        for (size_t j = 0; j < outcomes.size(); ++j) {
+            auto &o = outcomes[j];
+            auto &e = expected[i][j];
+            bool same = std::isnan(e.value) ? std::isnan(o.value) : o.value == e.value;
+            if (not same or o.error not_eq e.error or o.offset not_eq e.offset) {
+                fail("Testing server failed. Equation " + std::to_string(j) + " of request " +
+                     std::to_string(i + 1) + " gave " + std::to_string(o.value) + ", error " +
+                     std::to_string(o.error) + " at " + std::to_string(o.offset) + ".");
+            }
+        }
+    }
+    client.close();
+    server.stop();
+    loop.join();
+    auto served = server.counters();
+    if (served.requests not_eq 3 or served.equations not_eq 6 or served.errors not_eq 2 or
+        server.cache_counters().hits < 1) {
+        fail("Testing server failed. Counted " + std::to_string(served.requests) + " requests, " +
+             std::to_string(served.equations) + " equations and " +
+             std::to_string(served.errors) + " errors.");
+    }
+    string frame;
+    Calculator_server::encode_request(7, first, frame);
+    string_view payload;
+    uint32_t id;
+    vector<query> decoded;
+    if (Calculator_server::next_frame(frame, payload) not_eq frame.size() or
+        not Calculator_server::decode_request(payload, id, decoded) or id not_eq 7 or
+        decoded.size() not_eq first.size() or decoded[1].bindings[3].name not_eq "unused") {
+        fail("Testing server failed. A request did not decode.");
+    }
+    for (size_t length = 0; length < payload.size(); ++length) {
+        if (Calculator_server::decode_request(payload.substr(0, length), id, decoded) or
+            Calculator_server::next_frame(string_view(frame).substr(0, length + 4), payload)) {
+            fail("Testing server failed. A request of " + std::to_string(length) +
+                 " bytes decoded.");
+            break;
+        }
+    }
+}
+
+/*
+ * Machine generated equations of a megabyte, nested hundreds of thousands deep or naming tens of
+ * thousands of variables, are solved without recursion and in time proportional to their length.
+ * One of eight megabytes, which quadratic behavior would make eight times slower per byte, may take
+ * at most five times as long per byte. The margin is for caches: the variable table of the smaller
+ * equation still fits in them, that of the larger one does not.
+ */
+void Infix_calculator_testing::check_long_equations() {
+    auto nested = [](size_t bytes) {
+        string equation;
+        size_t depth = bytes / 8;
+        for (size_t i = 0; i < depth; ++i) {
+            equation += "1 × (";
+        }
+        equation += "1";
+        return equation + string(depth, ')');
+    };
+    auto named = [](size_t bytes) {
+        string equation{"v0"};
+        for (size_t i = 1; equation.size() < bytes; ++i) {
+            equation += " + v" + std::to_string(i);
+        }
+        return equation;
+    };
+    auto solve = [](const string &equation) {
+        Infix_calculator c{equation};
+        vector<double> values(c.variables().size(), 1.0);
+        double computed = c.bind(values.data()).compute();
+        return computed + Compiled_expression{equation}.evaluate(values.data());
+    };
+    // The bytes allocated per byte of equation, which grows with the length if any step is not
+    // linear. Timing that is left to the stress benchmarks, as it is too noisy for a test.
+    auto memory = [&solve](const string &equation) {
+        size_t before = allocated;
+        solve(equation);
+        return double(allocated - before) / double(equation.size());
+    };
+    const size_t megabyte{1 << 20};
+    using generator = std::function<string(size_t)>;
+    for (auto make : {generator(nested), generator(named)}) {
+        string equation = make(megabyte);
+        Infix_calculator c{equation};
+        double expected = c.variables().empty() ? 2.0 : 2.0 * c.variables().size();
+        if (solve(equation) != expected) {
+            fail("Testing a " + std::to_string(equation.size()) + " byte equation failed. Result " +
+                 std::to_string(solve(equation)) + " not equal to expected result " +
+                 std::to_string(expected) + ".");
+        }
+        // Buffers that double as they grow may be up to twice as large per byte at either size.
+        double small = memory(equation);
+        double large = memory(make(8 * megabyte));
+        if (large > 2.5 * small) {
+            fail("Testing a " + std::to_string(equation.size()) + " byte equation failed. One eight " +
+                 "times its size allocated " + std::to_string(large / small) + " times as much per " +
+                 "byte.");
+        }
+    }
+}
+
 void Infix_calculator_testing::run() {
     string equation;
     double sample;
@@ -68,4 +1213,174 @@ void Infix_calculator_testing::run() {
             throw std::runtime_error(err.message());
         }
     }
+    for (auto &test : cases) {
+        Compiled_expression compiled{test.first};
+        sample = compiled.evaluate();
+        if (not approximately_equal(test.second, sample)) {
+            fail("Testing compiled " + test.first + " failed. Result " + std::to_string(sample) +
+                 " not equal to expected result " + std::to_string(test.second) + ".");
+        }
+    }
+    for (auto &test : variable_cases) {
+        Compiled_expression compiled{test.first};
+        vector<double> values;
+        for (auto &name : compiled.variables()) {
+            values.push_back(bindings[name]);
+        }
+        Infix_calculator c{test.first, true};
+        for (auto result : {compiled.evaluate(values.data()), c.bind(values.data()).compute()}) {
+            if (not approximately_equal(test.second, result)) {
+                fail("Testing " + test.first + " failed. Result " + std::to_string(result) +
+                     " not equal to expected result " + std::to_string(test.second) + ".");
+            }
+        }
+    }
+    for (auto &test : variable_cases) {
+        // Odd row counts exercise the scalar tails of the vectorized kernels.
+        Compiled_expression compiled{test.first};
+        const size_t rows{1027};
+        vector<vector<double>> columns;
+        vector<const double *> pointers;
+        for (auto &name : compiled.variables()) {
+            columns.emplace_back(rows, bindings[name]);
+            pointers.push_back(columns.back().data());
+        }
+        for (size_t row = 0; row < rows; ++row) {
+            columns[0][row] += row;
+        }
+        vector<double> result(rows);
+        compiled.evaluate_batch(pointers.data(), rows, result.data());
+        vector<double> values(columns.size());
+        for (size_t row = 0; row < rows; ++row) {
+            for (size_t i = 0; i < columns.size(); ++i) {
+                values[i] = columns[i][row];
+            }
+            if (result[row] != compiled.evaluate(values.data())) {
+                fail("Testing batch " + test.first + " failed at row " + std::to_string(row) + ".");
+            }
+        }
+    }
+    Compiled_expression unknown{"x + z", {"x", "y"}};
+    if (unknown.error() not_eq Infix_lexer::unknown_variable or unknown.error_offset() != 4) {
+        fail("Testing x + z failed. Variable z was not reported as unknown.");
+    }
+    for (auto &test : number_cases) {
+        if (Infix_lexer::parse_number(test.first) != test.second) {
+            fail("Testing number " + test.first + " failed.");
+        }
+    }
+    for (auto &test : optimization_cases) {
+        Compiled_expression compiled{test.first, {"x", "y", "rate"}, true};
+        if (compiled.instructions().size() != test.second) {
+            fail("Testing optimization of " + test.first + " failed. " +
+                 std::to_string(compiled.instructions().size()) + " instructions were left.");
+        }
+        vector<double> values{bindings["x"], bindings["y"], bindings["rate"]};
+        Infix_calculator c{test.first};
+        vector<double> bound;
+        for (auto &name : c.variables()) {
+            bound.push_back(bindings[name]);
+        }
+        if (compiled.evaluate(values.data()) != c.bind(bound.data()).compute()) {
+            fail("Testing optimization of " + test.first + " failed. The result changed.");
+        }
+    }
+    vector<Infix_lexer::token> tokens;
+    for (auto &test : invalid_cases) {
+        Infix_lexer lexer{test.first};
+        auto error = lexer.scan(tokens);
+        if (error not_eq test.second) {
+            fail("Testing " + test.first + " failed. Error kind " + std::to_string(error) +
+                 " not equal to expected kind " + std::to_string(test.second) + ".");
+        }
+        auto solution = Infix_calculator{test.first}.solve();
+        if (solution.error not_eq test.second or solution.offset not_eq lexer.error_offset() or
+            not std::isnan(solution.value)) {
+            fail("Testing solve " + test.first + " failed. Error kind " +
+                 std::to_string(solution.error) + " at " + std::to_string(solution.offset) +
+                 " not equal to expected kind " + std::to_string(test.second) + " at " +
+                 std::to_string(lexer.error_offset()) + ".");
+        }
+        Compiled_expression compiled{test.first};
+        if (compiled.error() not_eq test.second) {
+            fail("Testing compiled " + test.first + " failed. Error kind " +
+                 std::to_string(compiled.error()) + " not equal to expected kind " +
+                 std::to_string(test.second) + ".");
+        }
+        auto solved = Constexpr_calculator::solve(test.first);
+        if (solved.error not_eq test.second or solved.offset not_eq lexer.error_offset()) {
+            fail("Testing constexpr " + test.first + " failed. Error kind " +
+                 std::to_string(solved.error) + " at " + std::to_string(solved.offset) +
+                 " not equal to expected kind " + std::to_string(test.second) + " at " +
+                 std::to_string(lexer.error_offset()) + ".");
+        }
+    }
+    for (auto &test : format_cases) {
+        Infix_calculator c{test.first};
+        if (c.format() not_eq test.second) {
+            fail("Testing " + test.first + " failed. Formatted as \"" + c.format() +
+                 "\" instead of \"" + test.second + "\".");
+        }
+    }
+    Batch_evaluator batch;
+    string output;
+    batch.solve("1+2\n5÷2×3\r\n2x\n\n(1+\n1.1+2.2+3.3\nx*2", output);
+    if (output != "3\n7.5\nerror: invalid sequence of operators at 1\nerror: empty equation at 0\n"
+                  "error: invalid sequence of operators at 2\n6.6\nerror: unknown variable at 0\n" or
+        batch.totals().equations != 7 or batch.totals().errors != 4) {
+        fail("Testing batch mode failed. Output was:\n" + output);
+    }
+    // Parallel batches must come out in input order, with the same counts.
+    string lines;
+    for (int i = 0; i < 50000; ++i) {
+        lines += i % 7 ? std::to_string(i) + " × 2 − (1 + " + std::to_string(i % 13) + ")\n" : "(\n";
+    }
+    string serial;
+    Batch_evaluator one;
+    one.solve(lines, serial);
+    FILE *out = std::tmpfile();
+    Batch_evaluator four{4};
+    four.solve_buffer(lines, out);
+    string parallel(serial.size() + 1, '\0');
+    std::rewind(out);
+    parallel.resize(std::fread(&parallel[0], 1, parallel.size(), out));
+    std::fclose(out);
+    if (parallel != serial or four.totals().errors != one.totals().errors) {
+        fail("Testing parallel batch mode failed. Output differs from serial batch mode.");
+    }
+    // A streamed line may be many times longer than a chunk.
+    string longest{"1"};
+    for (int i = 0; i < 100000; ++i) {
+        longest += " + 1";
+    }
+    lines = "1 + 1\n" + longest + "\n2 × 3\n" + longest;
+    serial.clear();
+    one.solve(lines, serial);
+    FILE *in = std::tmpfile();
+    std::fwrite(lines.data(), 1, lines.size(), in);
+    std::rewind(in);
+    out = std::tmpfile();
+    Batch_evaluator streamed{4};
+    streamed.solve_stream(in, out);
+    std::fclose(in);
+    parallel.assign(serial.size() + 1, '\0');
+    std::rewind(out);
+    parallel.resize(std::fread(&parallel[0], 1, parallel.size(), out));
+    std::fclose(out);
+    if (parallel != serial or serial != "2\n100001\n6\n100001\n") {
+        fail("Testing streamed batch mode failed. Output was:\n" + parallel);
+    }
+    check_cache();
+    check_profile();
+    check_native();
+    check_numeric();
+    check_derivatives();
+    check_functions();
+    check_incremental();
+    check_c_api();
+    check_catalog();
+    check_fuzzing();
+    check_server();
+    check_long_equations();
+    check_allocations();
 }
@@ -6,16 +6,50 @@
 #define INC_9_CALCULATOR_CALCULATOR_TESTING_H
 
 #include <map>
-
-using std::map;
-using std::string;
+#include <string>
+#include "infix_lexer.h"
 
 class Infix_calculator_testing {
-    static map<string, double> cases;
+    static std::map<std::string, double> cases;
+    static std::map<std::string, Infix_lexer::error_kind> invalid_cases;
+    static std::map<std::string, std::string> format_cases;
+    static std::map<std::string, double> variable_cases;
+    static std::map<std::string, double> function_cases;
+    static std::map<std::string, double> bindings;
+    static std::map<std::string, double> number_cases;
+    static std::map<std::string, size_t> optimization_cases;
 
     // Credit to Michael Goldshteyn on SO.
     bool approximately_equal(double a, double b, double error_factor);
 
+    void fail(const std::string &message);
+
+    void check_allocations();
+
+    void check_cache();
+
+    void check_profile();
+
+    void check_native();
+
+    void check_numeric();
+
+    void check_derivatives();
+
+    void check_functions();
+
+    void check_incremental();
+
+    void check_c_api();
+
+    void check_catalog();
+
+    void check_fuzzing();
+
+    void check_server();
+
+    void check_long_equations();
+
 public:
     void run();
 };
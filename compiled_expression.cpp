@@ -0,0 +1,574 @@
+//
+// Parse once, evaluate many times.
+//
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <functional>
+#include "calculator.h"
+#include "batch_kernels.h"
+#include "compiled_expression.h"
+#include "function_registry.h"
+#include "calculator_profile.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::cout;
+using std::endl;
+
+/*
+ * A Compiled_expression runs the lexer and the shunting-yard algorithm once, at construction. The
+ * result is a postfix program over a constant pool. evaluate() walks the program with a plain
+ * array for the value stack, so repeated evaluation does no string handling and no allocation.
+ */
+Compiled_expression::Compiled_expression(string_view equation, bool debug) : debug(debug) {
+    compile(equation, nullptr);
+}
+
+Compiled_expression::Compiled_expression(string_view equation, const vector<string> &variables,
+                                         bool debug) : debug(debug) {
+    compile(equation, &variables);
+}
+
+/*
+ * Variables are resolved to slots here, once. Without a caller supplied list the slots follow the
+ * order in which the names first appear in the equation.
+ */
+void Compiled_expression::compile(string_view equation, const vector<string> *variables) {
+    vector<Infix_lexer::token> tokens;
+    Infix_lexer lexer{equation};
+    {
+        Calculator_profile::timer timed{Calculator_profile::parse};
+        compile_error = lexer.scan(tokens);
+        Calculator_profile::count_tokens(tokens.size());
+    }
+    compile_error_at = lexer.error_offset();
+    if (compile_error not_eq Infix_lexer::none) {
+        return;
+    }
+    names = variables ? *variables : lexer.variables();
+    vector<size_t> slots;
+    if (variables) {
+        std::unordered_map<string_view, size_t> given;
+        for (size_t i = names.size(); i-- > 0;) {
+            given[names[i]] = i;    // The first of any repeated names wins, as with find().
+        }
+        for (auto &name : lexer.variables()) {
+            auto found = given.find(name);
+            slots.push_back(found == given.end() ? names.size() : found->second);
+        }
+    } else {
+        for (size_t i = 0; i < names.size(); ++i) {
+            slots.push_back(i);
+        }
+    }
+    for (auto &token : tokens) {
+        if (token.type == Infix_lexer::variable and slots[token.slot] == names.size()) {
+            compile_error = Infix_lexer::unknown_variable;
+            compile_error_at = token.offset;
+            return;
+        }
+    }
+    compile(tokens, slots);
+    size_t before = program.size();
+    optimize();
+    thread();
+    debug ? cout << "Optimized " << before << " instructions to " << program.size() << "." << endl
+          : cout;
+}
+
+bool Compiled_expression::valid() const {
+    return compile_error == Infix_lexer::none;
+}
+
+Infix_lexer::error_kind Compiled_expression::error() const {
+    return compile_error;
+}
+
+size_t Compiled_expression::error_offset() const {
+    return compile_error_at;
+}
+
+const vector<string> &Compiled_expression::variables() const {
+    return names;
+}
+
+long Compiled_expression::slot(const string &name) const {
+    auto found = std::find(names.begin(), names.end(), name);
+    return found == names.end() ? -1 : long(found - names.begin());
+}
+
+const vector<Compiled_expression::instruction> &Compiled_expression::instructions() const {
+    return program;
+}
+
+size_t Compiled_expression::stack_depth() const {
+    return max_depth;
+}
+
+/*
+ * The same outline as Infix_calculator::compute(), except that operators are appended to the
+ * program instead of being applied to the value stack.
+ */
+vector<Compiled_expression::instruction> Compiled_expression::postfix(
+        const vector<Infix_lexer::token> &tokens, const vector<size_t> &slots) {
+    auto &precedence = Infix_calculator::operator_precedence;
+    vector<instruction> program;
+    vector<char> operator_stack;
+    vector<instruction> calls;    // The functions whose arguments are being read, innermost last.
+    program.reserve(tokens.size());
+    auto emit = [&program, &operator_stack]() {
+        program.push_back({Infix_lexer::arithmetic_operator, operator_stack.back(), 0});
+        operator_stack.pop_back();
+    };
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        auto &token = tokens[i];
+        switch (token.type) {
+            case Infix_lexer::number : {
+                program.push_back({Infix_lexer::number, 0, uint32_t(i)});
+                break;
+            }
+            case Infix_lexer::variable : {
+                program.push_back({Infix_lexer::variable, 0, uint32_t(slots[token.slot])});
+                break;
+            }
+            case Infix_lexer::left_parenthesis : {
+                operator_stack.push_back(token.operator_);
+                break;
+            }
+            case Infix_lexer::right_parenthesis : {
+                while (operator_stack.back() != '(') {
+                    emit();
+                }
+                operator_stack.pop_back();
+                // The parenthesis closes the arguments of a function, which is called now.
+                if (not operator_stack.empty() and operator_stack.back() == 'f') {
+                    operator_stack.pop_back();
+                    program.push_back(calls.back());
+                    calls.pop_back();
+                }
+                break;
+            }
+            case Infix_lexer::function_name : {
+                operator_stack.push_back('f');
+                calls.push_back({Infix_lexer::function_name, 0, uint32_t(token.slot), 1});
+                break;
+            }
+            case Infix_lexer::comma : {
+                while (operator_stack.back() != '(') {
+                    emit();
+                }
+                ++calls.back().arguments;
+                break;
+            }
+            case Infix_lexer::arithmetic_operator : {
+                if (Infix_calculator::operators.count(token.operator_) == 0) {
+                    break;
+                }
+                while (not operator_stack.empty() and
+                       precedence.at(operator_stack.back()) <=
+                       precedence.at(token.operator_) and
+                       operator_stack.back() != '(') {
+                    emit();
+                }
+                operator_stack.push_back(token.operator_);
+                break;
+            }
+        }
+    }
+    while (not operator_stack.empty()) {
+        emit();
+    }
+    return program;
+}
+
+// Moves the numbers of the postfix program into the constant pool.
+void Compiled_expression::compile(const vector<Infix_lexer::token> &tokens,
+                                  const vector<size_t> &slots) {
+    program = postfix(tokens, slots);
+    for (auto &i : program) {
+        if (i.type == Infix_lexer::number) {
+            constants.push_back(tokens[i.index].value);
+            i.index = uint32_t(constants.size() - 1);
+        }
+    }
+    measure_depth();
+}
+
+/*
+ * Folds subexpressions of constants, calls of pure functions included, into one constant and
+ * removes operations that cannot change their other operand: x*1, 1*x, x/1, x-0, x+(-0), (-0)+x and
+ * x^1. x+0 is kept because -0 + 0 is +0. x^2 is kept as it is, for the engines that take over the
+ * program and bound a square more tightly than a product, and is multiplied out when lowered.
+ * Folding applies the same functions evaluate() does, in the same order, so results are unchanged
+ * bit for bit. The pass walks the program once, keeping a stack that records where each operand's
+ * instructions start in the output and whether it is a constant.
+ */
+void Compiled_expression::optimize() {
+    struct operand {
+        size_t start;          // Index in the output of the operand's first instruction.
+        bool constant;
+        double value;
+    };
+    vector<instruction> optimized;
+    vector<bool> removed;      // Constants dropped by a left identity, erased after the walk.
+    vector<operand> stack;
+    vector<double> folded;
+    vector<double> arguments;
+    auto push_constant = [&](double value) {
+        stack.push_back({optimized.size(), true, value});
+        optimized.push_back({Infix_lexer::number, 0, uint32_t(folded.size())});
+        removed.push_back(false);
+        folded.push_back(value);
+    };
+    auto truncate = [&](size_t size) {
+        optimized.resize(size);
+        removed.resize(size);
+    };
+    for (auto &i : program) {
+        if (i.type == Infix_lexer::number) {
+            push_constant(constants[i.index]);
+            continue;
+        }
+        if (i.type == Infix_lexer::variable) {
+            stack.push_back({optimized.size(), false, 0.0});
+            optimized.push_back(i);
+            removed.push_back(false);
+            continue;
+        }
+        if (i.type == Infix_lexer::function_name) {
+            // A pure call of constants is folded like an operator. Others are kept as they are.
+            size_t first = stack.size() - i.arguments;
+            arguments.resize(i.arguments);
+            bool constant = Function_registry::at(i.index).pure;
+            for (size_t k = first; k < stack.size(); ++k) {
+                constant = constant and stack[k].constant;
+                arguments[k - first] = stack[k].value;
+            }
+            size_t start = stack[first].start;
+            stack.resize(first);
+            if (constant) {
+                truncate(start);
+                push_constant(Function_registry::at(i.index).apply(arguments.data(), i.arguments));
+            } else {
+                optimized.push_back(i);
+                removed.push_back(false);
+                stack.push_back({start, false, 0.0});
+            }
+            continue;
+        }
+        operand right = stack.back();
+        stack.pop_back();
+        operand left = stack.back();
+        stack.pop_back();
+        char op = i.operator_;
+        auto is = [](const operand &o, double value, bool negative = false) {
+            return o.constant and o.value == value and std::signbit(o.value) == negative;
+        };
+        if (left.constant and right.constant) {
+            truncate(left.start);
+            push_constant(Infix_calculator::operators.at(op)(left.value, right.value));
+        } else if ((op == '*' and is(right, 1.0)) or (op == '/' and is(right, 1.0)) or
+                   (op == '-' and is(right, 0.0)) or (op == '+' and is(right, 0.0, true)) or
+                   (op == '^' and is(right, 1.0))) {
+            truncate(right.start);
+            stack.push_back(left);
+        } else if ((op == '*' and is(left, 1.0)) or (op == '+' and is(left, 0.0, true))) {
+            removed[left.start] = true;
+            stack.push_back({left.start, false, 0.0});
+        } else {
+            optimized.push_back(i);
+            removed.push_back(false);
+            stack.push_back({left.start, false, 0.0});
+        }
+    }
+    // Keep the surviving instructions, and only the constants they still use.
+    program.clear();
+    constants.clear();
+    for (size_t i = 0; i < optimized.size(); ++i) {
+        if (removed[i]) {
+            continue;
+        }
+        if (optimized[i].type == Infix_lexer::number) {
+            constants.push_back(folded[optimized[i].index]);
+            optimized[i].index = uint32_t(constants.size() - 1);
+        }
+        program.push_back(optimized[i]);
+    }
+    measure_depth();
+}
+
+// The deepest the value stack gets while running the program, and the operators and calls it
+// applies.
+void Compiled_expression::measure_depth() {
+    size_t depth{0};
+    max_depth = 0;
+    operator_count = 0;
+    call_count = 0;
+    for (auto &i : program) {
+        operator_count += i.type == Infix_lexer::arithmetic_operator;
+        call_count += i.type == Infix_lexer::function_name;
+        if (i.type == Infix_lexer::function_name) {
+            depth -= i.arguments - 1;
+        } else {
+            depth = i.type == Infix_lexer::arithmetic_operator ? depth - 1 : depth + 1;
+        }
+        max_depth = std::max(max_depth, depth);
+    }
+}
+
+/*
+ * Lowers the postfix program to the steps run by evaluate(). An operator whose right operand is a
+ * single push takes that operand from the step itself, which saves a dispatch and a trip through
+ * the value stack: x * 2 runs as push x, multiply by 2. A variable squared runs as push x, multiply
+ * by x, the correctly rounded square, which std::pow() only approximates.
+ */
+void Compiled_expression::thread() {
+    static const opcode binary[] = {add, subtract, multiply, divide, power};
+    auto offset = [](char operator_) {
+        switch (operator_) {
+            case '+' : return 0;
+            case '-' : return 1;
+            case '*' : return 2;
+            case '/' : return 3;
+            default : return 4;
+        }
+    };
+    threaded.clear();
+    threaded.reserve(program.size() + 1);
+    for (size_t i = 0; i < program.size(); ++i) {
+        auto &next = program[i];
+        bool fused = i + 1 < program.size() and i > 0 and
+                     next.type not_eq Infix_lexer::arithmetic_operator and
+                     program[i + 1].type == Infix_lexer::arithmetic_operator;
+        if (next.type == Infix_lexer::number and fused and program[i + 1].operator_ == '^' and
+            constants[next.index] == 2.0 and program[i - 1].type == Infix_lexer::variable) {
+            threaded.push_back({multiply_variable, 0, program[i - 1].index, 0.0});
+            ++i;
+        } else if (next.type == Infix_lexer::number) {
+            int code = fused ? add_constant + offset(program[++i].operator_) : push_constant;
+            threaded.push_back({opcode(code), 0, 0, constants[next.index]});
+        } else if (next.type == Infix_lexer::variable) {
+            int code = fused ? add_variable + offset(program[++i].operator_) : push_variable;
+            threaded.push_back({opcode(code), 0, next.index, 0.0});
+        } else if (next.type == Infix_lexer::function_name) {
+            threaded.push_back({call, uint16_t(next.arguments), next.index, 0.0});
+        } else {
+            threaded.push_back({binary[offset(next.operator_)], 0, 0, 0.0});
+        }
+    }
+    threaded.push_back({halt, 0, 0, 0.0});
+}
+
+/*
+ * The top of the value stack is kept in a local, so most steps touch memory at most once. With GCC
+ * and Clang each step jumps straight to the next one through a table of label addresses, which
+ * gives the branch predictor one indirect jump per step instead of a single shared one. Other
+ * compilers run the same steps in a switch.
+ */
+#if defined(__GNUC__)
+#define COMPILED_EXPRESSION_THREADED 1
+#endif
+
+#ifdef COMPILED_EXPRESSION_THREADED
+#define COMPILED_EXPRESSION_STEP(name) name##_step
+#define COMPILED_EXPRESSION_NEXT goto *labels[(++pc)->code]
+#else
+#define COMPILED_EXPRESSION_STEP(name) case name
+#define COMPILED_EXPRESSION_NEXT ++pc; continue
+#endif
+
+double Compiled_expression::run(double *stack, const double *values) const {
+    const step *pc = threaded.data();
+    double *below = stack;    // One past the value under the top.
+    double top{0.0};
+#ifdef COMPILED_EXPRESSION_THREADED
+    static const void *const labels[] = {
+            &&push_constant_step, &&push_variable_step,
+            &&add_step, &&subtract_step, &&multiply_step, &&divide_step, &&power_step,
+            &&add_constant_step, &&subtract_constant_step, &&multiply_constant_step,
+            &&divide_constant_step, &&power_constant_step,
+            &&add_variable_step, &&subtract_variable_step, &&multiply_variable_step,
+            &&divide_variable_step, &&power_variable_step,
+            &&call_step, &&halt_step,
+    };
+    goto *labels[pc->code];
+#else
+    for (;;) switch (pc->code) {
+#endif
+    COMPILED_EXPRESSION_STEP(push_constant):
+        *below++ = top;
+        top = pc->constant;
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(push_variable):
+        *below++ = top;
+        top = values[pc->index];
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(add):
+        top = Infix_calculator::plus(*--below, top);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(subtract):
+        top = Infix_calculator::minus(*--below, top);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(multiply):
+        top = Infix_calculator::multiply(*--below, top);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(divide):
+        top = Infix_calculator::divide(*--below, top);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(power):
+        top = Infix_calculator::exponent(*--below, top);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(add_constant):
+        top = Infix_calculator::plus(top, pc->constant);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(subtract_constant):
+        top = Infix_calculator::minus(top, pc->constant);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(multiply_constant):
+        top = Infix_calculator::multiply(top, pc->constant);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(divide_constant):
+        top = Infix_calculator::divide(top, pc->constant);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(power_constant):
+        top = Infix_calculator::exponent(top, pc->constant);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(add_variable):
+        top = Infix_calculator::plus(top, values[pc->index]);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(subtract_variable):
+        top = Infix_calculator::minus(top, values[pc->index]);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(multiply_variable):
+        top = Infix_calculator::multiply(top, values[pc->index]);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(divide_variable):
+        top = Infix_calculator::divide(top, values[pc->index]);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(power_variable):
+        top = Infix_calculator::exponent(top, values[pc->index]);
+        COMPILED_EXPRESSION_NEXT;
+    COMPILED_EXPRESSION_STEP(call): {
+        // The arguments are the values under the top and the top itself, stored above them.
+        double *arguments = below - (pc->arguments - 1);
+        *below = top;
+        top = Function_registry::at(pc->index).apply(arguments, pc->arguments);
+        below = arguments;
+        COMPILED_EXPRESSION_NEXT;
+    }
+    COMPILED_EXPRESSION_STEP(halt):
+        return top;
+#ifndef COMPILED_EXPRESSION_THREADED
+    }
+#endif
+}
+
+double Compiled_expression::evaluate() const {
+    return evaluate(nullptr);
+}
+
+double Compiled_expression::evaluate(const double *values) const {
+    if (not valid() or (values == nullptr and not names.empty())) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    Calculator_profile::timer timed{Calculator_profile::evaluate};
+    Calculator_profile::count_operator(operator_count);
+    Calculator_profile::count_call(call_count);
+    Calculator_profile::stack_depth(max_depth, 0);
+    // Shallow programs, which is nearly all of them, keep their value stack in registers or on the
+    // machine stack. Deeper ones reuse a per-thread buffer that only grows. A call stores the top
+    // above the values under it, so the stack takes one slot more than the deepest it gets.
+    const size_t inline_depth{32};
+    if (max_depth < inline_depth) {
+        double stack[inline_depth];
+        return run(stack, values);
+    }
+    thread_local vector<double> deep_stack;
+    if (deep_stack.size() <= max_depth) {
+        deep_stack.resize(max_depth + 1);
+    }
+    return run(deep_stack.data(), values);
+}
+
+/*
+ * The value stack holds one block of rows per level. Variables are read in place from their
+ * columns, constants are broadcast into their level, and each operator writes over the block of
+ * its left operand. The last operator writes straight into result, so neither the inputs nor the
+ * output are copied, except where evaluation is in place. Blocks are sized to stay in the L1 and L2 caches.
+ */
+void Compiled_expression::evaluate_batch(const double *const *columns, size_t rows,
+                                         double *result) const {
+    if (not valid() or (columns == nullptr and not names.empty())) {
+        Batch_kernels::fill(result, std::numeric_limits<double>::quiet_NaN(), rows);
+        return;
+    }
+    // Deep programs take fewer rows per block, so the levels stay within about 4 MB.
+    const size_t block = std::max<size_t>(8, std::min<size_t>(512, (size_t(1) << 19) / max_depth));
+    thread_local vector<double> levels;
+    thread_local vector<const double *> operands;
+    if (levels.size() < max_depth * block) {
+        levels.resize(max_depth * block);
+    }
+    // A deeper program can take fewer levels in all, since its blocks are shorter.
+    if (operands.size() < max_depth) {
+        operands.resize(max_depth);
+    }
+    // The last instruction writes straight into result, unless result overlaps a column.
+    const instruction *last = &program.back();
+    std::less<const double *> before;
+    for (size_t k = 0; k < names.size(); ++k) {
+        if (before(columns[k], result + rows) and before(result, columns[k] + rows)) {
+            last = nullptr;
+        }
+    }
+    for (size_t begin = 0; begin < rows; begin += block) {
+        size_t n = std::min(block, rows - begin);
+        size_t size{0};
+        double *out = result + begin;
+        for (auto &i : program) {
+            switch (i.type) {
+                case Infix_lexer::number : {
+                    double *level = &levels[size * block];
+                    Batch_kernels::fill(level, constants[i.index], n);
+                    operands[size++] = level;
+                    break;
+                }
+                case Infix_lexer::variable : {
+                    operands[size++] = columns[i.index] + begin;
+                    break;
+                }
+                case Infix_lexer::function_name : {
+                    size -= i.arguments - 1;
+                    double *level = &i == last ? out : &levels[(size - 1) * block];
+                    Function_registry::apply_batch(i.index, &operands[size - 1], i.arguments, level,
+                                                   n);
+                    operands[size - 1] = level;
+                    break;
+                }
+                default : {
+                    const double *operand = operands[--size];
+                    double *level = &i == last ? out : &levels[(size - 1) * block];
+                    // Anything squared is multiplied by itself, as Elementary_functions::pow() would give.
+                    bool square = i.operator_ == '^' and (&i - 1)->type == Infix_lexer::number and
+                                  constants[(&i - 1)->index] == 2.0;
+                    operand = square ? operands[size - 1] : operand;
+                    Batch_kernels::for_operator(square ? '*' : i.operator_)(operands[size - 1],
+                                                                            operand, level, n);
+                    operands[size - 1] = level;
+                    break;
+                }
+            }
+        }
+        if (operands[0] not_eq out) {
+            std::copy_n(operands[0], n, out);
+        }
+    }
+}
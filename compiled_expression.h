@@ -0,0 +1,117 @@
+//
+// Parse once, evaluate many times.
+//
+
+#ifndef INC_9_CALCULATOR_COMPILED_EXPRESSION_H
+#define INC_9_CALCULATOR_COMPILED_EXPRESSION_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "infix_lexer.h"
+
+class Compiled_expression {
+
+public:
+    // In debug mode the instruction counts before and after optimization are printed.
+    explicit Compiled_expression(std::string_view equation, bool debug = false);
+
+    // Fixes the slot order of the variables. Names not in the list are reported as unknown.
+    Compiled_expression(std::string_view equation, const std::vector<std::string> &variables,
+                        bool debug = false);
+
+    bool valid() const;
+
+    Infix_lexer::error_kind error() const;
+
+    size_t error_offset() const;
+
+    double evaluate() const;
+
+    // values[i] is the value of variables()[i].
+    double evaluate(const double *values) const;
+
+    /*
+     * Evaluates rows of variable values held in columns. columns[i] points to rows values of
+     * variables()[i] and rows results are written to result. Each instruction runs as a vectorized
+     * loop over a block of rows. The columns are read where they are and result may be one of them.
+     */
+    void evaluate_batch(const double *const *columns, size_t rows, double *result) const;
+
+    const std::vector<std::string> &variables() const;
+
+    // The slot of a variable, or -1 when it has none.
+    long slot(const std::string &name) const;
+
+    /*
+     * A postfix instruction. Numbers index into the constant pool, variables into the values
+     * passed to evaluate(), and operators carry their symbol. A function call indexes into
+     * Function_registry and takes its arguments from the top of the stack.
+     */
+    struct instruction {
+        Infix_lexer::token_type type;
+        char operator_;
+        uint32_t index;
+        uint32_t arguments{0};    // Function calls only.
+    };
+
+    const std::vector<instruction> &instructions() const;
+
+    /*
+     * The shunting-yard algorithm alone, from tokens to an unoptimized postfix program. Numbers
+     * index into tokens rather than into a constant pool, so other number types can read their
+     * digits, and variables take their slots from slots[token.slot].
+     */
+    static std::vector<instruction> postfix(const std::vector<Infix_lexer::token> &tokens,
+                                            const std::vector<size_t> &slots);
+
+    size_t stack_depth() const;
+
+private:
+    friend class Native_expression;
+    friend class Incremental_expression;
+    friend class Program_catalog;
+    template<typename Number> friend class Numeric_expression;
+
+    // An empty expression, for Program_catalog to fill in.
+    Compiled_expression() = default;
+
+    /*
+     * The program as run by evaluate(). Operators whose right operand is a constant or a variable
+     * are fused with the push of that operand, and constants are held inline.
+     */
+    enum opcode : uint8_t {
+        push_constant, push_variable,
+        add, subtract, multiply, divide, power,
+        add_constant, subtract_constant, multiply_constant, divide_constant, power_constant,
+        add_variable, subtract_variable, multiply_variable, divide_variable, power_variable,
+        call, halt,
+    };
+    struct step {
+        opcode code;
+        uint16_t arguments;    // Function calls only.
+        uint32_t index;        // Variables and function calls only.
+        double constant;       // Constants only.
+    };
+
+    std::vector<instruction> program;
+    std::vector<step> threaded;
+    std::vector<double> constants;
+    std::vector<std::string> names;
+    size_t max_depth{0};
+    size_t operator_count{0};
+    size_t call_count{0};
+    Infix_lexer::error_kind compile_error{Infix_lexer::none};
+    size_t compile_error_at{0};
+    bool debug{false};
+    void compile(std::string_view equation, const std::vector<std::string> *variables);
+    void compile(const std::vector<Infix_lexer::token> &tokens, const std::vector<size_t> &slots);
+    void optimize();
+    void measure_depth();
+    void thread();
+    double run(double *stack, const double *values) const;
+};
+
+#endif //INC_9_CALCULATOR_COMPILED_EXPRESSION_H
@@ -0,0 +1,621 @@
+//
+// Infix equations solved at compile time.
+//
+
+#ifndef INC_9_CALCULATOR_CONSTEXPR_CALCULATOR_H
+#define INC_9_CALCULATOR_CONSTEXPR_CALCULATOR_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include "infix_lexer.h"
+
+/*
+ * Constexpr_calculator reads the same grammar as Infix_lexer, glyphs and signs included, and
+ * applies the precedence table of Infix_calculator::operator_precedence, but every function is
+ * constexpr. An equation written into the source is solved by the compiler:
+ *
+ *     constexpr double ratio = Constexpr_calculator::calc("5÷(2×(3^3))");
+ *
+ * or compiled to a postfix program whose variables are the parameters of a function:
+ *
+ *     constexpr auto interest = Constexpr_calculator::compile("principal*(1+rate)^years",
+ *                                                             {"principal", "rate", "years"});
+ *     double owed = interest(100.0, 0.25, 2.0);    // 156.25, with no parsing at run time.
+ *
+ * Numbers of up to 15 significant digits and with at most 22 decimal places are converted exactly
+ * as std::from_chars would. Integral powers up to 64 in magnitude are multiplied out by repeated
+ * squaring, which rounds at each step where std::pow() rounds once, so x^n may differ from it by
+ * up to about n ulps. Other powers are exp(y log(x)), whose error grows with y log(x), up to a
+ * relative 3e-13 for a result in range. Longer literals may differ from std::from_chars' in the
+ * last bit.
+ *
+ * Function calls are not supported. A name followed by a parenthesis is read as a variable, so
+ * "sqrt(4)" is an invalid sequence of operators and "max(1, 2)" has an invalid character.
+ */
+class Constexpr_calculator {
+
+public:
+    typedef Infix_lexer::token_type token_type;
+    typedef Infix_lexer::error_kind error_kind;
+
+    struct instruction {
+        token_type type{Infix_lexer::number};
+        char operator_{0};     // Operators only. 'n' negates its one operand, as -1 * it.
+        double value{0.0};     // Numbers only. The signed value.
+        size_t slot{0};        // Variables only. The index of its parameter.
+    };
+
+    // Infix_calculator::operator_precedence as a constexpr function. Lower binds tighter.
+    static constexpr int precedence(char operator_) {
+        switch (operator_) {
+            case '(' :
+            case ')' :
+            case '^' : return 1;
+            case '*' :
+            case '/' : return 2;
+            case '+' :
+            case '-' : return 3;
+            default : return 0;
+        }
+    }
+
+    /*
+     * A postfix program of at most Capacity instructions over Variables parameters. Any equation of
+     * Capacity bytes fits. Compiling a longer one throws, which is a compile error in a constant
+     * expression.
+     */
+    template<size_t Capacity, size_t Variables = 0>
+    class expression {
+
+    public:
+        constexpr explicit expression(std::string_view equation,
+                                      const std::array<std::string_view, Variables> &names = {}) {
+            compile(equation, names);
+        }
+
+        constexpr bool valid() const {
+            return error_ == Infix_lexer::none;
+        }
+
+        constexpr error_kind error() const {
+            return error_;
+        }
+
+        constexpr size_t error_offset() const {
+            return error_at;
+        }
+
+        constexpr size_t size() const {
+            return length;
+        }
+
+        constexpr const instruction &operator[](size_t i) const {
+            return program[i];
+        }
+
+        // values[i] is the value of the variable named names[i]. Invalid equations return NaN.
+        constexpr double evaluate(const double *values) const {
+            if (not valid()) {
+                return std::numeric_limits<double>::quiet_NaN();
+            }
+            double stack[Capacity]{};
+            size_t depth{0};
+            for (size_t i = 0; i < length; ++i) {
+                const instruction &next = program[i];
+                if (next.type == Infix_lexer::number) {
+                    stack[depth++] = next.value;
+                } else if (next.type == Infix_lexer::variable) {
+                    stack[depth++] = values[next.slot];
+                } else if (next.operator_ == 'n') {
+                    stack[depth - 1] = apply('*', -1.0, stack[depth - 1]);
+                } else {
+                    --depth;
+                    stack[depth - 1] = apply(next.operator_, stack[depth - 1], stack[depth]);
+                }
+            }
+            return stack[0];
+        }
+
+        template<typename... Values>
+        constexpr double operator()(Values... values) const {
+            static_assert(sizeof...(Values) == Variables, "Pass one value per variable.");
+            const double bound[Variables + 1] = {double(values)..., 0.0};
+            return evaluate(bound);
+        }
+
+    private:
+        instruction program[Capacity]{};
+        size_t length{0};
+        error_kind error_{Infix_lexer::none};
+        size_t error_at{0};
+
+        // Records the first error of the most important kind, as Infix_lexer::fail() does.
+        constexpr void fail(error_kind kind, size_t offset) {
+            if (error_ == Infix_lexer::none or kind < error_) {
+                error_ = kind;
+                error_at = offset;
+            }
+        }
+
+        constexpr void emit(const instruction &next) {
+            if (length == Capacity) {
+                throw std::length_error("Constexpr_calculator::expression capacity exceeded.");
+            }
+            program[length++] = next;
+        }
+
+        constexpr void emit(char operator_) {
+            emit(instruction{Infix_lexer::arithmetic_operator, operator_, 0.0, 0});
+        }
+
+        static constexpr void push(char *operators, size_t &pending, char operator_) {
+            if (pending == Capacity) {
+                throw std::length_error("Constexpr_calculator::expression capacity exceeded.");
+            }
+            operators[pending++] = operator_;
+        }
+
+        /*
+         * The scan follows Infix_lexer::scan() and the shunting-yard pass follows compute(),
+         * emitting each operator where compute() would apply it.
+         */
+        constexpr void compile(std::string_view equation,
+                               const std::array<std::string_view, Variables> &names) {
+            char operators[Capacity]{};
+            size_t pending{0};
+            bool expect_operand{true};
+            long depth{0};
+            size_t outermost_open{0};
+            size_t last_offset{0};       // Offset of the last token.
+            bool scanned_token{false};
+            size_t unknown_at{equation.size()};    // Offset of the first unknown variable.
+            bool negate{false};          // A sign applies to the next name or parenthesis.
+            bool negated[Capacity + 1]{};    // Whether the group at each depth had a sign.
+            size_t position{0};
+            while (position < equation.size()) {
+                size_t offset = position;
+                size_t length_{1};
+                char symbol = next_symbol(equation, position, length_);
+                if (is_space(symbol)) {
+                    position += length_;
+                    continue;
+                }
+                // As in Infix_lexer::scan(), - before a name or a parenthesis negates that operand,
+                // which Infix_lexer writes as (-1 * operand), and + changes nothing.
+                if ((symbol == '+' or symbol == '-') and expect_operand and
+                    starts_name_or_group(equation, offset + length_)) {
+                    if (symbol == '-') {
+                        negate = true;
+                        scanned_token = true;
+                        last_offset = offset;
+                    }
+                    position += length_;
+                    continue;
+                }
+                if (is_digit(symbol) or symbol == '.' or
+                    ((symbol == '+' or symbol == '-') and expect_operand and
+                     starts_number(equation, offset + length_))) {
+                    bool signed_ = not is_digit(symbol) and symbol != '.';
+                    if (not signed_ and not starts_number(equation, offset)) {
+                        fail(Infix_lexer::invalid_character, offset);
+                        position += length_;
+                        continue;
+                    }
+                    if (not expect_operand) {
+                        fail(Infix_lexer::operator_sequence, offset);
+                    }
+                    position += signed_ ? length_ : 0;
+                    double value = scan_number(equation, position);
+                    emit(instruction{Infix_lexer::number, 0, symbol == '-' ? -value : value, 0});
+                    expect_operand = false;
+                    scanned_token = true;
+                    last_offset = offset;
+                    continue;
+                }
+                if (is_alpha(symbol) or symbol == '_') {
+                    if (not expect_operand) {
+                        fail(Infix_lexer::operator_sequence, offset);
+                    }
+                    while (position < equation.size() and
+                           (is_alpha(equation[position]) or is_digit(equation[position]) or
+                            equation[position] == '_')) {
+                        ++position;
+                    }
+                    std::string_view name = equation.substr(offset, position - offset);
+                    size_t slot{0};
+                    while (slot < Variables and names[slot] != name) {
+                        ++slot;
+                    }
+                    if (slot == Variables and unknown_at == equation.size()) {
+                        unknown_at = offset;
+                    }
+                    emit(instruction{Infix_lexer::variable, 0, 0.0, slot});
+                    if (negate) {
+                        emit('n');
+                        negate = false;
+                    }
+                    expect_operand = false;
+                    scanned_token = true;
+                    last_offset = offset;
+                    continue;
+                }
+                if (precedence(symbol)) {
+                    scanned_token = true;
+                    last_offset = offset;
+                }
+                switch (symbol) {
+                    case '+' :
+                    case '-' :
+                    case '*' :
+                    case '/' :
+                    case '^' : {
+                        if (expect_operand) {
+                            fail(Infix_lexer::operator_sequence, offset);
+                        }
+                        while (pending > 0 and operators[pending - 1] != '(' and
+                               precedence(operators[pending - 1]) <= precedence(symbol)) {
+                            emit(operators[--pending]);
+                        }
+                        push(operators, pending, symbol);
+                        expect_operand = true;
+                        break;
+                    }
+                    case '(' : {
+                        if (not expect_operand) {
+                            fail(Infix_lexer::operator_sequence, offset);
+                        }
+                        if (depth == 0) {
+                            outermost_open = offset;
+                        }
+                        negated[depth] = negate;
+                        negate = false;
+                        ++depth;
+                        push(operators, pending, symbol);
+                        expect_operand = true;
+                        break;
+                    }
+                    case ')' : {
+                        if (expect_operand) {
+                            fail(Infix_lexer::operator_sequence, offset);
+                        }
+                        if (depth == 0) {
+                            fail(Infix_lexer::unbalanced_parentheses, offset);
+                        } else {
+                            --depth;
+                            while (operators[pending - 1] != '(') {
+                                emit(operators[--pending]);
+                            }
+                            --pending;
+                            if (negated[depth]) {
+                                emit('n');
+                            }
+                        }
+                        expect_operand = false;
+                        break;
+                    }
+                    default : {
+                        fail(Infix_lexer::invalid_character, offset);
+                        break;
+                    }
+                }
+                position += length_;
+            }
+            if (depth > 0) {
+                fail(Infix_lexer::unbalanced_parentheses, outermost_open);
+            }
+            if (not scanned_token) {
+                fail(Infix_lexer::empty_equation, 0);
+            } else if (expect_operand) {
+                fail(Infix_lexer::operator_sequence, last_offset);
+            }
+            // Names are checked last, so any error the lexer would report comes first.
+            if (valid() and unknown_at < equation.size()) {
+                fail(Infix_lexer::unknown_variable, unknown_at);
+            }
+            while (pending > 0 and valid()) {
+                emit(operators[--pending]);
+            }
+            if (not valid()) {
+                length = 0;
+            }
+        }
+    };
+
+    // The outcome of solving an equation without variables.
+    struct result {
+        double value;
+        error_kind error;
+        size_t offset;
+
+        constexpr bool valid() const {
+            return error == Infix_lexer::none;
+        }
+    };
+
+    template<size_t Capacity = 64>
+    static constexpr result solve(std::string_view equation) {
+        expression<Capacity> compiled{equation};
+        return {compiled.evaluate(nullptr), compiled.error(), compiled.error_offset()};
+    }
+
+    // Solves an equation literal. An invalid equation throws, so it does not compile.
+    template<size_t N>
+    static constexpr double calc(const char (&equation)[N]) {
+        result solved = solve<N>(std::string_view(equation, N - 1));
+        if (not solved.valid()) {
+            throw std::invalid_argument(Infix_lexer::describe(solved.error));
+        }
+        return solved.value;
+    }
+
+    // Compiles an equation literal to a function of the named variables, in that order.
+    template<size_t N, size_t Variables>
+    static constexpr expression<N, Variables> compile(const char (&equation)[N],
+                                                      const char *const (&names)[Variables]) {
+        std::array<std::string_view, Variables> views{};
+        for (size_t i = 0; i < Variables; ++i) {
+            views[i] = names[i];
+        }
+        expression<N, Variables> compiled{std::string_view(equation, N - 1), views};
+        if (not compiled.valid()) {
+            throw std::invalid_argument(Infix_lexer::describe(compiled.error()));
+        }
+        return compiled;
+    }
+
+    // The operators of Infix_calculator::operators.
+    static constexpr double apply(char operator_, double x, double y) {
+        switch (operator_) {
+            case '+' : return x + y;
+            case '-' : return x - y;
+            case '*' : return x * y;
+            case '/' : return divide(x, y);
+            case '^' : return power(x, y);
+            default : return std::numeric_limits<double>::quiet_NaN();
+        }
+    }
+
+    // Division by zero is not a constant expression, so its IEEE result is spelled out.
+    static constexpr double divide(double x, double y) {
+        if (y != 0.0) {
+            return x / y;
+        }
+        if (x != x or x == 0.0) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        bool negative = (x < 0.0) != is_negative_zero(y);
+        return negative ? -std::numeric_limits<double>::infinity()
+                        : std::numeric_limits<double>::infinity();
+    }
+
+    static constexpr double power(double x, double y) {
+        if (y == 0.0 or x == 1.0) {
+            return 1.0;
+        }
+        if (x != x or y != y) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        // Every double of magnitude 2^53 or more, infinity included, is an even integer.
+        bool large = y >= 9007199254740992.0 or y <= -9007199254740992.0;
+        bool integral = large or y == double(int64_t(y));
+        if (integral and y <= 64.0 and y >= -64.0) {
+            // Small integral powers by repeated squaring. A negative power is the reciprocal of
+            // the positive one, so that 10^-5 rounds once more rather than at every step.
+            uint64_t n = uint64_t(y < 0.0 ? -y : y);
+            double product = multiplied(x, n);
+            if (y > 0.0) {
+                return product;
+            }
+            bool finite = product < std::numeric_limits<double>::infinity() and
+                          product > -std::numeric_limits<double>::infinity();
+            return finite ? divide(1.0, product) : multiplied(divide(1.0, x), n);
+        }
+        if (x < 0.0) {
+            if (integral) {
+                // The magnitude as for -x, negative when y is odd.
+                double magnitude = power(-x, y);
+                return not large and int64_t(y) & 1 ? -magnitude : magnitude;
+            }
+            if (x == -std::numeric_limits<double>::infinity()) {
+                return y > 0.0 ? std::numeric_limits<double>::infinity() : 0.0;
+            }
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        if (x == 0.0) {
+            return y > 0.0 ? 0.0 : std::numeric_limits<double>::infinity();
+        }
+        return exp(y * log(x));
+    }
+
+    // x^n by repeated squaring.
+    static constexpr double multiplied(double x, uint64_t n) {
+        double product{1.0};
+        while (n) {
+            if (n & 1) {
+                product *= x;
+            }
+            x *= x;
+            n >>= 1;
+        }
+        return product;
+    }
+
+    static constexpr double exp(double x) {
+        if (x != x) {
+            return x;
+        }
+        if (x > 709.78) {
+            return std::numeric_limits<double>::infinity();
+        }
+        if (x < -745.14) {
+            return 0.0;
+        }
+        // x = n ln 2 + r with |r| <= ln 2 / 2, so the series converges in a few terms.
+        long n = long(x / ln2 + (x < 0.0 ? -0.5 : 0.5));
+        double r = (x - n * ln2_high) - n * ln2_low;
+        double term{1.0};
+        double sum{1.0};
+        for (int k = 1; k < 24; ++k) {
+            term *= r / k;
+            sum += term;
+        }
+        for (; n > 0; --n) {
+            sum *= 2.0;
+        }
+        for (; n < 0; ++n) {
+            sum *= 0.5;
+        }
+        return sum;
+    }
+
+    static constexpr double log(double x) {
+        if (x != x or x < 0.0) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        if (x == 0.0) {
+            return -std::numeric_limits<double>::infinity();
+        }
+        if (x == std::numeric_limits<double>::infinity()) {
+            return x;
+        }
+        // x = m 2^e with m in [sqrt(1/2), sqrt(2)), and log m = 2 atanh((m - 1) / (m + 1)).
+        long e{0};
+        while (x >= 2.0) {
+            x *= 0.5;
+            ++e;
+        }
+        while (x < 1.0) {
+            x *= 2.0;
+            --e;
+        }
+        if (x > 1.4142135623730951) {
+            x *= 0.5;
+            ++e;
+        }
+        double s = (x - 1.0) / (x + 1.0);
+        double s2 = s * s;
+        double term = s;
+        double sum{0.0};
+        for (int k = 1; k < 40; k += 2) {
+            sum += term / k;
+            term *= s2;
+        }
+        return e * ln2_high + (2.0 * sum + e * ln2_low);
+    }
+
+    // Converts unsigned digits with an optional decimal point, advancing position past them.
+    static constexpr double scan_number(std::string_view equation, size_t &position) {
+        uint64_t mantissa{0};
+        int digits{0};         // Significant digits kept in mantissa.
+        int exponent{0};       // Power of ten to apply to mantissa.
+        bool fraction{false};
+        for (; position < equation.size(); ++position) {
+            char c = equation[position];
+            if (c == '.' and not fraction) {
+                fraction = true;
+                continue;
+            }
+            if (not is_digit(c)) {
+                break;
+            }
+            if (digits < 19) {
+                if (mantissa or c != '0') {
+                    ++digits;
+                }
+                mantissa = mantissa * 10 + uint64_t(c - '0');
+                exponent -= fraction ? 1 : 0;
+            } else {
+                exponent += fraction ? 0 : 1;
+            }
+        }
+        double value = double(mantissa);
+        // Both factors are exact below 2^53 and 10^22, so one rounding gives the nearest double.
+        for (; exponent > 0; exponent -= exponent > 22 ? 22 : exponent) {
+            value *= power_of_ten(exponent > 22 ? 22 : exponent);
+        }
+        for (; exponent < 0; exponent += exponent < -22 ? 22 : -exponent) {
+            value /= power_of_ten(exponent < -22 ? 22 : -exponent);
+        }
+        return value;
+    }
+
+private:
+    static constexpr double ln2{0.6931471805599453};
+    static constexpr double ln2_high{0.693147180369123816490};
+    static constexpr double ln2_low{1.90821492927058770002e-10};
+
+    static constexpr double power_of_ten(int exponent) {
+        double value{1.0};
+        for (int i = 0; i < exponent; ++i) {
+            value *= 10.0;
+        }
+        return value;
+    }
+
+    static constexpr bool is_negative_zero(double y) {
+#if defined(__GNUC__) || defined(__clang__)
+        return y == 0.0 and __builtin_copysign(1.0, y) < 0.0;
+#else
+        return false;
+#endif
+    }
+
+    static constexpr bool is_space(char c) {
+        return c == ' ' or c == '\t' or c == '\n' or c == '\v' or c == '\f' or c == '\r';
+    }
+
+    static constexpr bool is_digit(char c) {
+        return c >= '0' and c <= '9';
+    }
+
+    static constexpr bool is_alpha(char c) {
+        return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z');
+    }
+
+    // A number starts with a digit, or with a decimal point followed by a digit.
+    // Infix_lexer::starts_name_or_group().
+    static constexpr bool starts_name_or_group(std::string_view equation, size_t offset) {
+        return offset < equation.size() and
+               (is_alpha(equation[offset]) or equation[offset] == '_' or equation[offset] == '(');
+    }
+
+    static constexpr bool starts_number(std::string_view equation, size_t offset) {
+        return (offset < equation.size() and is_digit(equation[offset])) or
+               (offset + 1 < equation.size() and equation[offset] == '.' and
+                is_digit(equation[offset + 1]));
+    }
+
+    // Infix_lexer::next_symbol(): − ÷ × read as - / * and any other non-ASCII character as zero.
+    static constexpr char next_symbol(std::string_view equation, size_t position,
+                                      size_t &length) {
+        auto byte = [&equation](size_t i) {
+            return i < equation.size() ? static_cast<unsigned char>(equation[i]) : 0u;
+        };
+        length = 1;
+        if (byte(position) < 0x80) {
+            return equation[position];
+        }
+        if (byte(position) == 0xE2 and byte(position + 1) == 0x88 and byte(position + 2) == 0x92) {
+            length = 3;
+            return '-';
+        }
+        if (byte(position) == 0xC3 and byte(position + 1) == 0xB7) {
+            length = 2;
+            return '/';
+        }
+        if (byte(position) == 0xC3 and byte(position + 1) == 0x97) {
+            length = 2;
+            return '*';
+        }
+        while (position + length < equation.size() and (byte(position + length) & 0xC0) == 0x80) {
+            ++length;
+        }
+        return 0;
+    }
+};
+
+#endif //INC_9_CALCULATOR_CONSTEXPR_CALCULATOR_H
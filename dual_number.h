@@ -0,0 +1,194 @@
+//
+// Dual numbers for forward-mode automatic differentiation.
+//
+
+#ifndef INC_9_CALCULATOR_DUAL_NUMBER_H
+#define INC_9_CALCULATOR_DUAL_NUMBER_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+#include "function_registry.h"
+
+/*
+ * A Dual<N> is a value with its partial derivatives by up to N variables. A variable is seeded
+ * with a derivative of one by itself and every operation carries the derivatives through by the
+ * chain rule, so one evaluation gives an equation's value and its gradient, where finite
+ * differences take an evaluation more per variable and are only approximate. The value is
+ * computed by the same operations as in double, so it is the same bit for bit.
+ *
+ * The built-in functions are differentiated exactly. abs, floor, ceil, min and max take the
+ * derivative of the side they are on, and floor and ceil have none. Functions registered by the
+ * caller are differentiated by central differences, since nothing else is known of them.
+ *
+ * Operations may write their result over either operand.
+ */
+template<size_t N>
+struct Dual {
+    double value{0.0};
+    std::array<double, N> gradient{};
+
+    // A constant, whose derivatives are all zero.
+    static Dual constant(double value) {
+        Dual result;
+        result.value = value;
+        return result;
+    }
+
+    // Variable slot, of derivative one by itself and zero by the others.
+    static Dual variable(double value, size_t slot) {
+        Dual result = constant(value);
+        result.gradient[slot] = 1.0;
+        return result;
+    }
+
+    static void plus(const Dual &x, const Dual &y, Dual &result) {
+        for (size_t k = 0; k < N; ++k) {
+            result.gradient[k] = x.gradient[k] + y.gradient[k];
+        }
+        result.value = x.value + y.value;
+    }
+
+    static void minus(const Dual &x, const Dual &y, Dual &result) {
+        for (size_t k = 0; k < N; ++k) {
+            result.gradient[k] = x.gradient[k] - y.gradient[k];
+        }
+        result.value = x.value - y.value;
+    }
+
+    static void multiply(const Dual &x, const Dual &y, Dual &result) {
+        double u = x.value;
+        double v = y.value;
+        for (size_t k = 0; k < N; ++k) {
+            result.gradient[k] = v * x.gradient[k] + u * y.gradient[k];
+        }
+        result.value = u * v;
+    }
+
+    static void divide(const Dual &x, const Dual &y, Dual &result) {
+        double quotient = x.value / y.value;
+        double v = y.value;
+        for (size_t k = 0; k < N; ++k) {
+            result.gradient[k] = (x.gradient[k] - quotient * y.gradient[k]) / v;
+        }
+        result.value = quotient;
+    }
+
+    /*
+     * d(u^v) = v u^(v-1) du + u^v log(u) dv. A term is left out where its differential is zero,
+     * so a constant exponent of a negative base, or a variable one of a constant base, does not
+     * make the derivative NaN through log(u) or u^(v-1).
+     */
+    static void exponent(const Dual &x, const Dual &y, Dual &result) {
+        double u = x.value;
+        double v = y.value;
+        double power = std::pow(u, v);
+        double by_base{0.0};
+        double by_exponent{0.0};
+        bool base_varies{false};
+        bool exponent_varies{false};
+        for (size_t k = 0; k < N; ++k) {
+            base_varies = base_varies or x.gradient[k] != 0.0;
+            exponent_varies = exponent_varies or y.gradient[k] != 0.0;
+        }
+        if (base_varies) {
+            by_base = v * std::pow(u, v - 1.0);
+        }
+        if (exponent_varies) {
+            by_exponent = power * std::log(u);
+        }
+        for (size_t k = 0; k < N; ++k) {
+            double dx = x.gradient[k];
+            double dy = y.gradient[k];
+            result.gradient[k] = (dx != 0.0 ? by_base * dx : 0.0) +
+                                 (dy != 0.0 ? by_exponent * dy : 0.0);
+        }
+        result.value = power;
+    }
+
+    // Applies function f to count arguments. The value is f's own.
+    static void call(const Function_registry::function &f, const Dual *x, size_t count,
+                     Dual &result) {
+        thread_local std::vector<double> values;
+        values.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = x[i].value;
+        }
+        double value = f.apply(values.data(), count);
+        const std::string &name = f.name;
+        if (name == "min" or name == "max") {
+            // The argument chosen, as min_of and max_of choose it.
+            size_t chosen{0};
+            for (size_t i = 1; i < count; ++i) {
+                bool keep = name == "min" ? values[chosen] < values[i] : values[chosen] > values[i];
+                chosen = keep ? chosen : i;
+            }
+            result.gradient = x[chosen].gradient;
+            result.value = value;
+            return;
+        }
+        if (count == 1 and is_builtin(name)) {
+            double u = x[0].value;
+            double slope{0.0};
+            if (name == "sqrt") {
+                slope = 0.5 / value;
+            } else if (name == "abs") {
+                slope = u > 0.0 ? 1.0 : u < 0.0 ? -1.0 : 0.0;
+            } else if (name == "exp") {
+                slope = value;
+            } else if (name == "log") {
+                slope = 1.0 / u;
+            } else if (name == "sin") {
+                slope = std::cos(u);
+            } else if (name == "cos") {
+                slope = -std::sin(u);
+            } else if (name == "tan") {
+                slope = 1.0 + value * value;
+            }
+            scale(x[0], slope, result);
+            result.value = value;
+            return;
+        }
+        // A central difference by each argument, of a step that balances rounding and truncation.
+        std::array<double, N> gradient{};
+        const double relative_step = std::cbrt(std::numeric_limits<double>::epsilon());
+        for (size_t i = 0; i < count; ++i) {
+            double u = values[i];
+            double step = relative_step * std::max(1.0, std::fabs(u));
+            values[i] = u + step;
+            double above = f.apply(values.data(), count);
+            values[i] = u - step;
+            double below = f.apply(values.data(), count);
+            values[i] = u;
+            double slope = (above - below) / (2.0 * step);
+            for (size_t k = 0; k < N; ++k) {
+                gradient[k] += x[i].gradient[k] != 0.0 ? slope * x[i].gradient[k] : 0.0;
+            }
+        }
+        result.gradient = gradient;
+        result.value = value;
+    }
+
+private:
+    static bool is_builtin(const std::string &name) {
+        for (const char *builtin : {"sqrt", "abs", "floor", "ceil", "exp", "log", "sin", "cos",
+                                    "tan"}) {
+            if (name == builtin) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void scale(const Dual &x, double slope, Dual &result) {
+        for (size_t k = 0; k < N; ++k) {
+            result.gradient[k] = x.gradient[k] != 0.0 ? slope * x.gradient[k] : 0.0;
+        }
+    }
+};
+
+#endif //INC_9_CALCULATOR_DUAL_NUMBER_H
@@ -0,0 +1,368 @@
+//
+// exp, log, sin, cos, tan and pow, written so that a loop over columns of them can be packed.
+//
+
+#ifndef INC_9_CALCULATOR_ELEMENTARY_FUNCTIONS_H
+#define INC_9_CALCULATOR_ELEMENTARY_FUNCTIONS_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+/*
+ * The methods are those of fdlibm, with errors under one ulp, written without branches or tables
+ * so that the compiler can run a loop of them in vector registers. Each *_or_nan function
+ * computes its function over the arguments where that is simple: finite, normal arguments whose
+ * results are normal, and for sin, cos and tan arguments under 2^20 that do not cancel against
+ * a multiple of π/2. Elsewhere it gives NaN, and the public functions ask the C library instead,
+ * as the batch kernels do for the rows where a packed loop gave NaN. A scalar call and a packed
+ * loop therefore agree bit for bit, provided the compiler does not contract a multiply and an add
+ * into one fused step, which is why the library is built with -ffp-contract=off.
+ *
+ * Only the batch kernels use these functions. Every engine that evaluates one row at a time calls
+ * the C library, so a batch result may differ from a single evaluation by an ulp. An integral
+ * power that is exactly representable, e.g. 3^3, is exact, and x^2 is x*x.
+ */
+class Elementary_functions {
+
+public:
+    static double exp(double x) {
+        double result = exp_or_nan(x);
+        return result == result ? result : std::exp(x);
+    }
+
+    static double log(double x) {
+        double result = log_or_nan(x);
+        return result == result ? result : std::log(x);
+    }
+
+    static double sin(double x) {
+        double result = sin_or_nan(x);
+        return result == result ? result : std::sin(x);
+    }
+
+    static double cos(double x) {
+        double result = cos_or_nan(x);
+        return result == result ? result : std::cos(x);
+    }
+
+    static double tan(double x) {
+        double result = tan_or_nan(x);
+        return result == result ? result : std::tan(x);
+    }
+
+    static double pow(double x, double y) {
+        double result = pow_or_nan(x, y);
+        return result == result ? result : std::pow(x, y);
+    }
+
+    // e^x, where |x| < 708 so that the result is normal.
+    static double exp_or_nan(double x) {
+        const double ln2_high = 6.93147180369123816490e-01;
+        const double ln2_low = 1.90821492927058770002e-10;
+        const double inverse_ln2 = 1.44269504088896338700e+00;
+        const double P1 = 1.66666666666666019037e-01;
+        const double P2 = -2.77777777770155933842e-03;
+        const double P3 = 6.61375632143793436117e-05;
+        const double P4 = -1.65339022054652515390e-06;
+        const double P5 = 4.13813679705723846039e-08;
+        // x = k ln2 + r, |r| <= ln2 / 2, where ln2_high has the zeros for k ln2_high to be exact.
+        double k = nearest(x * inverse_ln2);
+        double high = x - k * ln2_high;
+        double low = k * ln2_low;
+        double r = high - low;
+        double t = r * r;
+        double c = r - t * (P1 + t * (P2 + t * (P3 + t * (P4 + t * P5))));
+        double y = 1.0 - ((low - (r * c) / (2.0 - c)) - high);
+        double result = y * power_of_two(k);
+        return std::fabs(x) < 708.0 ? result : not_a_number();
+    }
+
+    // ln x, where x is positive, finite and normal.
+    static double log_or_nan(double x) {
+        const double ln2_high = 6.93147180369123816490e-01;
+        const double ln2_low = 1.90821492927058770002e-10;
+        const double Lg1 = 6.666666666666735130e-01;
+        const double Lg2 = 3.999999999940941908e-01;
+        const double Lg3 = 2.857142874366239149e-01;
+        const double Lg4 = 2.222219843214978396e-01;
+        const double Lg5 = 1.818357216161805012e-01;
+        const double Lg6 = 1.531383769920937332e-01;
+        const double Lg7 = 1.479819860511658591e-01;
+        // x = 2^k (1 + f), where sqrt(2)/2 < 1 + f < sqrt(2).
+        uint64_t word = bits(x);
+        int64_t high = int64_t(word >> 32);
+        int64_t k = (high >> 20) - 1023;
+        high &= 0x000fffff;
+        int64_t i = (high + 0x95f64) & 0x100000;
+        double f = from_bits(uint64_t(high | (i ^ 0x3ff00000)) << 32 | (word & 0xffffffffu)) - 1.0;
+        double dk = to_double(k + (i >> 20));
+        double s = f / (2.0 + f);
+        double z = s * s;
+        double w = z * z;
+        double t1 = w * (Lg2 + w * (Lg4 + w * Lg6));
+        double t2 = z * (Lg1 + w * (Lg3 + w * (Lg5 + w * Lg7)));
+        double R = t2 + t1;
+        double half_square = 0.5 * f * f;
+        double wide = dk * ln2_high - ((half_square - (s * (half_square + R) + dk * ln2_low)) - f);
+        double narrow = dk * ln2_high - ((s * (f - R) - dk * ln2_low) - f);
+        double result = to_double((high - 0x6147a) | (0x6b851 - high)) > 0.0 ? wide : narrow;
+        return x >= std::numeric_limits<double>::min() and x <= std::numeric_limits<double>::max()
+               ? result : not_a_number();
+    }
+
+    static double sin_or_nan(double x) {
+        reduced r = reduce(x);
+        double sine = sin_kernel(r.high, r.low);
+        double cosine = cos_kernel(r.high, r.low);
+        return r.quadrant == 0.0 ? sine : r.quadrant == 1.0 ? cosine
+                                        : r.quadrant == 2.0 ? -sine : -cosine;
+    }
+
+    static double cos_or_nan(double x) {
+        reduced r = reduce(x);
+        double sine = sin_kernel(r.high, r.low);
+        double cosine = cos_kernel(r.high, r.low);
+        return r.quadrant == 0.0 ? cosine : r.quadrant == 1.0 ? -sine
+                                          : r.quadrant == 2.0 ? -cosine : sine;
+    }
+
+    static double tan_or_nan(double x) {
+        reduced r = reduce(x);
+        double half = 0.5 * r.quadrant;
+        return tan_kernel(r.high, r.low, nearest(half) == half ? 1.0 : -1.0);
+    }
+
+    /*
+     * x^y, where |x| is finite and normal, x is positive or y is an integer, |y| < 2^31 and the
+     * result is normal. log2 |x| is found to about 2^-64 as the sum of two doubles, multiplied by y
+     * as two, and raised to a power of two.
+     */
+    static double pow_or_nan(double x, double y) {
+        const double dp_h1 = 5.84962487220764160156e-01;    // log2(1.5), high and low.
+        const double dp_l1 = 1.35003920212974897128e-08;
+        const double L1 = 5.99999999999994648725e-01;
+        const double L2 = 4.28571428578550184252e-01;
+        const double L3 = 3.33333329818377432918e-01;
+        const double L4 = 2.72728123808534006489e-01;
+        const double L5 = 2.30660745775561754067e-01;
+        const double L6 = 2.06975017800338417784e-01;
+        const double P1 = 1.66666666666666019037e-01;
+        const double P2 = -2.77777777770155933842e-03;
+        const double P3 = 6.61375632143793436117e-05;
+        const double P4 = -1.65339022054652515390e-06;
+        const double P5 = 4.13813679705723846039e-08;
+        const double lg2 = 6.93147180559945286227e-01;
+        const double lg2_h = 6.93147182464599609375e-01;
+        const double lg2_l = -1.90465429995776804525e-09;
+        const double cp = 9.61796693925975554329e-01;       // 2 / (3 ln 2), whole, high and low.
+        const double cp_h = 9.61796700954437255859e-01;
+        const double cp_l = -7.02846165095275826516e-09;
+        double ax = std::fabs(x);
+        // |x| = 2^n a, where a is in [sqrt(3)/2, sqrt(3)), about b: 1 below sqrt(3/2), 1.5 above.
+        uint64_t word = bits(ax);
+        double fraction = to_double(int64_t((word >> 32) & 0x000fffff));
+        bool above = fraction >= 0xbb67a;
+        bool middle = fraction > 0x3988e and not above;
+        double dn = to_double(int64_t(word >> 52) - 0x3ff) + (above ? 1.0 : 0.0);
+        double a = from_bits((word & 0x000fffffffffffffu) | 0x3ff0000000000000u);
+        a = above ? 0.5 * a : a;
+        double b = middle ? 1.5 : 1.0;
+        double dp_h = middle ? dp_h1 : 0.0;
+        double dp_l = middle ? dp_l1 : 0.0;
+        // s = s_h + s_l = (a - b) / (a + b)
+        double u = a - b;
+        double v = 1.0 / (a + b);
+        double ss = u * v;
+        double s_h = high_half(ss);
+        double t_h = high_half(a + b);
+        double t_l = a - (t_h - b);
+        double s_l = v * ((u - s_h * t_h) - s_h * t_l);
+        // log2(a) = 2/(3 ln 2) (s + ...) + log2(b)
+        double s2 = ss * ss;
+        double r = s2 * s2 * (L1 + s2 * (L2 + s2 * (L3 + s2 * (L4 + s2 * (L5 + s2 * L6)))));
+        r += s_l * (s_h + ss);
+        s2 = s_h * s_h;
+        t_h = high_half(3.0 + s2 + r);
+        t_l = r - ((t_h - 3.0) - s2);
+        u = s_h * t_h;
+        v = s_l * t_h + t_l * ss;
+        double p_h = high_half(u + v);
+        double p_l = v - (p_h - u);
+        double z_h = cp_h * p_h;
+        double z_l = cp_l * p_h + p_l * cp + dp_l;
+        double t1 = high_half(((z_h + z_l) + dp_h) + dn);
+        double t2 = z_l - (((t1 - dn) - dp_h) - z_h);
+        // y log2|x| = p_h + p_l
+        double y1 = high_half(y);
+        p_l = (y - y1) * t1 + y * t2;
+        p_h = y1 * t1;
+        double z = p_l + p_h;
+        // 2^(p_h + p_l) = 2^m 2^(p_h - m + p_l)
+        double m = nearest(z);
+        p_h -= m;
+        double t = high_half(p_l + p_h);
+        u = t * lg2_h;
+        v = (p_l - (t - p_h)) * lg2 + t * lg2_l;
+        z = u + v;
+        double w = v - (z - u);
+        t = z * z;
+        t1 = z - t * (P1 + t * (P2 + t * (P3 + t * (P4 + t * P5))));
+        r = (z * t1) / (t1 - 2.0) - (w + z * w);
+        double result = (1.0 - (r - z)) * power_of_two(m);
+        // Odd integral powers of a negative base are negative, and powers that are not integral
+        // are left to the library.
+        double half = 0.5 * y;
+        double negative = nearest(half) == half ? result : -result;
+        negative = nearest(y) == y ? negative : not_a_number();
+        result = x < 0.0 ? negative : result;
+        result = ax >= std::numeric_limits<double>::min() ? result : not_a_number();
+        result = ax <= std::numeric_limits<double>::max() ? result : not_a_number();
+        result = std::fabs(y) < 0x1p31 ? result : not_a_number();
+        result = m > -1021.0 ? result : not_a_number();
+        result = m < 1023.0 ? result : not_a_number();
+        return y == 2.0 ? x * x : result;
+    }
+
+private:
+    // x = quadrant π/2 + high + low, where quadrant is taken modulo 4, and high is NaN where the
+    // reduction is not exact enough.
+    struct reduced {
+        double high;
+        double low;
+        double quadrant;
+    };
+
+    static uint64_t bits(double x) {
+        uint64_t word;
+        std::memcpy(&word, &x, sizeof(word));
+        return word;
+    }
+
+    static double from_bits(uint64_t word) {
+        double x;
+        std::memcpy(&x, &word, sizeof(x));
+        return x;
+    }
+
+    static double not_a_number() {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    // x with the low 32 bits of its significand cleared, so that products of two are exact.
+    static double high_half(double x) {
+        return from_bits(bits(x) & 0xffffffff00000000u);
+    }
+
+    // x to the nearest integer, ties to even, for |x| < 2^51. The vector units have no conversion.
+    static double nearest(double x) {
+        return (x + 0x1.8p52) - 0x1.8p52;
+    }
+
+    // An integer of magnitude under 2^51 as a double.
+    static double to_double(int64_t n) {
+        return from_bits(bits(0x1.8p52) + uint64_t(n)) - 0x1.8p52;
+    }
+
+    // 2^k for an integer k from -1022 to 1023.
+    static double power_of_two(double k) {
+        return from_bits((bits(k + 0x1.8p52) + 1023) << 52);
+    }
+
+    /*
+     * x less the nearest multiple of π/2, by three pieces of π/2 of which the first two have
+     * products with the multiple that are exact below 2^20. Where the result is under 2^-49 of x,
+     * e.g.; near 2^19 π/2, it is not exact enough.
+     */
+    static reduced reduce(double x) {
+        const double two_over_pi = 6.36619772367581382433e-01;
+        const double pio2_1 = 1.57079632673412561417e+00;
+        const double pio2_2 = 6.07710050630396597660e-11;
+        const double pio2_2t = 2.02226624879595063154e-21;
+        double shifted = x * two_over_pi + 0x1.8p52;
+        double n = shifted - 0x1.8p52;
+        double t = x - n * pio2_1;
+        double w = n * pio2_2;
+        double r = t - w;
+        w = n * pio2_2t - ((t - r) - w);
+        double high = r - w;
+        double low = (r - high) - w;
+        double scale = from_bits(bits(x) & 0x7ff0000000000000u);
+        high = std::fabs(x) < 0x1p20 ? high : not_a_number();
+        high = std::fabs(high) >= scale * 0x1p-49 ? high : not_a_number();
+        return {high, low, to_double(int64_t(bits(shifted) & 3))};
+    }
+
+    // sin(x + y) for |x| <= π/4, where y is the tail of x.
+    static double sin_kernel(double x, double y) {
+        const double S1 = -1.66666666666666324348e-01;
+        const double S2 = 8.33333333332248946124e-03;
+        const double S3 = -1.98412698298579493134e-04;
+        const double S4 = 2.75573137070700676789e-06;
+        const double S5 = -2.50507602534068634195e-08;
+        const double S6 = 1.58969099521155010221e-10;
+        double z = x * x;
+        double w = z * z;
+        double r = S2 + z * (S3 + z * S4) + z * w * (S5 + z * S6);
+        double v = z * x;
+        return x - ((z * (0.5 * y - v * r) - y) - v * S1);
+    }
+
+    static double cos_kernel(double x, double y) {
+        const double C1 = 4.16666666666666019037e-02;
+        const double C2 = -1.38888888888741095749e-03;
+        const double C3 = 2.48015872894767294178e-05;
+        const double C4 = -2.75573143513906633035e-07;
+        const double C5 = 2.08757232129817482790e-09;
+        const double C6 = -1.13596475577881948265e-11;
+        double z = x * x;
+        double w = z * z;
+        double r = z * (C1 + z * (C2 + z * C3)) + w * w * (C4 + z * (C5 + z * C6));
+        double half = 0.5 * z;
+        w = 1.0 - half;
+        return w + (((1.0 - w) - half) + (z * r - x * y));
+    }
+
+    // tan(x + y) for |x| <= π/4 when sign is 1, or -1/tan(x + y) when it is -1.
+    static double tan_kernel(double x, double y, double sign) {
+        const double T[] = {
+                3.33333333333334091986e-01, 1.33333333333201242699e-01,
+                5.39682539762260521377e-02, 2.18694882948595424599e-02,
+                8.86323982359930005737e-03, 3.59207910759131235356e-03,
+                1.45620945432529025516e-03, 5.88041240820264096874e-04,
+                2.46463134818469906812e-04, 7.81794442939557092300e-05,
+                7.14072491382608190305e-05, -1.85586374855275456654e-05,
+                2.59073051863633712884e-05,
+        };
+        const double pio4 = 7.85398163397448278999e-01;
+        const double pio4lo = 3.06161699786838301793e-17;
+        // Above 0.6744, tan(x) is found from tan(π/4 - |x|).
+        bool negative = x < 0.0;
+        bool large = std::fabs(x) >= 0x1.59428p-1;
+        double ax = negative ? -x : x;
+        double ay = negative ? -y : y;
+        x = large ? (pio4 - ax) + (pio4lo - ay) : x;
+        y = large ? 0.0 : y;
+        double z = x * x;
+        double w = z * z;
+        double r = T[1] + w * (T[3] + w * (T[5] + w * (T[7] + w * (T[9] + w * T[11]))));
+        double v = z * (T[2] + w * (T[4] + w * (T[6] + w * (T[8] + w * (T[10] + w * T[12])))));
+        double s = z * x;
+        r = y + z * (s * (r + v) + y);
+        r += T[0] * s;
+        w = x + r;
+        double folded = (negative ? -1.0 : 1.0) * (sign - 2.0 * (x - (w * w / (w + sign) - r)));
+        // -1/w, accurately, from the high halves of w and of its reciprocal.
+        double w_h = high_half(w);
+        v = r - (w_h - x);
+        double a = -1.0 / w;
+        double a_h = high_half(a);
+        double reciprocal = a_h + a * ((1.0 + a_h * w_h) + a_h * v);
+        // Below 2^-28, tan(x) rounds to x, of the same sign even where x is zero.
+        w = std::fabs(x) < 0x1p-28 ? x : w;
+        return large ? folded : sign > 0.0 ? w : reciprocal;
+    }
+};
+
+#endif //INC_9_CALCULATOR_ELEMENTARY_FUNCTIONS_H
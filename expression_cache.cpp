@@ -0,0 +1,88 @@
+//
+// A bounded, thread-safe cache of compiled expressions.
+//
+
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "expression_cache.h"
+
+using std::string;
+using std::string_view;
+using std::shared_ptr;
+using std::lock_guard;
+using std::mutex;
+
+/*
+ * Equations are keyed on their canonical form, so "5÷2×3" and "5 / 2 * 3" share one entry. Each
+ * entry holds the compiled program and, for equations the optimizer folded to one constant, the
+ * final result. An equation without variables that calls an impure function is not folded, and is
+ * evaluated on every hit. A miss
+ * compiles without holding the shard lock; if another thread inserted the same key meanwhile, its
+ * entry is kept and returned.
+ */
+Expression_cache::entry::entry(const string &canonical)
+        : compiled(canonical),
+          constant(compiled.valid() and compiled.instructions().size() == 1 and
+                   compiled.instructions()[0].type == Infix_lexer::number),
+          result(constant ? compiled.evaluate() : std::numeric_limits<double>::quiet_NaN()) {}
+
+/*
+ * A cache smaller than max_shards takes a shard per entry. The capacity is shared out so that the
+ * shards add up to it exactly, the first ones taking one more where it does not divide evenly.
+ */
+Expression_cache::Expression_cache(size_t capacity) {
+    capacity = std::max<size_t>(capacity, 1);
+    size_t count = std::min(capacity, max_shards);
+    for (size_t i = 0; i < count; ++i) {
+        shards.emplace_back(new shard);
+        shards.back()->capacity = capacity / count + (i < capacity % count);
+    }
+}
+
+Expression_cache::statistics Expression_cache::counters() const {
+    return {hits, misses, evictions};
+}
+
+shared_ptr<const Expression_cache::entry>
+Expression_cache::compile(string_view equation, Infix_lexer::error_kind &error,
+                          size_t &error_offset) {
+    thread_local std::vector<Infix_lexer::token> tokens;
+    Infix_lexer lexer{equation};
+    error = lexer.scan(tokens);
+    error_offset = lexer.error_offset();
+    if (error not_eq Infix_lexer::none) {
+        return nullptr;
+    }
+    string key = Infix_lexer::format(tokens);
+    auto &cached = *shards[std::hash<string>{}(key) % shards.size()];
+    {
+        lock_guard<mutex> guard{cached.lock};
+        auto found = cached.index.find(key);
+        if (found != cached.index.end()) {
+            cached.recent.splice(cached.recent.begin(), cached.recent, found->second);
+            ++hits;
+            return found->second->second;
+        }
+    }
+    ++misses;
+    shared_ptr<const entry> compiled = std::make_shared<const entry>(key);
+    lock_guard<mutex> guard{cached.lock};
+    auto found = cached.index.find(key);
+    if (found != cached.index.end()) {
+        return found->second->second;
+    }
+    cached.recent.emplace_front(key, compiled);
+    cached.index.emplace(std::move(key), cached.recent.begin());
+    if (cached.index.size() > cached.capacity) {
+        cached.index.erase(cached.recent.back().first);
+        cached.recent.pop_back();
+        ++evictions;
+    }
+    return compiled;
+}
@@ -0,0 +1,67 @@
+//
+// A bounded, thread-safe cache of compiled expressions.
+//
+
+#ifndef INC_9_CALCULATOR_EXPRESSION_CACHE_H
+#define INC_9_CALCULATOR_EXPRESSION_CACHE_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "infix_lexer.h"
+#include "compiled_expression.h"
+
+class Expression_cache {
+
+public:
+    struct entry {
+        explicit entry(const std::string &canonical);
+        Compiled_expression compiled;
+        bool constant;         // The program is one constant, so result holds its value.
+        double result;
+    };
+
+    struct statistics {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+    };
+
+    /*
+     * Holds up to capacity entries, least recently used first out. Each shard evicts on its own,
+     * so an entry can leave while the cache as a whole has room.
+     */
+    explicit Expression_cache(size_t capacity);
+
+    /*
+     * Returns the entry for the canonical form of an equation, compiling it on a miss. Equations
+     * that do not scan are not cached: nullptr is returned with error and error_offset set.
+     */
+    std::shared_ptr<const entry> compile(std::string_view equation,
+                                         Infix_lexer::error_kind &error, size_t &error_offset);
+
+    statistics counters() const;
+
+private:
+    // The cache is split by key hash so that threads rarely wait on each other.
+    struct shard {
+        std::mutex lock;
+        std::list<std::pair<std::string, std::shared_ptr<const entry>>> recent;
+        std::unordered_map<std::string, decltype(recent)::iterator> index;
+        size_t capacity;
+    };
+    static constexpr size_t max_shards{16};
+    std::vector<std::unique_ptr<shard>> shards;
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> evictions{0};
+};
+
+#endif //INC_9_CALCULATOR_EXPRESSION_CACHE_H
@@ -0,0 +1,405 @@
+//
+// Differential testing of the evaluation engines on random equations.
+//
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+#include "calculator.h"
+#include "calculator_api.h"
+#include "compiled_expression.h"
+#include "constexpr_calculator.h"
+#include "expression_fuzzer.h"
+#include "function_registry.h"
+#include "incremental_expression.h"
+#include "native_expression.h"
+#include "numeric_expression.h"
+#include "program_catalog.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const char *const operators[] = {"+", "-", "*", "/", "^", "−", "×", "÷"};
+const char *const signs[] = {"-", "+", "−"};
+const char *const names[] = {"x", "y", "rate", "principal_2"};
+const double values[] = {2.0, -3.5, 0.25, 100.0};
+const char *const unary[] = {"sqrt", "abs", "floor", "ceil", "exp", "log", "sin", "cos", "tan"};
+
+// Bytes that damage an equation: stray operators and punctuation, an unknown glyph, a lone UTF-8
+// lead byte and a continuation byte.
+const char *const damage[] = {"(", ")", "+", "-", "*", "/", "^", ",", ".", "$", "#", "q", "_", "7",
+                              " ", "−", "×", "€", "\xE2", "\x88", "foo(", "sqrt(1, ", "max()"};
+
+struct outcome {
+    double value;
+    Infix_lexer::error_kind error;
+    size_t offset;
+};
+
+// Bit for bit, except that every NaN is alike.
+bool same(double a, double b) {
+    return (a == b and std::signbit(a) == std::signbit(b)) or (std::isnan(a) and std::isnan(b));
+}
+
+bool close(double a, double b) {
+    return same(a, b) or std::fabs(a - b) <= 1e-12 * std::max(std::fabs(a), std::fabs(b));
+}
+
+// Whether batch evaluation runs the equation through a packed exp, log, sin, cos, tan or ^.
+bool packs(const Compiled_expression &compiled) {
+    for (auto &i : compiled.instructions()) {
+        if (i.type == Infix_lexer::function_name) {
+            auto &name = Function_registry::at(i.index).name;
+            if (name == "exp" or name == "log" or name == "sin" or name == "cos" or name == "tan") {
+                return true;
+            }
+        } else if (i.type == Infix_lexer::arithmetic_operator and i.operator_ == '^') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Tells apart the files of fuzzers running side by side.
+string process_name() {
+#if defined(__unix__) || defined(__APPLE__)
+    return std::to_string(getpid());
+#else
+    return std::to_string(std::random_device{}());
+#endif
+}
+
+string describe(const outcome &o) {
+    return std::to_string(o.value) + " (" + Infix_lexer::describe(o.error) + " at " +
+           std::to_string(o.offset) + ")";
+}
+
+} // namespace
+
+Expression_fuzzer::Expression_fuzzer(uint64_t seed) : random(seed) {}
+
+size_t Expression_fuzzer::below(size_t n) {
+    return std::uniform_int_distribution<size_t>(0, n - 1)(random);
+}
+
+bool Expression_fuzzer::chance(double p) {
+    return std::uniform_real_distribution<double>(0.0, 1.0)(random) < p;
+}
+
+void Expression_fuzzer::spaces(string &out) {
+    out.append(chance(0.4) ? below(3) : 0, ' ');
+}
+
+/*
+ * A number, with or without a sign, integer part or fraction and of up to twenty digits, a
+ * variable, a parenthesized expression or a function call, the last three perhaps signed too.
+ */
+void Expression_fuzzer::operand(string &out, size_t terms, size_t depth) {
+    size_t kind = below(10);
+    if (depth < 4 and terms > 1 and kind < 2) {
+        if (chance(0.2)) {
+            out += signs[below(std::size(signs))];
+        }
+        out += '(';
+        spaces(out);
+        expression(out, terms - 1, depth + 1);
+        spaces(out);
+        out += ')';
+    } else if (depth < 4 and kind < 4) {
+        bool fold = chance(0.3);
+        if (chance(0.2)) {
+            out += signs[below(std::size(signs))];
+        }
+        out += fold ? (chance(0.5) ? "min" : "max") : unary[below(std::size(unary))];
+        spaces(out);
+        out += '(';
+        size_t arguments = fold ? 1 + below(3) : 1;
+        for (size_t i = 0; i < arguments; ++i) {
+            if (i) {
+                out += ',';
+                spaces(out);
+            }
+            expression(out, std::max<size_t>(1, terms / 2), depth + 1);
+        }
+        out += ')';
+    } else if (kind < 7) {
+        if (chance(0.2)) {
+            out += signs[below(std::size(signs))];
+        }
+        switch (below(5)) {
+            case 0 : out += std::to_string(below(10)); break;
+            case 1 : out += std::to_string(below(1000)); break;
+            case 2 : out += std::to_string(below(100)) + '.' + std::to_string(below(1000)); break;
+            case 3 : out += '.' + std::to_string(1 + below(99)); break;
+            default : {
+                size_t digits = 10 + below(11);
+                for (size_t i = 0; i < digits; ++i) {
+                    out += char('0' + below(10));
+                }
+                out.insert(out.size() - below(digits), 1, '.');
+                break;
+            }
+        }
+    } else {
+        if (chance(0.2)) {
+            out += signs[below(std::size(signs))];
+        }
+        out += names[below(std::size(names))];
+    }
+}
+
+void Expression_fuzzer::expression(string &out, size_t terms, size_t depth) {
+    size_t operands = 1 + below(std::min<size_t>(std::max<size_t>(terms, 1), 4));
+    for (size_t i = 0; i < operands; ++i) {
+        if (i) {
+            spaces(out);
+            out += operators[below(std::size(operators))];
+            spaces(out);
+        }
+        operand(out, std::max<size_t>(1, terms / operands), depth);
+    }
+}
+
+string Expression_fuzzer::well_formed(size_t terms) {
+    string out;
+    spaces(out);
+    expression(out, terms, 0);
+    spaces(out);
+    return out;
+}
+
+string Expression_fuzzer::malformed(size_t terms) {
+    string out = well_formed(terms);
+    size_t at = below(out.size() + 1);
+    switch (below(6)) {
+        case 0 : out.insert(at, damage[below(std::size(damage))]); break;
+        case 1 : out.erase(std::min(at, out.size() - 1), 1); break;
+        case 2 : out.insert(at, out.substr(at, 1 + below(3))); break;
+        case 3 : {
+            if (at + 1 < out.size()) {
+                std::swap(out[at], out[at + 1]);
+            }
+            break;
+        }
+        case 4 : out.resize(at); break;
+        default : {
+            // One byte of a glyph alone, which is invalid UTF-8.
+            out.insert(at, 1, "\xE2\x88\x92\xC3\x97"[below(5)]);
+            break;
+        }
+    }
+    return out;
+}
+
+string Expression_fuzzer::nested(size_t depth) {
+    string out;
+    for (size_t i = 0; i < depth; ++i) {
+        operand(out, 1, 0);
+        spaces(out);
+        out += operators[below(std::size(operators))];
+        spaces(out);
+        if (chance(0.3)) {
+            out += unary[below(std::size(unary))];
+        }
+        out += '(';
+    }
+    operand(out, 1, 0);
+    out.append(depth, ')');
+    return out;
+}
+
+bool Expression_fuzzer::report::passed() const {
+    for (auto &e : engines) {
+        if (e.mismatches) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Each engine solves the whole list in one timed pass, and the outcomes are compared afterwards,
+ * so the comparison does not count against any engine's time. Variables take their values by
+ * name, and names the generator did not write, made by damage, take 1.5.
+ */
+Expression_fuzzer::report Expression_fuzzer::run(size_t count) {
+    vector<string> equations;
+    for (size_t i = 0; i < count; ++i) {
+        size_t terms = 1 + below(12);
+        if (chance(0.05)) {
+            // Either side of the 32 values Compiled_expression::evaluate keeps on its own stack.
+            equations.push_back(nested(24 + below(17)));
+        } else {
+            equations.push_back(chance(0.25) ? malformed(terms) : well_formed(terms));
+        }
+    }
+    auto bind = [](const vector<string> &variables) {
+        vector<double> bound;
+        for (auto &name : variables) {
+            auto found = std::find(std::begin(names), std::end(names), name);
+            bound.push_back(found == std::end(names) ? 1.5 : values[found - std::begin(names)]);
+        }
+        return bound;
+    };
+    vector<bool> packed;
+    // The catalog is saved before the timed pass, which measures opening and loading it.
+    auto catalog_path = (std::filesystem::temp_directory_path() /
+                         ("calculator_fuzz." + process_name() + ".catalog")).string();
+    {
+        vector<Compiled_expression> compiled;
+        for (auto &equation : equations) {
+            compiled.emplace_back(equation);
+            packed.push_back(packs(compiled.back()));
+        }
+        Program_catalog::save(catalog_path, equations, compiled);
+    }
+    typedef std::function<bool(size_t, outcome &)> solver;
+    auto from = [&bind, &equations](auto evaluate) {
+        return [&bind, &equations, evaluate](size_t i, outcome &result) {
+            Compiled_expression compiled{equations[i]};
+            auto bound = bind(compiled.variables());
+            result = {evaluate(compiled, bound), compiled.error(), compiled.error_offset()};
+            return true;
+        };
+    };
+    Program_catalog catalog;
+    vector<std::pair<string, solver>> engines = {
+            {"compute", [&](size_t i, outcome &result) {
+                Infix_calculator c{equations[i]};
+                auto bound = bind(c.variables());
+                auto solved = c.bind(bound.data()).solve();
+                result = {solved.value, solved.error, solved.offset};
+                return true;
+            }},
+            {"compiled", from([](Compiled_expression &compiled, vector<double> &bound) {
+                return compiled.evaluate(bound.data());
+            })},
+            {"native", from([](Compiled_expression &compiled, vector<double> &bound) {
+                return Native_expression{compiled}.evaluate(bound.data());
+            })},
+            {"batch", from([](Compiled_expression &compiled, vector<double> &bound) {
+                vector<const double *> columns;
+                for (auto &value : bound) {
+                    columns.push_back(&value);
+                }
+                double result;
+                compiled.evaluate_batch(columns.data(), 1, &result);
+                return result;
+            })},
+            {"incremental", from([](Compiled_expression &compiled, vector<double> &bound) {
+                return Incremental_expression{compiled}.evaluate(bound.data());
+            })},
+            {"numeric", [&](size_t i, outcome &result) {
+                Numeric_expression<double> numeric{equations[i]};
+                auto bound = bind(numeric.variables());
+                result = {numeric.evaluate(bound.data()).value, numeric.error(),
+                          numeric.error_offset()};
+                result.value = numeric.valid() ? result.value : std::nan("");
+                return true;
+            }},
+            {"catalog", [&](size_t i, outcome &result) {
+                if (i == 0 and not catalog.open(catalog_path)) {
+                    return false;
+                }
+                Compiled_expression loaded = catalog.expression(i);
+                auto bound = bind(loaded.variables());
+                result = {loaded.evaluate(bound.data()), loaded.error(), loaded.error_offset()};
+                return true;
+            }},
+            {"c_api", [&](size_t i, outcome &result) {
+                auto &equation = equations[i];
+                auto *compiled = calculator_compile(equation.data(), equation.size(), nullptr, 0);
+                vector<string> variables;
+                for (size_t v = 0; v < calculator_variable_count(compiled); ++v) {
+                    variables.emplace_back(calculator_variable(compiled, v));
+                }
+                auto bound = bind(variables);
+                result.value = calculator_evaluate(compiled, bound.data());
+                result.error = Infix_lexer::error_kind(calculator_compile_error(compiled,
+                                                                                &result.offset));
+                calculator_free(compiled);
+                return true;
+            }},
+            {"constexpr", [&](size_t i, outcome &result) {
+                // A separate parser without variables or functions, for equations of no names.
+                auto &equation = equations[i];
+                for (char c : equation) {
+                    if (std::isalpha(static_cast<unsigned char>(c)) or c == '_') {
+                        return false;
+                    }
+                }
+                if (equation.size() >= 256) {
+                    return false;
+                }
+                auto solved = Constexpr_calculator::solve<256>(equation);
+                result = {solved.value, solved.error, solved.offset};
+                return true;
+            }},
+    };
+    report results{count, 0, {}, {}};
+    vector<outcome> reference;
+    for (auto &next : engines) {
+        vector<outcome> outcomes(count);
+        vector<bool> solved(count);
+        engine timed{next.first, 0, 0, 0.0};
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; ++i) {
+            solved[i] = next.second(i, outcomes[i]);
+        }
+        timed.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                .count();
+        if (reference.empty()) {
+            reference = outcomes;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (not solved[i]) {
+                continue;
+            }
+            ++timed.solved;
+            auto &expected = reference[i];
+            auto &actual = outcomes[i];
+            bool values = next.first == "constexpr" ? close(actual.value, expected.value)
+                          : next.first == "batch" and packed[i] ? true
+                          : same(actual.value, expected.value);
+            if (actual.error not_eq expected.error or actual.offset not_eq expected.offset or
+                not values) {
+                ++timed.mismatches;
+                if (results.examples.size() < 10) {
+                    results.examples.push_back(next.first + ": \"" + equations[i] + "\" gave " +
+                                               describe(actual) + " instead of " +
+                                               describe(expected));
+                }
+            }
+        }
+        results.engines.push_back(timed);
+    }
+    for (auto &expected : reference) {
+        results.invalid += expected.error not_eq Infix_lexer::none;
+    }
+    std::remove(catalog_path.c_str());
+    return results;
+}
+
+void Expression_fuzzer::print(const report &results, FILE *out) {
+    std::fprintf(out, "Fuzzed %zu equations, %zu of them invalid.\n", results.equations,
+                 results.invalid);
+    std::fprintf(out, "%-12s %10s %11s %14s\n", "engine", "equations", "mismatches",
+                 "equations/s");
+    for (auto &e : results.engines) {
+        std::fprintf(out, "%-12s %10zu %11zu %14.0f\n", e.name.c_str(), e.solved, e.mismatches,
+                     e.seconds > 0.0 ? double(e.solved) / e.seconds : 0.0);
+    }
+    for (auto &example : results.examples) {
+        std::fprintf(out, "%s\n", example.c_str());
+    }
+}
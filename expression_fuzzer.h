@@ -0,0 +1,76 @@
+//
+// Differential testing of the evaluation engines on random equations.
+//
+
+#ifndef INC_9_CALCULATOR_EXPRESSION_FUZZER_H
+#define INC_9_CALCULATOR_EXPRESSION_FUZZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * An Expression_fuzzer writes random equations in the calculator's grammar: numbers, signs,
+ * variables, parentheses, function calls, spaces, and the Numbers and Excel glyphs −, × and ÷.
+ * Some are then damaged, by inserting, deleting, repeating or swapping bytes, so that every kind
+ * of error turns up as well.
+ *
+ * run() solves each equation with Infix_calculator::solve() as the reference and with every other
+ * engine, and counts the engines' disagreements with it: a different value, bit for bit with any
+ * NaN alike, or a different kind or offset of error. Constexpr_calculator, which is a separate
+ * parser, is held to the same errors but to values within 1e-12, since it computes powers
+ * itself, and only sees equations without names. Batch evaluation is held to the same errors,
+ * but its values only where it runs no packed exp, log, sin, cos, tan or ^. Those may each be an
+ * ulp from the C library, which an equation can magnify without bound, and are held to an ulp
+ * by Infix_calculator_testing instead. Each engine's time is taken over the whole run
+ * so that the report gives its equations per second alongside its correctness.
+ */
+class Expression_fuzzer {
+
+public:
+    explicit Expression_fuzzer(uint64_t seed);
+
+    // A random valid equation of about terms operands.
+    std::string well_formed(size_t terms);
+
+    // A random equation damaged in one place. It is usually, but not always, invalid.
+    std::string malformed(size_t terms);
+
+    // A random valid equation whose parentheses and calls nest depth deep, one inside the next.
+    std::string nested(size_t depth);
+
+    struct engine {
+        std::string name;
+        size_t solved;           // Equations given to the engine.
+        size_t mismatches;
+        double seconds;
+    };
+
+    struct report {
+        size_t equations;
+        size_t invalid;          // Equations the reference found invalid.
+        std::vector<engine> engines;
+        std::vector<std::string> examples;    // The first few mismatches, described.
+
+        bool passed() const;
+    };
+
+    // Generates count equations, a quarter of them damaged and a few deeply nested, and solves them with every engine.
+    report run(size_t count);
+
+    // A table of the engines, with their mismatches and equations per second.
+    static void print(const report &results, FILE *out);
+
+private:
+    std::mt19937_64 random;
+    size_t below(size_t n);
+    bool chance(double p);
+    void spaces(std::string &out);
+    void operand(std::string &out, size_t terms, size_t depth);
+    void expression(std::string &out, size_t terms, size_t depth);
+};
+
+#endif //INC_9_CALCULATOR_EXPRESSION_FUZZER_H
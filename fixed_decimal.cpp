@@ -0,0 +1,145 @@
+//
+// Decimal fixed-point numbers.
+//
+
+#include <cmath>
+#include <limits>
+#include "fixed_decimal.h"
+
+using std::string;
+using std::string_view;
+
+namespace {
+
+// n / d rounded to the nearest integer, halves away from zero. d is not zero.
+__int128 rounded_quotient(__int128 n, __int128 d) {
+    __int128 quotient = n / d;
+    __int128 remainder = n % d;
+    __int128 twice = remainder < 0 ? -2 * remainder : 2 * remainder;
+    if (twice >= (d < 0 ? -d : d)) {
+        quotient += (n < 0) == (d < 0) ? 1 : -1;
+    }
+    return quotient;
+}
+
+} // namespace
+
+Fixed_decimal Fixed_decimal::from_units(int64_t units) {
+    Fixed_decimal result;
+    result.value = units;
+    return result;
+}
+
+bool Fixed_decimal::fit(__int128 units, Fixed_decimal &result) {
+    if (units > std::numeric_limits<int64_t>::max() or
+        units < std::numeric_limits<int64_t>::min()) {
+        return false;
+    }
+    result.value = int64_t(units);
+    return true;
+}
+
+/*
+ * Digits past the ninth decimal place only decide the rounding of the ninth. The integer part is
+ * checked against the range as it is read, so a long run of digits cannot overflow.
+ */
+bool Fixed_decimal::parse(string_view digits, bool negative, Fixed_decimal &result) {
+    const __int128 limit = __int128(std::numeric_limits<int64_t>::max()) + 1;
+    __int128 units{0};
+    size_t i{0};
+    for (; i < digits.size() and digits[i] != '.'; ++i) {
+        units = units * 10 + (digits[i] - '0') * __int128(scale);
+        if (units > limit) {
+            return false;
+        }
+    }
+    int64_t place{scale};
+    for (i = i < digits.size() ? i + 1 : i; i < digits.size(); ++i) {
+        place /= 10;
+        if (place == 0) {
+            units += digits[i] >= '5' ? 1 : 0;
+            break;
+        }
+        units += (digits[i] - '0') * __int128(place);
+    }
+    return fit(negative ? -units : units, result);
+}
+
+bool Fixed_decimal::from_double(double value, Fixed_decimal &result) {
+    double units = std::round(value * double(scale));
+    if (not (std::fabs(units) < 9.2e18)) {
+        return false;
+    }
+    result.value = int64_t(units);
+    return true;
+}
+
+int64_t Fixed_decimal::units() const {
+    return value;
+}
+
+double Fixed_decimal::to_double() const {
+    // Correctly rounded while the count of billionths fits in a double's 53 bits.
+    return double(value) / double(scale);
+}
+
+string Fixed_decimal::to_string() const {
+    __int128 magnitude = value < 0 ? -__int128(value) : __int128(value);
+    string text = std::to_string(uint64_t(magnitude / scale));
+    auto fraction = uint64_t(magnitude % scale);
+    if (fraction) {
+        string digits = std::to_string(fraction);
+        digits.insert(0, size_t(places) - digits.size(), '0');
+        digits.erase(digits.find_last_not_of('0') + 1);
+        text += '.' + digits;
+    }
+    return value < 0 ? '-' + text : text;
+}
+
+bool Fixed_decimal::plus(Fixed_decimal x, Fixed_decimal y, Fixed_decimal &result) {
+    return fit(__int128(x.value) + y.value, result);
+}
+
+bool Fixed_decimal::minus(Fixed_decimal x, Fixed_decimal y, Fixed_decimal &result) {
+    return fit(__int128(x.value) - y.value, result);
+}
+
+bool Fixed_decimal::multiply(Fixed_decimal x, Fixed_decimal y, Fixed_decimal &result) {
+    return fit(rounded_quotient(__int128(x.value) * y.value, scale), result);
+}
+
+bool Fixed_decimal::divide(Fixed_decimal x, Fixed_decimal y, Fixed_decimal &result) {
+    if (y.value == 0) {
+        return false;
+    }
+    return fit(rounded_quotient(__int128(x.value) * scale, y.value), result);
+}
+
+/*
+ * A whole exponent is applied by repeated squaring, each product rounded to nine places, and a
+ * negative one divides the result into one. Fractional exponents have no exact decimal result in
+ * general and go through pow().
+ */
+bool Fixed_decimal::exponent(Fixed_decimal x, Fixed_decimal y, Fixed_decimal &result) {
+    if (y.value % scale) {
+        return from_double(std::pow(x.to_double(), y.to_double()), result);
+    }
+    int64_t n = y.value / scale;
+    uint64_t remaining = n < 0 ? uint64_t(-(n + 1)) + 1 : uint64_t(n);
+    Fixed_decimal power = from_units(scale);
+    Fixed_decimal base = x;
+    while (remaining) {
+        if ((remaining & 1) and not multiply(power, base, power)) {
+            return false;
+        }
+        remaining >>= 1;
+        if (remaining and not multiply(base, base, base)) {
+            return false;
+        }
+    }
+    if (n < 0) {
+        return divide(from_units(scale), power, result);
+    }
+    result = power;
+    return true;
+}
@@ -0,0 +1,65 @@
+//
+// Decimal fixed-point numbers.
+//
+
+#ifndef INC_9_CALCULATOR_FIXED_DECIMAL_H
+#define INC_9_CALCULATOR_FIXED_DECIMAL_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ * A Fixed_decimal is a count of billionths in a 64 bit integer, so it holds nine decimal places
+ * exactly and magnitudes up to about 9.2e9. Decimal fractions such as 1.1 carry no binary rounding
+ * error, and sums and differences are exact. Products and quotients are rounded to the nearest
+ * billionth, halves away from zero. Arithmetic reports a result that does not fit, or a division
+ * by zero, by returning false, rather than wrapping around.
+ */
+class Fixed_decimal {
+
+public:
+    static constexpr int places{9};
+    static constexpr int64_t scale{1000000000};
+
+    Fixed_decimal() = default;
+
+    // The number of billionths.
+    static Fixed_decimal from_units(int64_t units);
+
+    // Reads the digits of a number, without its sign, rounded to nine places. False on overflow.
+    static bool parse(std::string_view digits, bool negative, Fixed_decimal &result);
+
+    // The nearest Fixed_decimal to a double. False when it is out of range or not a number.
+    static bool from_double(double value, Fixed_decimal &result);
+
+    int64_t units() const;
+
+    double to_double() const;
+
+    // The shortest exact decimal, e.g.; "6.6" or "-0.000000001".
+    std::string to_string() const;
+
+    // Each sets result and returns true, or returns false when the result does not fit.
+    static bool plus(Fixed_decimal x, Fixed_decimal y, Fixed_decimal &result);
+    static bool minus(Fixed_decimal x, Fixed_decimal y, Fixed_decimal &result);
+    static bool multiply(Fixed_decimal x, Fixed_decimal y, Fixed_decimal &result);
+    static bool divide(Fixed_decimal x, Fixed_decimal y, Fixed_decimal &result);
+
+    // Whole exponents are applied by repeated multiplication, others through pow().
+    static bool exponent(Fixed_decimal x, Fixed_decimal y, Fixed_decimal &result);
+
+    bool operator==(Fixed_decimal other) const {
+        return value == other.value;
+    }
+
+    bool operator!=(Fixed_decimal other) const {
+        return value != other.value;
+    }
+
+private:
+    int64_t value{0};
+    static bool fit(__int128 units, Fixed_decimal &result);
+};
+
+#endif //INC_9_CALCULATOR_FIXED_DECIMAL_H
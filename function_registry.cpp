@@ -0,0 +1,166 @@
+//
+// Functions that equations can call.
+//
+
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <mutex>
+#include <vector>
+#include "function_registry.h"
+
+using std::string;
+using std::string_view;
+
+/*
+ * The functions live in a fixed array that is never reallocated, so at() needs no lock: a function
+ * is written in full before the count that makes it visible is published, and is never changed
+ * after. Only add() takes the mutex.
+ */
+namespace {
+
+// The built-ins, written to agree with their batch kernels bit for bit.
+double sqrt_of(const double *x, size_t) {
+    return std::sqrt(x[0]);
+}
+
+double abs_of(const double *x, size_t) {
+    return std::fabs(x[0]);
+}
+
+double floor_of(const double *x, size_t) {
+    return std::floor(x[0]);
+}
+
+double ceil_of(const double *x, size_t) {
+    return std::ceil(x[0]);
+}
+
+double exp_of(const double *x, size_t) {
+    return std::exp(x[0]);
+}
+
+double log_of(const double *x, size_t) {
+    return std::log(x[0]);
+}
+
+double sin_of(const double *x, size_t) {
+    return std::sin(x[0]);
+}
+
+double cos_of(const double *x, size_t) {
+    return std::cos(x[0]);
+}
+
+double tan_of(const double *x, size_t) {
+    return std::tan(x[0]);
+}
+
+// As minpd: the smaller of each pair, or the second when they are unordered.
+double min_of(const double *x, size_t count) {
+    double least = x[0];
+    for (size_t i = 1; i < count; ++i) {
+        least = least < x[i] ? least : x[i];
+    }
+    return least;
+}
+
+double max_of(const double *x, size_t count) {
+    double most = x[0];
+    for (size_t i = 1; i < count; ++i) {
+        most = most > x[i] ? most : x[i];
+    }
+    return most;
+}
+
+struct Table {
+    Function_registry::function functions[Function_registry::capacity];
+    std::atomic<size_t> size{0};
+    std::mutex adding;
+};
+
+Table &table() {
+    static Table *registry = [] {
+        auto *registry = new Table;
+        const struct {
+            const char *name;
+            size_t most;
+            Function_registry::scalar apply;
+        } builtins[] = {
+                {"sqrt", 1, sqrt_of}, {"abs", 1, abs_of}, {"floor", 1, floor_of},
+                {"ceil", 1, ceil_of}, {"exp", 1, exp_of}, {"log", 1, log_of},
+                {"sin", 1, sin_of}, {"cos", 1, cos_of}, {"tan", 1, tan_of},
+                {"min", Function_registry::most_arguments, min_of},
+                {"max", Function_registry::most_arguments, max_of},
+        };
+        size_t size{0};
+        for (auto &builtin : builtins) {
+            registry->functions[size++] = {builtin.name, 1, builtin.most, builtin.apply,
+                                           Batch_kernels::for_function(builtin.name), true};
+        }
+        registry->size.store(size, std::memory_order_release);
+        return registry;
+    }();
+    return *registry;
+}
+
+// A letter or underscore followed by letters, digits or underscores, as the lexer reads names.
+bool valid_name(const string &name) {
+    if (name.empty() or std::isdigit(static_cast<unsigned char>(name[0]))) {
+        return false;
+    }
+    for (char c : name) {
+        if (not std::isalnum(static_cast<unsigned char>(c)) and c != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+long Function_registry::find(string_view name) {
+    Table &registry = table();
+    size_t size = registry.size.load(std::memory_order_acquire);
+    for (size_t i = 0; i < size; ++i) {
+        if (registry.functions[i].name == name) {
+            return long(i);
+        }
+    }
+    return -1;
+}
+
+const Function_registry::function &Function_registry::at(size_t index) {
+    return table().functions[index];
+}
+
+long Function_registry::add(const string &name, size_t min_arguments, size_t max_arguments,
+                            scalar apply, Batch_kernels::function_kernel batch, bool pure) {
+    Table &registry = table();
+    std::lock_guard<std::mutex> lock{registry.adding};
+    size_t size = registry.size.load(std::memory_order_relaxed);
+    if (size == capacity or not valid_name(name) or find(name) >= 0 or apply == nullptr or
+        min_arguments == 0 or min_arguments > max_arguments or max_arguments > most_arguments) {
+        return -1;
+    }
+    registry.functions[size] = {name, min_arguments, max_arguments, apply, batch, pure};
+    registry.size.store(size + 1, std::memory_order_release);
+    return long(size);
+}
+
+void Function_registry::apply_batch(size_t index, const double *const *arguments, size_t count,
+                                    double *out, size_t n) {
+    const function &called = at(index);
+    if (called.batch) {
+        called.batch(arguments, count, out, n);
+        return;
+    }
+    thread_local std::vector<double> row;
+    row.resize(count);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t k = 0; k < count; ++k) {
+            row[k] = arguments[k][i];
+        }
+        out[i] = called.apply(row.data(), count);
+    }
+}
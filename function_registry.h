@@ -0,0 +1,63 @@
+//
+// Functions that equations can call.
+//
+
+#ifndef INC_9_CALCULATOR_FUNCTION_REGISTRY_H
+#define INC_9_CALCULATOR_FUNCTION_REGISTRY_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include "batch_kernels.h"
+
+/*
+ * The functions that may be called in an equation, e.g.; sqrt(x) or max(x, y, 0). The built-ins
+ * are sqrt, abs, floor, ceil, exp, log, sin, cos and tan of one argument, and min and max of one or
+ * more. Each has a batch kernel, packed where the instruction set allows, which gives the same
+ * results as the scalar function. Functions are numbered in order of registration and equations
+ * refer to them by number, so a function cannot be replaced once it is registered.
+ *
+ * A pure function gives the same result for the same arguments and does nothing else, so a call of
+ * constants may be folded when an equation is compiled. The built-ins are pure. A function added
+ * by the caller is only taken to be pure when it says so.
+ */
+class Function_registry {
+
+public:
+    // arguments[0] to arguments[count - 1], in the order written.
+    typedef double (*scalar)(const double *arguments, size_t count);
+
+    struct function {
+        std::string name;
+        size_t min_arguments;
+        size_t max_arguments;
+        scalar apply;
+        Batch_kernels::function_kernel batch;    // nullptr applies the scalar function row by row.
+        bool pure;
+    };
+
+    // The most functions, and the most arguments a call may pass.
+    static constexpr size_t capacity{256};
+    static constexpr size_t most_arguments{65535};
+
+    // The number of a function, or -1 when there is none of that name.
+    static long find(std::string_view name);
+
+    static const function &at(size_t index);
+
+    /*
+     * Registers a function of min_arguments to max_arguments arguments, at least one, and returns
+     * its number. Returns -1 when the name is taken or is not a valid name, or the registry is
+     * full. Registering while equations are scanned on other threads is safe; the new function is
+     * only visible to equations scanned after add() returns.
+     */
+    static long add(const std::string &name, size_t min_arguments, size_t max_arguments,
+                    scalar apply, Batch_kernels::function_kernel batch = nullptr,
+                    bool pure = false);
+
+    // Applies function index to n rows of argument columns with its batch kernel, or row by row.
+    static void apply_batch(size_t index, const double *const *arguments, size_t count,
+                            double *out, size_t n);
+};
+
+#endif //INC_9_CALCULATOR_FUNCTION_REGISTRY_H
@@ -0,0 +1,211 @@
+//
+// Re-evaluation of only what a change of variables touches.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include "calculator.h"
+#include "function_registry.h"
+#include "incremental_expression.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// Bit for bit, so a NaN is unchanged and -0 differs from 0.
+bool same(double a, double b) {
+    uint64_t x, y;
+    std::memcpy(&x, &a, sizeof(x));
+    std::memcpy(&y, &b, sizeof(y));
+    return x == y;
+}
+
+} // namespace
+
+/*
+ * The graph is built by running the optimized postfix program over a stack of node numbers rather
+ * than values. Each node is keyed by its kind and its operands, so a repeated subexpression finds
+ * the node made the first time. A call of a function that is not pure is keyed by its place as
+ * well, so each is a node of its own. The program is already in postfix order, so every node is
+ * numbered after its operands.
+ */
+Incremental_expression::Incremental_expression(const Compiled_expression &compiled)
+        : names(compiled.variables()), compiled_valid(compiled.valid()) {
+    variable_nodes.assign(names.size(), -1);
+    if (not compiled_valid) {
+        return;
+    }
+    std::unordered_map<string, uint32_t> known;
+    vector<uint32_t> stack;
+    string key;
+    auto append = [&key](const void *bytes, size_t size) {
+        key.append(static_cast<const char *>(bytes), size);
+    };
+    auto add = [&](node n, size_t count) {
+        n.first = uint32_t(operands.size());
+        n.count = uint32_t(count);
+        operands.insert(operands.end(), stack.end() - count, stack.end());
+        stack.resize(stack.size() - count);
+        key.clear();
+        append(&n.type, sizeof(n.type));
+        append(&n.operator_, sizeof(n.operator_));
+        append(&n.index, sizeof(n.index));
+        append(&n.value, sizeof(n.value));
+        append(operands.data() + n.first, count * sizeof(uint32_t));
+        if (n.type == Infix_lexer::function_name and not Function_registry::at(n.index).pure) {
+            size_t place = graph.size();
+            append(&place, sizeof(place));
+        }
+        auto found = known.emplace(key, uint32_t(graph.size()));
+        if (found.second) {
+            graph.push_back(n);
+        } else {
+            operands.resize(n.first);
+        }
+        stack.push_back(found.first->second);
+    };
+    for (auto &i : compiled.instructions()) {
+        switch (i.type) {
+            case Infix_lexer::number :
+                add({i.type, 0, 0, 0, 0, compiled.constants[i.index]}, 0);
+                break;
+            case Infix_lexer::variable :
+                add({i.type, 0, i.index, 0, 0, 0.0}, 0);
+                variable_nodes[i.index] = long(stack.back());
+                break;
+            case Infix_lexer::function_name :
+                add({i.type, 0, i.index, 0, 0, 0.0}, i.arguments);
+                break;
+            default :
+                add({i.type, i.operator_, 0, 0, 0, 0.0}, 2);
+                break;
+        }
+    }
+    root = stack.back();
+    users_start.assign(graph.size() + 1, 0);
+    for (auto operand : operands) {
+        ++users_start[operand + 1];
+    }
+    std::partial_sum(users_start.begin(), users_start.end(), users_start.begin());
+    users.resize(operands.size());
+    vector<uint32_t> filled(users_start.begin(), users_start.end() - 1);
+    for (uint32_t n = 0; n < graph.size(); ++n) {
+        for (uint32_t k = 0; k < graph[n].count; ++k) {
+            users[filled[operands[graph[n].first + k]]++] = n;
+        }
+    }
+    queued.assign(graph.size(), false);
+    for (auto &n : graph) {
+        if (n.count) {
+            n.value = compute(n);
+            ++last_recomputed;
+        }
+    }
+}
+
+bool Incremental_expression::valid() const {
+    return compiled_valid;
+}
+
+const vector<string> &Incremental_expression::variables() const {
+    return names;
+}
+
+double Incremental_expression::value() const {
+    return valid() ? graph[root].value : std::numeric_limits<double>::quiet_NaN();
+}
+
+size_t Incremental_expression::recomputed() const {
+    return last_recomputed;
+}
+
+size_t Incremental_expression::nodes() const {
+    return graph.size();
+}
+
+double Incremental_expression::evaluate(const double *values) {
+    if (values == nullptr and not names.empty()) {
+        last_recomputed = 0;
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    for (size_t slot = 0; slot < names.size(); ++slot) {
+        set(slot, values[slot]);
+    }
+    return settle();
+}
+
+double Incremental_expression::update(size_t slot, double value) {
+    set(slot, value);
+    return settle();
+}
+
+// The same functions Compiled_expression::evaluate() applies.
+double Incremental_expression::compute(const node &n) {
+    if (n.type == Infix_lexer::function_name) {
+        arguments.resize(n.count);
+        for (uint32_t k = 0; k < n.count; ++k) {
+            arguments[k] = graph[operands[n.first + k]].value;
+        }
+        return Function_registry::at(n.index).apply(arguments.data(), n.count);
+    }
+    double x = graph[operands[n.first]].value;
+    double y = graph[operands[n.first + 1]].value;
+    switch (n.operator_) {
+        case '+' : return Infix_calculator::plus(x, y);
+        case '-' : return Infix_calculator::minus(x, y);
+        case '*' : return Infix_calculator::multiply(x, y);
+        case '/' : return Infix_calculator::divide(x, y);
+        default : return Infix_calculator::exponent(x, y);
+    }
+}
+
+void Incremental_expression::queue_users(uint32_t n) {
+    for (uint32_t u = users_start[n]; u < users_start[n + 1]; ++u) {
+        if (not queued[users[u]]) {
+            queued[users[u]] = true;
+            dirty.push_back(users[u]);
+            std::push_heap(dirty.begin(), dirty.end(), std::greater<>());
+        }
+    }
+}
+
+// Queues the users of a variable whose value changed.
+void Incremental_expression::set(size_t slot, double value) {
+    if (not valid() or slot >= names.size() or variable_nodes[slot] < 0) {
+        return;
+    }
+    auto n = uint32_t(variable_nodes[slot]);
+    if (same(graph[n].value, value)) {
+        return;
+    }
+    graph[n].value = value;
+    queue_users(n);
+}
+
+/*
+ * Recomputes queued nodes lowest number first, so every operand is final before the nodes that use
+ * it. A node whose value comes out the same does not queue its users.
+ */
+double Incremental_expression::settle() {
+    last_recomputed = 0;
+    while (not dirty.empty()) {
+        std::pop_heap(dirty.begin(), dirty.end(), std::greater<>());
+        uint32_t n = dirty.back();
+        dirty.pop_back();
+        queued[n] = false;
+        ++last_recomputed;
+        double result = compute(graph[n]);
+        if (same(result, graph[n].value)) {
+            continue;
+        }
+        graph[n].value = result;
+        queue_users(n);
+    }
+    return value();
+}
@@ -0,0 +1,78 @@
+//
+// Re-evaluation of only what a change of variables touches.
+//
+
+#ifndef INC_9_CALCULATOR_INCREMENTAL_EXPRESSION_H
+#define INC_9_CALCULATOR_INCREMENTAL_EXPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "compiled_expression.h"
+
+/*
+ * An Incremental_expression holds the postfix program of a Compiled_expression as a graph of
+ * nodes, each with the value of its subexpression. A subexpression written more than once, such
+ * as (x+y) in (x+y)*(x+y), is one node. Changing a variable recomputes only the nodes above it,
+ * and stops climbing wherever a node's value comes out unchanged, so a change that only moves
+ * floor(x) within the same integer goes no further. Results are the same, bit for bit, as those of
+ * Compiled_expression::evaluate(). All variables start at zero.
+ *
+ * A call of a function that is not pure is never shared with another, but like any node it is only
+ * called again when one of its arguments changes.
+ */
+class Incremental_expression {
+
+public:
+    explicit Incremental_expression(const Compiled_expression &compiled);
+
+    bool valid() const;
+
+    const std::vector<std::string> &variables() const;
+
+    // values[i] is the new value of variables()[i]. Only the nodes above those that changed are
+    // recomputed. A null values, for an expression with variables, changes nothing and gives NaN.
+    double evaluate(const double *values);
+
+    // Sets variables()[slot] and recomputes the nodes above it.
+    double update(size_t slot, double value);
+
+    // The value of the whole expression.
+    double value() const;
+
+    // The operators and calls recomputed by the last evaluate() or update(), or at construction.
+    size_t recomputed() const;
+
+    // The number of distinct constants, variables, operators and calls.
+    size_t nodes() const;
+
+private:
+    struct node {
+        Infix_lexer::token_type type;
+        char operator_;
+        uint32_t index;        // Variables and function calls only.
+        uint32_t first;        // Operands are operands[first] to operands[first + count - 1].
+        uint32_t count;
+        double value;
+    };
+
+    // Operands come before the nodes that use them, so a node's number is its topological order.
+    std::vector<node> graph;
+    std::vector<uint32_t> operands;
+    std::vector<uint32_t> users_start;    // Users of n are users[users_start[n]] to users_start[n+1].
+    std::vector<uint32_t> users;
+    std::vector<long> variable_nodes;     // By slot, or -1 for a variable that is never read.
+    std::vector<uint32_t> dirty;          // A min-heap of nodes whose operands changed.
+    std::vector<bool> queued;
+    std::vector<double> arguments;
+    std::vector<std::string> names;
+    uint32_t root{0};
+    size_t last_recomputed{0};
+    bool compiled_valid{false};
+    double compute(const node &n);
+    void set(size_t slot, double value);
+    void queue_users(uint32_t n);
+    double settle();
+};
+
+#endif //INC_9_CALCULATOR_INCREMENTAL_EXPRESSION_H
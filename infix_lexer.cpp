@@ -0,0 +1,371 @@
+//
+// Single pass tokenizer for infix equations.
+//
+
+#include <string>
+#include <vector>
+#include <cctype>
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include "function_registry.h"
+#include "infix_lexer.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+/*
+ * The lexer replaces the regex based format_* and validate_* passes. It walks the UTF-8 input once,
+ * maps the look-alike glyphs used by the Mac OS Numbers application and Microsoft Excel onto their
+ * ASCII operators, decides whether a + or - is a sign or an operator, and emits typed tokens. The
+ * checks formerly made by validate_characters(), validate_operator_sequence() and
+ * validate_balanced_parentheses() are made along the way.
+ */
+Infix_lexer::Infix_lexer(string_view equation) : equation(equation) {}
+
+size_t Infix_lexer::error_offset() const {
+    return error_at;
+}
+
+const vector<string> &Infix_lexer::variables() const {
+    return names;
+}
+
+// Records the first error of the most important kind. Scanning continues so that an invalid
+// character later in the equation still outranks an earlier operator sequence error.
+void Infix_lexer::fail(error_kind kind, size_t offset) {
+    if (error == none or kind < error) {
+        error = kind;
+        error_at = offset;
+    }
+}
+
+/*
+ * Returns the ASCII symbol at the current position and its length in bytes. The look-alike minus
+ * (U+2212), division (U+00F7) and multiplication (U+00D7) signs are returned as '-', '/' and '*'.
+ * Any other non-ASCII character is returned as zero.
+ */
+char Infix_lexer::next_symbol(size_t &length) const {
+    auto byte = static_cast<unsigned char>(equation[position]);
+    auto follows = [this](size_t i, unsigned char expected) {
+        return position + i < equation.size() and
+               static_cast<unsigned char>(equation[position + i]) == expected;
+    };
+    length = 1;
+    if (byte < 0x80) {
+        return static_cast<char>(byte);
+    }
+    if (byte == 0xE2 and follows(1, 0x88) and follows(2, 0x92)) {
+        length = 3;
+        return '-';
+    }
+    if (byte == 0xC3 and follows(1, 0xB7)) {
+        length = 2;
+        return '/';
+    }
+    if (byte == 0xC3 and follows(1, 0x97)) {
+        length = 2;
+        return '*';
+    }
+    // Step over the whole of any other UTF-8 sequence.
+    while (position + length < equation.size() and
+           (static_cast<unsigned char>(equation[position + length]) & 0xC0) == 0x80) {
+        ++length;
+    }
+    return 0;
+}
+
+string Infix_lexer::format(const vector<token> &tokens) {
+    string formatted;
+    for (auto &token : tokens) {
+        if (not formatted.empty()) {
+            formatted += ' ';
+        }
+        if (token.type == number or token.type == variable or token.type == function_name) {
+            if (token.operator_) {
+                formatted += token.operator_;
+            }
+            formatted += token.text;
+        } else {
+            formatted += token.operator_;
+        }
+    }
+    return formatted;
+}
+
+const char *Infix_lexer::describe(error_kind error) {
+    switch (error) {
+        case none : return "none";
+        case invalid_character : return "invalid character";
+        case operator_sequence : return "invalid sequence of operators";
+        case unbalanced_parentheses : return "unbalanced parentheses";
+        case empty_equation : return "empty equation";
+        case unknown_variable : return "unknown variable";
+        case unknown_function : return "unknown function";
+        case argument_count : return "wrong number of arguments";
+    }
+    return "unknown error";
+}
+
+/*
+ * std::from_chars is locale independent, does not throw and rounds correctly. Standard libraries
+ * that lack the floating point overloads fall back to strtod(), which reads the same digits. So
+ * does a number out of range, which from_chars leaves unconverted, and which strtod() gives as
+ * infinity, zero or a subnormal.
+ */
+double Infix_lexer::parse_number(string_view digits) {
+    double value{0.0};
+#if defined(__cpp_lib_to_chars)
+    auto parsed = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    if (parsed.ec == std::errc::result_out_of_range) {
+        value = std::strtod(string(digits).c_str(), nullptr);
+    }
+#else
+    value = std::strtod(string(digits).c_str(), nullptr);
+#endif
+    return value;
+}
+
+// A number starts with a digit, or with a decimal point followed by a digit.
+bool Infix_lexer::starts_number(size_t offset) const {
+    auto digit = [this](size_t i) {
+        return i < equation.size() and std::isdigit(static_cast<unsigned char>(equation[i]));
+    };
+    return digit(offset) or (offset < equation.size() and equation[offset] == '.' and
+                             digit(offset + 1));
+}
+
+// A sign directly before a name or a left parenthesis applies to that operand.
+bool Infix_lexer::starts_name_or_group(size_t offset) const {
+    if (offset >= equation.size()) {
+        return false;
+    }
+    auto next = static_cast<unsigned char>(equation[offset]);
+    return std::isalpha(next) or next == '_' or next == '(';
+}
+
+string_view Infix_lexer::scan_number() {
+    size_t begin = position;
+    auto skip_digits = [this]() {
+        while (position < equation.size() and
+               std::isdigit(static_cast<unsigned char>(equation[position]))) {
+            ++position;
+        }
+    };
+    skip_digits();
+    if (position < equation.size() and equation[position] == '.') {
+        ++position;
+        skip_digits();
+    }
+    return equation.substr(begin, position - begin);
+}
+
+// A variable name is a letter or underscore followed by letters, digits or underscores.
+string_view Infix_lexer::scan_name() {
+    size_t begin = position;
+    while (position < equation.size() and
+           (std::isalnum(static_cast<unsigned char>(equation[position])) or
+            equation[position] == '_')) {
+        ++position;
+    }
+    return equation.substr(begin, position - begin);
+}
+
+// A name followed by a left parenthesis, perhaps after spaces, is a function call.
+bool Infix_lexer::opens_call() const {
+    size_t next = position;
+    while (next < equation.size() and std::isspace(static_cast<unsigned char>(equation[next]))) {
+        ++next;
+    }
+    return next < equation.size() and equation[next] == '(';
+}
+
+// Variables are numbered in order of first appearance. A hash keeps machine generated equations
+// with many thousands of names linear. It is sized from the equation, so it seldom rehashes.
+size_t Infix_lexer::slot(string_view name) {
+    if (slots.empty()) {
+        slots.reserve(equation.size() / 8);
+    }
+    auto found = slots.emplace(name, names.size());
+    if (found.second) {
+        names.emplace_back(name);
+    }
+    return found.first->second;
+}
+
+Infix_lexer::error_kind Infix_lexer::scan(vector<token> &tokens) {
+    tokens.clear();
+    names.clear();
+    slots.clear();
+    calls.clear();
+    position = 0;
+    error = none;
+    error_at = 0;
+    bool expect_operand{true};    // True where a number, variable or left parenthesis is due.
+    long depth{0};                // Parenthesis nesting depth.
+    size_t outermost_open{0};     // Offset of the outermost unclosed left parenthesis.
+    long called{-1};              // The function whose left parenthesis is next, if any.
+    size_t called_at{0};
+    bool negate{false};           // A sign's parenthesis closes after the next operand.
+    while (position < equation.size()) {
+        size_t offset = position;
+        size_t length;
+        char symbol = next_symbol(length);
+        if (std::isspace(static_cast<unsigned char>(symbol))) {
+            position += length;
+            continue;
+        }
+        if (std::isdigit(static_cast<unsigned char>(symbol)) or symbol == '.') {
+            if (not starts_number(offset)) {
+                fail(invalid_character, offset);
+                position += length;
+                continue;
+            }
+            if (not expect_operand) {
+                fail(operator_sequence, offset);
+            }
+            string_view digits = scan_number();
+            tokens.push_back({number, 0, digits, parse_number(digits), offset, 0});
+            expect_operand = false;
+            continue;
+        }
+        if (std::isalpha(static_cast<unsigned char>(symbol)) or symbol == '_') {
+            if (not expect_operand) {
+                fail(operator_sequence, offset);
+            }
+            string_view name = scan_name();
+            if (opens_call()) {
+                // The arguments are counted, and checked against the function, at the parenthesis.
+                called = Function_registry::find(name);
+                called_at = offset;
+                if (called < 0) {
+                    fail(unknown_function, offset);
+                }
+                tokens.push_back({function_name, 0, name, 0.0, offset,
+                                  size_t(called < 0 ? 0 : called)});
+                continue;
+            }
+            tokens.push_back({variable, 0, name, 0.0, offset, slot(name)});
+            if (negate) {
+                tokens.push_back({right_parenthesis, ')', {}, 0.0, offset, 0});
+                negate = false;
+            }
+            expect_operand = false;
+            continue;
+        }
+        switch (symbol) {
+            case '+':
+            case '-': {
+                // A sign is only recognized where an operand is expected and a number, name or
+                // parenthesis follows it directly. A number takes it: -1+-1 is read as -1 + -1.
+                if (expect_operand and starts_number(offset + length)) {
+                    position += length;
+                    string_view digits = scan_number();
+                    double value = parse_number(digits);
+                    tokens.push_back({number, symbol, digits, symbol == '-' ? -value : value,
+                                      offset, 0});
+                    expect_operand = false;
+                    continue;
+                }
+                // Before a name or a parenthesis, - is read as (-1 * operand), so that it binds as
+                // tightly as the sign of a number: -x^2 is (-x)^2, as -2^2 is. + changes nothing.
+                if (expect_operand and starts_name_or_group(offset + length)) {
+                    if (symbol == '-') {
+                        tokens.push_back({left_parenthesis, '(', {}, 0.0, offset, 0});
+                        tokens.push_back({number, '-', "1", -1.0, offset, 0});
+                        tokens.push_back({arithmetic_operator, '*', {}, 0.0, offset, 0});
+                        negate = true;
+                    }
+                    break;
+                }
+                if (expect_operand) {
+                    fail(operator_sequence, offset);
+                }
+                tokens.push_back({arithmetic_operator, symbol, {}, 0.0, offset, 0});
+                expect_operand = true;
+                break;
+            }
+            case '*':
+            case '/':
+            case '^': {
+                if (expect_operand) {
+                    fail(operator_sequence, offset);
+                }
+                tokens.push_back({arithmetic_operator, symbol, {}, 0.0, offset, 0});
+                expect_operand = true;
+                break;
+            }
+            case '(': {
+                if (not expect_operand) {
+                    fail(operator_sequence, offset);
+                }
+                if (depth == 0) {
+                    outermost_open = offset;
+                }
+                ++depth;
+                bool function = not tokens.empty() and tokens.back().type == function_name;
+                calls.push_back({function, function ? called : -1, 1, called_at, negate});
+                negate = false;
+                tokens.push_back({left_parenthesis, symbol, {}, 0.0, offset, 0});
+                expect_operand = true;
+                break;
+            }
+            case ',': {
+                // A comma only separates the arguments of a function.
+                if (calls.empty() or not calls.back().function) {
+                    fail(invalid_character, offset);
+                    break;
+                }
+                if (expect_operand) {
+                    fail(operator_sequence, offset);
+                }
+                ++calls.back().arguments;
+                tokens.push_back({comma, symbol, {}, 0.0, offset, 0});
+                expect_operand = true;
+                break;
+            }
+            case ')': {
+                if (expect_operand) {
+                    fail(operator_sequence, offset);
+                }
+                bool negated{false};
+                if (depth == 0) {
+                    fail(unbalanced_parentheses, offset);
+                } else {
+                    --depth;
+                    auto closed = calls.back();
+                    calls.pop_back();
+                    negated = closed.negated;
+                    if (closed.function and closed.index >= 0) {
+                        auto &function = Function_registry::at(size_t(closed.index));
+                        if (closed.arguments < function.min_arguments or
+                            closed.arguments > function.max_arguments) {
+                            fail(argument_count, closed.offset);
+                        }
+                    }
+                }
+                tokens.push_back({right_parenthesis, symbol, {}, 0.0, offset, 0});
+                if (negated) {
+                    tokens.push_back({right_parenthesis, symbol, {}, 0.0, offset, 0});
+                }
+                expect_operand = false;
+                break;
+            }
+            default: {
+                fail(invalid_character, offset);
+                break;
+            }
+        }
+        position += length;
+    }
+    if (depth > 0) {
+        fail(unbalanced_parentheses, outermost_open);
+    }
+    if (tokens.empty()) {
+        fail(empty_equation, 0);
+    } else if (expect_operand) {
+        fail(operator_sequence, tokens.back().offset);
+    }
+    return error;
+}
@@ -0,0 +1,103 @@
+//
+// Single pass tokenizer for infix equations.
+//
+
+#ifndef INC_9_CALCULATOR_INFIX_LEXER_H
+#define INC_9_CALCULATOR_INFIX_LEXER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+
+class Infix_lexer {
+
+public:
+    // These integers align to the outline used in compute(), e.g.; 123 means outline section 1.2.3.
+    enum token_type: int {
+        number              = 121,
+        variable            = 122,
+        left_parenthesis    = 123,
+        right_parenthesis   = 124,
+        arithmetic_operator = 125,
+        function_name       = 126,
+        comma               = 127,
+    };
+
+    // Ordered by the precedence with which they are reported.
+    enum error_kind: int {
+        none,
+        invalid_character,
+        operator_sequence,
+        unbalanced_parentheses,
+        empty_equation,
+        unknown_variable,
+        unknown_function,
+        argument_count,
+    };
+
+    /*
+     * Tokens refer to the equation rather than copying it, so the equation must outlive them.
+     * A number keeps its sign, if any, in operator_ and the digits that follow it in text. A sign
+     * before a name or a parenthesis becomes the tokens of (-1 * operand), whose 1 is not part of
+     * the equation.
+     */
+    struct token {
+        token_type type;
+        char operator_;        // The ASCII operator, parenthesis or sign.
+        std::string_view text; // Number digits, variable or function name.
+        double value;          // Numbers only. The signed value.
+        size_t offset;         // Byte offset of the token in the input equation.
+        size_t slot;           // Index of a variable in variables(), or of a function in
+                               // Function_registry.
+    };
+
+    explicit Infix_lexer(std::string_view equation);
+
+    /*
+     * The canonical form of scanned tokens: ASCII operators and single spaces between tokens.
+     * Equations that differ only in spacing or look-alike glyphs have the same canonical form.
+     */
+    static std::string format(const std::vector<token> &tokens);
+
+    // A short description of an error, e.g.; "unbalanced parentheses".
+    static const char *describe(error_kind error);
+
+    // Converts the digits of a number, without its sign, to the nearest double.
+    static double parse_number(std::string_view digits);
+
+    error_kind scan(std::vector<token> &tokens);
+
+    size_t error_offset() const;
+
+    // Variable names in order of first appearance.
+    const std::vector<std::string> &variables() const;
+
+private:
+    std::string_view equation;
+    size_t position{0};
+    error_kind error{none};
+    size_t error_at{0};
+    std::vector<std::string> names;
+    std::unordered_map<std::string_view, size_t> slots;    // Keys refer into the equation.
+    // One per unclosed parenthesis: whether it opens the arguments of a function, and how many.
+    struct call {
+        bool function;
+        long index;
+        size_t arguments;
+        size_t offset;
+        bool negated;          // Preceded by a sign, whose parenthesis closes with this one.
+    };
+    std::vector<call> calls;
+    void fail(error_kind kind, size_t offset);
+    char next_symbol(size_t &length) const;
+    bool starts_number(size_t offset) const;
+    bool starts_name_or_group(size_t offset) const;
+    std::string_view scan_number();
+    std::string_view scan_name();
+    bool opens_call() const;
+    size_t slot(std::string_view name);
+};
+
+#endif //INC_9_CALCULATOR_INFIX_LEXER_H
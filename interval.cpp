@@ -0,0 +1,219 @@
+//
+// Interval arithmetic.
+//
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include "interval.h"
+
+using std::string;
+
+namespace {
+
+const double infinity = std::numeric_limits<double>::infinity();
+const double not_a_number = std::numeric_limits<double>::quiet_NaN();
+const double pi = 3.14159265358979323846;
+
+bool undefined(const Interval &x) {
+    return std::isnan(x.lower) or std::isnan(x.upper);
+}
+
+// A product of endpoints, in which zero times infinity is zero.
+double times(double x, double y) {
+    return x == 0.0 or y == 0.0 ? 0.0 : x * y;
+}
+
+// The lowest and highest of four corners, where a corner that is NaN, e.g.; inf/inf, leaves them
+// unknown.
+Interval corners(double a, double b, double c, double d) {
+    if (std::isnan(a) or std::isnan(b) or std::isnan(c) or std::isnan(d)) {
+        return {-infinity, infinity};
+    }
+    return Interval::rounded(std::min({a, b, c, d}), std::max({a, b, c, d}));
+}
+
+// Whether point + 2kπ lies in [lower, upper] for some k, allowing for the rounding of π.
+bool reaches(double lower, double upper, double point, double period) {
+    double slack = 1e-12 * std::max({1.0, std::fabs(lower), std::fabs(upper)});
+    double k = std::ceil((lower - slack - point) / period);
+    return point + k * period <= upper + slack;
+}
+
+} // namespace
+
+Interval Interval::point(double value) {
+    return {value, value};
+}
+
+Interval Interval::rounded(double lower, double upper) {
+    return {std::nextafter(lower, -infinity), std::nextafter(upper, infinity)};
+}
+
+bool Interval::contains(double value) const {
+    return lower <= value and value <= upper;
+}
+
+double Interval::midpoint() const {
+    return lower / 2.0 + upper / 2.0;
+}
+
+string Interval::to_string() const {
+    char text[64];
+    string written{"["};
+    written.append(text, std::to_chars(text, text + sizeof(text), lower).ptr);
+    written += ", ";
+    written.append(text, std::to_chars(text, text + sizeof(text), upper).ptr);
+    return written + "]";
+}
+
+Interval Interval::plus(Interval x, Interval y) {
+    return rounded(x.lower + y.lower, x.upper + y.upper);
+}
+
+Interval Interval::minus(Interval x, Interval y) {
+    return rounded(x.lower - y.upper, x.upper - y.lower);
+}
+
+Interval Interval::multiply(Interval x, Interval y) {
+    if (undefined(x) or undefined(y)) {
+        return {not_a_number, not_a_number};
+    }
+    return corners(times(x.lower, y.lower), times(x.lower, y.upper), times(x.upper, y.lower),
+                   times(x.upper, y.upper));
+}
+
+Interval Interval::divide(Interval x, Interval y) {
+    if (undefined(x) or undefined(y)) {
+        return {not_a_number, not_a_number};
+    }
+    if (y.lower <= 0.0 and y.upper >= 0.0) {
+        return {-infinity, infinity};
+    }
+    return corners(x.lower / y.lower, x.lower / y.upper, x.upper / y.lower, x.upper / y.upper);
+}
+
+/*
+ * A constant integer exponent is applied by the monotonicity of x^n on each side of zero, so that
+ * even powers are never negative. Otherwise x^y is monotonic in each of x and y where x is not
+ * negative, so its bounds are at the corners.
+ */
+Interval Interval::exponent(Interval x, Interval y) {
+    if (undefined(x) or undefined(y)) {
+        return {not_a_number, not_a_number};
+    }
+    if (y.lower == y.upper and y.lower == std::floor(y.lower) and std::fabs(y.lower) < 0x1p53) {
+        double n = y.lower;
+        if (n == 0.0) {
+            return point(1.0);
+        }
+        return n > 0.0 ? power(x, n) : divide(point(1.0), power(x, -n));
+    }
+    if (x.upper < 0.0) {
+        return {not_a_number, not_a_number};
+    }
+    double a = std::max(x.lower, 0.0);
+    double b = x.upper;
+    return corners(std::pow(a, y.lower), std::pow(a, y.upper), std::pow(b, y.lower),
+                   std::pow(b, y.upper));
+}
+
+Interval Interval::power(Interval x, double n) {
+    double low = std::pow(x.lower, n);
+    double high = std::pow(x.upper, n);
+    if (std::fmod(n, 2.0) not_eq 0.0 or x.lower >= 0.0) {
+        return rounded(low, high);
+    }
+    Interval even = x.upper <= 0.0 ? rounded(high, low) : rounded(0.0, std::max(low, high));
+    even.lower = std::max(even.lower, 0.0);
+    return even;
+}
+
+// f of period 2π, greatest at peak and least at peak + π.
+Interval Interval::periodic(Interval x, double (*f)(double), double peak) {
+    if (not std::isfinite(x.lower) or not std::isfinite(x.upper) or x.upper - x.lower >= 2 * pi) {
+        return undefined(x) ? Interval{not_a_number, not_a_number} : Interval{-1.0, 1.0};
+    }
+    double at_lower = f(x.lower);
+    double at_upper = f(x.upper);
+    Interval bounds = rounded(std::min(at_lower, at_upper), std::max(at_lower, at_upper));
+    if (reaches(x.lower, x.upper, peak, 2 * pi)) {
+        bounds.upper = 1.0;
+    }
+    if (reaches(x.lower, x.upper, peak + pi, 2 * pi)) {
+        bounds.lower = -1.0;
+    }
+    return {std::max(bounds.lower, -1.0), std::min(bounds.upper, 1.0)};
+}
+
+// tan is increasing between its poles, at π/2 + kπ, so an interval holding one is unbounded.
+Interval Interval::tangent(Interval x) {
+    if (undefined(x)) {
+        return {not_a_number, not_a_number};
+    }
+    if (not std::isfinite(x.lower) or not std::isfinite(x.upper) or
+        reaches(x.lower, x.upper, pi / 2, pi)) {
+        return {-infinity, infinity};
+    }
+    return rounded(std::tan(x.lower), std::tan(x.upper));
+}
+
+Interval Interval::call(const Function_registry::function &f, const Interval *x, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (undefined(x[i])) {
+            return {not_a_number, not_a_number};
+        }
+    }
+    const string &name = f.name;
+    if (name == "min" or name == "max") {
+        Interval bounds = x[0];
+        for (size_t i = 1; i < count; ++i) {
+            bounds.lower = name == "min" ? std::min(bounds.lower, x[i].lower)
+                                         : std::max(bounds.lower, x[i].lower);
+            bounds.upper = name == "min" ? std::min(bounds.upper, x[i].upper)
+                                         : std::max(bounds.upper, x[i].upper);
+        }
+        return bounds;
+    }
+    if (count not_eq 1) {
+        return {-infinity, infinity};
+    }
+    double a = x[0].lower;
+    double b = x[0].upper;
+    if (name == "sqrt" or name == "log") {
+        if (b < 0.0) {
+            return {not_a_number, not_a_number};
+        }
+        if (name == "sqrt") {
+            return {a <= 0.0 ? 0.0 : std::max(std::nextafter(std::sqrt(a), 0.0), 0.0),
+                    std::nextafter(std::sqrt(b), infinity)};
+        }
+        return {a <= 0.0 ? -infinity : std::nextafter(std::log(a), -infinity),
+                std::nextafter(std::log(b), infinity)};
+    }
+    if (name == "abs") {
+        return a >= 0.0 ? x[0] : b <= 0.0 ? Interval{-b, -a} : Interval{0.0, std::max(-a, b)};
+    }
+    if (name == "floor") {
+        return {std::floor(a), std::floor(b)};
+    }
+    if (name == "ceil") {
+        return {std::ceil(a), std::ceil(b)};
+    }
+    if (name == "exp") {
+        Interval bounds = rounded(std::exp(a), std::exp(b));
+        bounds.lower = std::max(bounds.lower, 0.0);
+        return bounds;
+    }
+    if (name == "sin") {
+        return periodic(x[0], [](double u) { return std::sin(u); }, pi / 2);
+    }
+    if (name == "cos") {
+        return periodic(x[0], [](double u) { return std::cos(u); }, 0.0);
+    }
+    if (name == "tan") {
+        return tangent(x[0]);
+    }
+    return {-infinity, infinity};
+}
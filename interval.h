@@ -0,0 +1,71 @@
+//
+// Interval arithmetic.
+//
+
+#ifndef INC_9_CALCULATOR_INTERVAL_H
+#define INC_9_CALCULATOR_INTERVAL_H
+
+#include <cstddef>
+#include <string>
+#include "function_registry.h"
+
+/*
+ * An Interval is the set of reals from lower to upper, and each operation gives an interval that
+ * holds every result of its operands' members, so an equation evaluated over intervals bounds its
+ * value over the whole box of its variables. Endpoints are computed in double and moved out by an
+ * ulp, which covers the rounding of arithmetic and of the library's functions.
+ *
+ * The bounds are sound but not always tight: an interval does not know that two operands are the
+ * same variable, so x - x over [0, 1] is [-1, 1]. A division by an interval that holds zero gives
+ * the whole line, as does a function registered by the caller, of which nothing is known. A power
+ * of a base that is partly negative to an exponent that is not a constant integer, and sqrt and
+ * log, are bounded over the part of their domain the interval meets, and an interval entirely
+ * outside the domain is NaN.
+ */
+class Interval {
+
+public:
+    double lower{0.0};
+    double upper{0.0};
+
+    Interval() = default;
+
+    Interval(double lower, double upper) : lower(lower), upper(upper) {}
+
+    // The interval of one number.
+    static Interval point(double value);
+
+    // Lowest and highest to nearest, widened out by an ulp.
+    static Interval rounded(double lower, double upper);
+
+    bool contains(double value) const;
+
+    double midpoint() const;
+
+    // "[lower, upper]"
+    std::string to_string() const;
+
+    static Interval plus(Interval x, Interval y);
+    static Interval minus(Interval x, Interval y);
+    static Interval multiply(Interval x, Interval y);
+    static Interval divide(Interval x, Interval y);
+    static Interval exponent(Interval x, Interval y);
+
+    // Bounds function f of count arguments.
+    static Interval call(const Function_registry::function &f, const Interval *x, size_t count);
+
+    bool operator==(const Interval &other) const {
+        return lower == other.lower and upper == other.upper;
+    }
+
+    bool operator!=(const Interval &other) const {
+        return not (*this == other);
+    }
+
+private:
+    static Interval power(Interval x, double n);
+    static Interval periodic(Interval x, double (*f)(double), double peak);
+    static Interval tangent(Interval x);
+};
+
+#endif //INC_9_CALCULATOR_INTERVAL_H
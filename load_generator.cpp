@@ -0,0 +1,114 @@
+//
+// Drives a Calculator_server with pipelined requests and measures their latency.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "calculator_server.h"
+#include "expression_fuzzer.h"
+#include "load_generator.h"
+
+using std::string;
+using std::vector;
+typedef std::chrono::steady_clock load_clock;
+
+namespace {
+
+// The fuzzer writes these names, so every equation it makes is bound.
+const vector<Calculator_server::binding> bindings = {
+        {"x", 2.0}, {"y", -3.5}, {"rate", 0.25}, {"principal_2", 100.0}};
+
+double percentile(const vector<double> &sorted, double fraction) {
+    return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1,
+                                                  size_t(fraction * double(sorted.size())))];
+}
+
+} // namespace
+
+/*
+ * The equations are made before any connection opens, a few hundred of them that the requests
+ * share, so the server's cache sees repeats as it would from real clients.
+ */
+Load_generator::report Load_generator::run(const string &path, const settings &load) {
+    Expression_fuzzer fuzzer{load.seed};
+    vector<Calculator_server::query> pool;
+    for (size_t i = 0; i < 512; ++i) {
+        pool.push_back({fuzzer.well_formed(1 + i % 8), bindings});
+    }
+    report results{0, 0, 0, 0, 0.0, 0.0, 0.0, 0.0};
+    vector<double> latencies;
+    std::mutex merge;
+    auto drive = [&](size_t index) {
+        Calculator_client client;
+        vector<double> measured;
+        size_t errors{0};
+        size_t received{0};
+        bool open = client.connect(path);
+        if (open) {
+            std::deque<load_clock::time_point> sent;
+            vector<Calculator_server::query> queries(load.batch);
+            vector<Calculator_server::outcome> outcomes;
+            size_t next{index * load.requests};
+            while (open and received < load.requests) {
+                while (open and sent.size() < std::max<size_t>(load.depth, 1) and
+                       received + sent.size() < load.requests) {
+                    for (auto &q : queries) {
+                        q = pool[next++ % pool.size()];
+                    }
+                    sent.push_back(load_clock::now());
+                    open = client.send(uint32_t(next / load.batch), queries);
+                }
+                uint32_t id;
+                open = open and client.receive(id, outcomes);
+                if (not open) {
+                    break;
+                }
+                measured.push_back(std::chrono::duration<double, std::micro>(
+                        load_clock::now() - sent.front()).count());
+                sent.pop_front();
+                ++received;
+                for (auto &o : outcomes) {
+                    errors += o.error not_eq Infix_lexer::none;
+                }
+            }
+        }
+        std::lock_guard<std::mutex> guard{merge};
+        latencies.insert(latencies.end(), measured.begin(), measured.end());
+        results.requests += received;
+        results.equations += received * load.batch;
+        results.errors += errors;
+        results.failed_connections += received < load.requests;
+    };
+    auto start = load_clock::now();
+    vector<std::thread> threads;
+    for (size_t i = 0; i < load.connections; ++i) {
+        threads.emplace_back(drive, i);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    results.seconds = std::chrono::duration<double>(load_clock::now() - start).count();
+    std::sort(latencies.begin(), latencies.end());
+    results.p50 = percentile(latencies, 0.50);
+    results.p99 = percentile(latencies, 0.99);
+    results.max = latencies.empty() ? 0.0 : latencies.back();
+    return results;
+}
+
+void Load_generator::print(const report &results, FILE *out) {
+    double seconds = results.seconds > 0.0 ? results.seconds : 1.0;
+    std::fprintf(out, "%zu requests, %zu equations, %zu errors in %.3f s\n", results.requests,
+                 results.equations, results.errors, results.seconds);
+    std::fprintf(out, "%.0f requests/s, %.0f equations/s\n", double(results.requests) / seconds,
+                 double(results.equations) / seconds);
+    std::fprintf(out, "latency p50 %.1f us, p99 %.1f us, max %.1f us\n", results.p50, results.p99,
+                 results.max);
+    if (results.failed_connections) {
+        std::fprintf(out, "%zu connections failed\n", results.failed_connections);
+    }
+}
@@ -0,0 +1,47 @@
+//
+// Drives a Calculator_server with pipelined requests and measures their latency.
+//
+
+#ifndef INC_9_CALCULATOR_LOAD_GENERATOR_H
+#define INC_9_CALCULATOR_LOAD_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/*
+ * A Load_generator opens connections to a server, each on its own thread, and sends requests of
+ * batch random equations over the variables x, y, rate and principal_2, keeping up to depth of
+ * them in flight on every connection. A request's latency runs from sending it to receiving its
+ * response, so it includes the time spent queued behind the requests pipelined before it.
+ */
+class Load_generator {
+
+public:
+    struct settings {
+        size_t connections{4};
+        size_t requests{10000};    // Per connection.
+        size_t batch{16};          // Equations per request.
+        size_t depth{8};           // Requests in flight per connection.
+        uint64_t seed{2017};
+    };
+
+    struct report {
+        size_t requests;
+        size_t equations;
+        size_t errors;
+        size_t failed_connections;
+        double seconds;
+        double p50;                // Latencies, in microseconds.
+        double p99;
+        double max;
+    };
+
+    static report run(const std::string &path, const settings &load);
+
+    // Requests and equations per second, and the latency percentiles.
+    static void print(const report &results, FILE *out);
+};
+
+#endif //INC_9_CALCULATOR_LOAD_GENERATOR_H
@@ -1,8 +1,21 @@
 #include <iostream>
 #include <list>
+#include <thread>
+#include <cstdlib>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <cstdint>
+#include <csignal>
 #include "boost/format.hpp"
 #include "calculator.h"
 #include "calculator_testing.h"
+#include "batch_evaluator.h"
+#include "expression_cache.h"
+#include "calculator_profile.h"
+#include "expression_fuzzer.h"
+#include "calculator_server.h"
+#include "load_generator.h"
 #include "basic_argv_parse.h"
 
 
@@ -19,6 +32,16 @@ int main(int argc, char * argv[]) {
 
     bool infix_calculator_debug{false};
 
+    // Writes the per-stage timers and counters of builds with CALCULATOR_PROFILE to stderr.
+    auto report_profile = [argc, argv]() {
+        if (Basic_argv_parse::option_exists(argv, argv + argc, "--profile")) {
+            Calculator_profile::summary(Calculator_profile::collect(), stderr);
+        } else if (Basic_argv_parse::option_exists(argv, argv + argc, "--profile-json")) {
+            string json = Calculator_profile::json(Calculator_profile::collect());
+            std::fprintf(stderr, "%s\n", json.c_str());
+        }
+    };
+
     if (Basic_argv_parse::option_exists(argv, argv + argc, "-v")
         or Basic_argv_parse::option_exists(argv, argv + argc, "-d")) {
         // Enable debugging messages.
@@ -35,6 +58,91 @@ int main(int argc, char * argv[]) {
             exit(e.code().value());
         }
 
+    } else if (Basic_argv_parse::option_exists(argv, argv + argc, "--batch")) {
+        // Batch mode. Reads equations from the named file, or from stdin.
+        size_t threads{1};
+        if (char *count = Basic_argv_parse::get_option(argv, argv + argc, "--threads")) {
+            threads = std::strtoul(count, nullptr, 10);
+            threads = threads ? threads : std::thread::hardware_concurrency();
+        }
+        Batch_evaluator batch{threads};
+        std::unique_ptr<Expression_cache> cache;
+        if (char *capacity = Basic_argv_parse::get_option(argv, argv + argc, "--cache")) {
+            cache.reset(new Expression_cache(std::strtoul(capacity, nullptr, 10)));
+            batch.use_cache(cache.get());
+        }
+        char *path = Basic_argv_parse::get_option(argv, argv + argc, "--batch");
+        bool solved = path and path[0] != '-' ? batch.solve_file(path, stdout)
+                                              : batch.solve_stream(stdin, stdout);
+        if (Basic_argv_parse::option_exists(argv, argv + argc, "--stats")) {
+            batch.report(stderr);
+        }
+        report_profile();
+        if (not solved) {
+            cerr << "Unable to solve " << (path ? path : "stdin") << endl;
+            return 1;
+        }
+
+    } else if (char *count = Basic_argv_parse::get_option(argv, argv + argc, "--fuzz")) {
+        // Differential fuzzing. Solves random equations with every engine and compares them.
+        uint64_t seed{std::random_device{}()};
+        if (char *given = Basic_argv_parse::get_option(argv, argv + argc, "--seed")) {
+            seed = std::strtoull(given, nullptr, 10);
+        }
+        cout << "Seed " << seed << endl;
+        Expression_fuzzer fuzzer{seed};
+        auto results = fuzzer.run(std::strtoul(count, nullptr, 10));
+        Expression_fuzzer::print(results, stdout);
+        if (not results.passed()) {
+            return 1;
+        }
+
+    } else if (char *path = Basic_argv_parse::get_option(argv, argv + argc, "--serve")) {
+        // Server mode. Solves requests on a Unix domain socket until interrupted.
+        size_t threads{0};
+        size_t capacity{4096};
+        if (char *count = Basic_argv_parse::get_option(argv, argv + argc, "--threads")) {
+            threads = std::strtoul(count, nullptr, 10);
+        }
+        if (char *count = Basic_argv_parse::get_option(argv, argv + argc, "--cache")) {
+            capacity = std::strtoul(count, nullptr, 10);
+        }
+        static Calculator_server *serving{nullptr};
+        Calculator_server server{threads, capacity};
+        if (not server.listen(path)) {
+            cerr << "Unable to listen on " << path << endl;
+            return 1;
+        }
+        serving = &server;
+        std::signal(SIGINT, [](int) { serving->stop(); });
+        std::signal(SIGTERM, [](int) { serving->stop(); });
+        cerr << "Listening on " << path << endl;
+        server.run();
+        auto served = server.counters();
+        auto cached = server.cache_counters();
+        std::fprintf(stderr, "%zu connections, %zu requests, %zu equations, %zu errors, "
+                             "cache %zu hits %zu misses\n", served.connections, served.requests,
+                     served.equations, served.errors, cached.hits, cached.misses);
+        report_profile();
+
+    } else if (char *path = Basic_argv_parse::get_option(argv, argv + argc, "--load")) {
+        // Load generator. Drives a server with pipelined requests and reports their latency.
+        Load_generator::settings load;
+        auto option = [argc, argv](const string &name, size_t &value) {
+            if (char *given = Basic_argv_parse::get_option(argv, argv + argc, name)) {
+                value = std::strtoul(given, nullptr, 10);
+            }
+        };
+        option("--connections", load.connections);
+        option("--requests", load.requests);
+        option("--equations", load.batch);
+        option("--depth", load.depth);
+        auto results = Load_generator::run(path, load);
+        Load_generator::print(results, stdout);
+        if (results.failed_connections or results.requests == 0) {
+            return 1;
+        }
+
     } else {
         // Interactive mode.
         string equation;              // The infix expression to solve.
@@ -43,12 +151,18 @@ int main(int argc, char * argv[]) {
         cout << "Enter an arithmetic equation in infix notation: ";
         while (getline(cin, equation) and equation.length() > 0) {
             Infix_calculator c{equation, infix_calculator_debug};
-            result = c.compute();
+            auto solved = c.solve();
+            if (not solved.valid()) {
+                cerr << endl << "Detected " << Infix_lexer::describe(solved.error) << " at "
+                     << solved.offset << " in: " << equation << endl;
+            }
+            result = solved.value;
             cout << endl << c.format() << " = " << boost::format("%.4g") % result << endl;
             cout << endl << "Enter an arithmetic equation in infix notation: ";
             // Start over.
             result = 0.0;
         }
+        report_profile();
     }
 
     return 0;
@@ -0,0 +1,279 @@
+//
+// Compiled expressions lowered to x86-64 machine code.
+//
+
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <vector>
+#include "native_expression.h"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#include <sys/mman.h>
+#include <unistd.h>
+#define NATIVE_EXPRESSION_JIT 1
+#endif
+
+using std::vector;
+
+/*
+ * The generated function follows the System V calling convention: values arrives in rdi and the
+ * result leaves in xmm0. rbx holds values across calls to pow(), and a 112 byte frame keeps the
+ * registers under the operands of ^ while pow() runs, since every xmm register is caller-saved.
+ *
+ *     push rbx; mov rbx, rdi; sub rsp, 112; ...; add rsp, 112; pop rbx; ret
+ *
+ * A value at stack depth d is held in xmm(d - 1). Operators whose right operand is a single push
+ * read it straight from memory: a variable from [rbx + 8 * slot], a constant from a pool placed
+ * after the code and addressed relative to rip.
+ */
+namespace {
+
+const int registers{14};
+const int frame{registers * 8};
+
+class Assembler {
+
+public:
+    explicit Assembler(vector<uint8_t> &out) : out(out) {}
+
+    void byte(uint8_t value) {
+        out.push_back(value);
+    }
+
+    void bytes(std::initializer_list<uint8_t> values) {
+        out.insert(out.end(), values);
+    }
+
+    void dword(uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            byte(uint8_t(value >> (8 * i)));
+        }
+    }
+
+    void qword(uint64_t value) {
+        dword(uint32_t(value));
+        dword(uint32_t(value >> 32));
+    }
+
+    // prefix [REX] 0F opcode, with REX.R and REX.B taken from the register numbers.
+    void sse(uint8_t prefix, uint8_t opcode, int reg, int rm) {
+        byte(prefix);
+        if (reg >= 8 or rm >= 8) {
+            byte(uint8_t(0x40 | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0)));
+        }
+        byte(0x0F);
+        byte(opcode);
+    }
+
+    // opsd xmm(dst), xmm(src)
+    void scalar(uint8_t opcode, int dst, int src) {
+        sse(0xF2, opcode, dst, src);
+        byte(uint8_t(0xC0 | ((dst & 7) << 3) | (src & 7)));
+    }
+
+    // opsd xmm(dst), [rbx + offset]
+    void scalar_rbx(uint8_t opcode, int dst, int32_t offset) {
+        sse(0xF2, opcode, dst, 0);
+        byte(uint8_t(0x80 | ((dst & 7) << 3) | 3));
+        dword(uint32_t(offset));
+    }
+
+    // opsd xmm(dst), [rip + constant], patched once the constant pool is placed.
+    void scalar_constant(uint8_t opcode, int dst, uint32_t constant) {
+        sse(0xF2, opcode, dst, 0);
+        byte(uint8_t(((dst & 7) << 3) | 5));
+        fixups.push_back({out.size(), constant});
+        dword(0);
+    }
+
+    // movsd [rsp + offset], xmm(src) or, with load, movsd xmm(src), [rsp + offset]
+    void spill(int reg, int32_t offset, bool load) {
+        sse(0xF2, load ? 0x10 : 0x11, reg, 0);
+        byte(uint8_t(0x80 | ((reg & 7) << 3) | 4));
+        byte(0x24);
+        dword(uint32_t(offset));
+    }
+
+    // movapd xmm(dst), xmm(src)
+    void move(int dst, int src) {
+        if (dst not_eq src) {
+            sse(0x66, 0x28, dst, src);
+            byte(uint8_t(0xC0 | ((dst & 7) << 3) | (src & 7)));
+        }
+    }
+
+    void call(const void *target) {
+        bytes({0x48, 0xB8});    // mov rax, target
+        qword(uint64_t(reinterpret_cast<uintptr_t>(target)));
+        bytes({0xFF, 0xD0});    // call rax
+    }
+
+    // Appends the constants after the code and points every rip-relative operand at its slot.
+    void place(const vector<double> &constants) {
+        while (out.size() % 8) {
+            byte(0xCC);
+        }
+        size_t pool = out.size();
+        for (double constant : constants) {
+            uint64_t bits;
+            std::memcpy(&bits, &constant, sizeof(bits));
+            qword(bits);
+        }
+        for (auto &fixup : fixups) {
+            auto displacement = uint32_t(int32_t(pool + 8 * fixup.constant - (fixup.at + 4)));
+            for (int i = 0; i < 4; ++i) {
+                out[fixup.at + i] = uint8_t(displacement >> (8 * i));
+            }
+        }
+    }
+
+private:
+    struct fixup {
+        size_t at;
+        uint32_t constant;
+    };
+    vector<uint8_t> &out;
+    vector<fixup> fixups;
+};
+
+const uint8_t movsd{0x10};
+
+uint8_t opcode(char operator_) {
+    switch (operator_) {
+        case '+' : return 0x58;    // addsd
+        case '*' : return 0x59;    // mulsd
+        case '-' : return 0x5C;    // subsd
+        case '/' : return 0x5E;    // divsd
+        default : return 0;
+    }
+}
+
+} // namespace
+
+Native_expression::Native_expression(const Compiled_expression &compiled) : compiled(compiled) {
+#ifdef NATIVE_EXPRESSION_JIT
+    vector<uint8_t> out;
+    if (not generate(out)) {
+        return;
+    }
+    long page_bytes = sysconf(_SC_PAGESIZE);
+    page_size = (out.size() + page_bytes - 1) / page_bytes * page_bytes;
+    page = mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED) {
+        page = nullptr;
+        return;
+    }
+    std::memcpy(page, out.data(), out.size());
+    // The page is never writable and executable at once.
+    if (mprotect(page, page_size, PROT_READ | PROT_EXEC) not_eq 0) {
+        munmap(page, page_size);
+        page = nullptr;
+        return;
+    }
+    used = out.size();
+    code = reinterpret_cast<function>(page);
+#endif
+}
+
+Native_expression::~Native_expression() {
+#ifdef NATIVE_EXPRESSION_JIT
+    if (page) {
+        munmap(page, page_size);
+    }
+#endif
+}
+
+bool Native_expression::supported() {
+#ifdef NATIVE_EXPRESSION_JIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Native_expression::native() const {
+    return code not_eq nullptr;
+}
+
+Native_expression::function Native_expression::entry() const {
+    return code;
+}
+
+size_t Native_expression::code_size() const {
+    return used;
+}
+
+double Native_expression::evaluate(const double *values) const {
+    if (code and (values or compiled.variables().empty())) {
+        return code(values);
+    }
+    return compiled.evaluate(values);
+}
+
+bool Native_expression::generate(vector<uint8_t> &out) const {
+    auto &program = compiled.program;
+    if (not compiled.valid() or program.empty() or compiled.stack_depth() > size_t(registers)) {
+        return false;
+    }
+    for (auto &i : program) {
+        if (i.type == Infix_lexer::function_name) {
+            return false;
+        }
+    }
+    double (*power)(double, double) = std::pow;
+    Assembler code{out};
+    code.bytes({0x53});                    // push rbx
+    code.bytes({0x48, 0x89, 0xFB});        // mov rbx, rdi
+    code.bytes({0x48, 0x81, 0xEC});        // sub rsp, frame
+    code.dword(frame);
+    int depth{0};
+    for (size_t i = 0; i < program.size(); ++i) {
+        auto &next = program[i];
+        if (next.type not_eq Infix_lexer::arithmetic_operator) {
+            // An operand consumed at once by an operator other than ^ is read from memory.
+            bool fused = depth > 0 and i + 1 < program.size() and
+                         program[i + 1].type == Infix_lexer::arithmetic_operator and
+                         program[i + 1].operator_ not_eq '^';
+            int dst = fused ? depth - 1 : depth;
+            uint8_t op = fused ? opcode(program[++i].operator_) : movsd;
+            if (next.type == Infix_lexer::number) {
+                code.scalar_constant(op, dst, next.index);
+            } else {
+                code.scalar_rbx(op, dst, int32_t(8 * next.index));
+            }
+            depth = fused ? depth : depth + 1;
+            continue;
+        }
+        int left = depth - 2;
+        int right = depth - 1;
+        auto &previous = program[i - 1];
+        if (next.operator_ == '^' and previous.type == Infix_lexer::number and
+            compiled.constants[previous.index] == 2.0) {
+            // Squared, as pow() would give.
+            code.scalar(opcode('*'), left, left);
+        } else if (next.operator_ == '^') {
+            // pow(xmm0, xmm1) clobbers every xmm register, so the values under the operands wait
+            // in the frame.
+            for (int saved = 0; saved < left; ++saved) {
+                code.spill(saved, 8 * saved, false);
+            }
+            code.move(0, left);
+            code.move(1, right);
+            code.call(reinterpret_cast<const void *>(power));
+            code.move(left, 0);
+            for (int saved = 0; saved < left; ++saved) {
+                code.spill(saved, 8 * saved, true);
+            }
+        } else {
+            code.scalar(opcode(next.operator_), left, right);
+        }
+        --depth;
+    }
+    code.bytes({0x48, 0x81, 0xC4});        // add rsp, frame
+    code.dword(frame);
+    code.bytes({0x5B, 0xC3});              // pop rbx; ret
+    code.place(compiled.constants);
+    return true;
+}
@@ -0,0 +1,58 @@
+//
+// Compiled expressions lowered to x86-64 machine code.
+//
+
+#ifndef INC_9_CALCULATOR_NATIVE_EXPRESSION_H
+#define INC_9_CALCULATOR_NATIVE_EXPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "compiled_expression.h"
+
+/*
+ * A Native_expression translates the postfix program of a Compiled_expression into SSE2 scalar
+ * code in an executable page of its own. The value stack lives in xmm0 to xmm13 and ^ calls pow(),
+ * so results are the same, bit for bit, as those of Compiled_expression::evaluate(). Where the code
+ * cannot be generated (another architecture, a value stack deeper than the registers, or a call
+ * of a function) the expression is not native() and evaluate() falls back to the interpreter.
+ */
+class Native_expression {
+
+public:
+    // Takes values[i] as the value of variables()[i] and returns the result.
+    typedef double (*function)(const double *values);
+
+    explicit Native_expression(const Compiled_expression &compiled);
+
+    ~Native_expression();
+
+    // The generated code is owned by this object.
+    Native_expression(const Native_expression &) = delete;
+
+    Native_expression &operator=(const Native_expression &) = delete;
+
+    // True when evaluate() runs generated code rather than the interpreter.
+    bool native() const;
+
+    // The generated function, or nullptr when the expression is not native().
+    function entry() const;
+
+    double evaluate(const double *values) const;
+
+    // The size of the generated code and constants in bytes.
+    size_t code_size() const;
+
+    // Whether machine code can be generated on this platform at all.
+    static bool supported();
+
+private:
+    Compiled_expression compiled;
+    function code{nullptr};
+    void *page{nullptr};
+    size_t page_size{0};
+    size_t used{0};
+    bool generate(std::vector<uint8_t> &out) const;
+};
+
+#endif //INC_9_CALCULATOR_NATIVE_EXPRESSION_H
@@ -0,0 +1,431 @@
+//
+// Compiled expressions over a choice of number types.
+//
+
+#ifndef INC_9_CALCULATOR_NUMERIC_EXPRESSION_H
+#define INC_9_CALCULATOR_NUMERIC_EXPRESSION_H
+
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "boost/multiprecision/cpp_int.hpp"
+#include "compiled_expression.h"
+#include "dual_number.h"
+#include "fixed_decimal.h"
+#include "function_registry.h"
+#include "infix_lexer.h"
+#include "interval.h"
+
+// Exact fractions of arbitrary size.
+typedef boost::multiprecision::cpp_rational Rational;
+
+/*
+ * Numeric_traits<Number> tells Numeric_expression how to read, combine and print a number type.
+ * parse(), apply() and from_double() return false where the result cannot be represented: an exact
+ * type has no infinity to give for a division by zero, and a fixed-point one has a limited range.
+ * Functions are called in double, unless the traits define call() to apply them in Number.
+ */
+template<typename Number>
+struct Numeric_traits;
+
+template<typename Traits, typename = void>
+struct Numeric_calls : std::false_type {};
+
+template<typename Traits>
+struct Numeric_calls<Traits, std::void_t<decltype(&Traits::call)>> : std::true_type {};
+
+// The same operations as Compiled_expression, so double results are the same bit for bit.
+template<typename Float>
+struct Floating_traits {
+    static bool apply(char operator_, const Float &x, const Float &y, Float &result) {
+        switch (operator_) {
+            case '+' : result = x + y; break;
+            case '-' : result = x - y; break;
+            case '*' : result = x * y; break;
+            case '/' : result = x / y; break;
+            default : result = std::pow(x, y); break;
+        }
+        return true;
+    }
+
+    static double to_double(const Float &x) {
+        return double(x);
+    }
+
+    static bool from_double(double x, Float &result) {
+        result = Float(x);
+        return true;
+    }
+
+    static std::string to_string(const Float &x) {
+        char text[64];
+        auto written = std::to_chars(text, text + sizeof(text), x);
+        return std::string(text, written.ptr);
+    }
+};
+
+template<>
+struct Numeric_traits<double> : Floating_traits<double> {
+    static bool parse(std::string_view digits, bool negative, double &result) {
+        result = Infix_lexer::parse_number(digits);
+        result = negative ? -result : result;
+        return true;
+    }
+};
+
+template<>
+struct Numeric_traits<long double> : Floating_traits<long double> {
+    static bool parse(std::string_view digits, bool negative, long double &result) {
+#if defined(__cpp_lib_to_chars)
+        std::from_chars(digits.data(), digits.data() + digits.size(), result);
+#else
+        result = std::strtold(std::string(digits).c_str(), nullptr);
+#endif
+        result = negative ? -result : result;
+        return true;
+    }
+};
+
+template<>
+struct Numeric_traits<Fixed_decimal> {
+    static bool parse(std::string_view digits, bool negative, Fixed_decimal &result) {
+        return Fixed_decimal::parse(digits, negative, result);
+    }
+
+    static bool apply(char operator_, const Fixed_decimal &x, const Fixed_decimal &y,
+                      Fixed_decimal &result) {
+        switch (operator_) {
+            case '+' : return Fixed_decimal::plus(x, y, result);
+            case '-' : return Fixed_decimal::minus(x, y, result);
+            case '*' : return Fixed_decimal::multiply(x, y, result);
+            case '/' : return Fixed_decimal::divide(x, y, result);
+            default : return Fixed_decimal::exponent(x, y, result);
+        }
+    }
+
+    static double to_double(const Fixed_decimal &x) {
+        return x.to_double();
+    }
+
+    static bool from_double(double x, Fixed_decimal &result) {
+        return Fixed_decimal::from_double(x, result);
+    }
+
+    static std::string to_string(const Fixed_decimal &x) {
+        return x.to_string();
+    }
+};
+
+/*
+ * A decimal number is read as its digits over a power of ten, so 1.1 + 2.2 + 3.3 is exactly 33/5.
+ * Whole exponents up to max_exponent are applied exactly. Larger or fractional ones go through
+ * pow(), whose result is converted exactly, since the true power is in general irrational.
+ */
+template<>
+struct Numeric_traits<Rational> {
+    static constexpr long max_exponent{4096};
+
+    static bool parse(std::string_view digits, bool negative, Rational &result) {
+        boost::multiprecision::cpp_int numerator{0};
+        boost::multiprecision::cpp_int denominator{1};
+        bool fraction{false};
+        for (char digit : digits) {
+            if (digit == '.') {
+                fraction = true;
+                continue;
+            }
+            numerator = numerator * 10 + (digit - '0');
+            denominator *= fraction ? 10 : 1;
+        }
+        result = Rational(negative ? -numerator : numerator, denominator);
+        return true;
+    }
+
+    static bool apply(char operator_, const Rational &x, const Rational &y, Rational &result) {
+        switch (operator_) {
+            case '+' : result = x + y; return true;
+            case '-' : result = x - y; return true;
+            case '*' : result = x * y; return true;
+            case '/' : {
+                if (y == 0) {
+                    return false;
+                }
+                result = x / y;
+                return true;
+            }
+            default : return power(x, y, result);
+        }
+    }
+
+    static bool power(const Rational &x, const Rational &y, Rational &result) {
+        if (denominator(y) == 1 and abs(numerator(y)) <= max_exponent) {
+            auto n = numerator(y).convert_to<long>();
+            if (n < 0 and x == 0) {
+                return false;
+            }
+            auto magnitude = unsigned(n < 0 ? -n : n);
+            Rational power{boost::multiprecision::pow(numerator(x), magnitude),
+                           boost::multiprecision::pow(denominator(x), magnitude)};
+            result = n < 0 ? 1 / power : power;
+            return true;
+        }
+        return from_double(std::pow(to_double(x), to_double(y)), result);
+    }
+
+    static double to_double(const Rational &x) {
+        return x.convert_to<double>();
+    }
+
+    // Every finite double is a fraction with a power of two below, so the conversion is exact.
+    static bool from_double(double x, Rational &result) {
+        if (not std::isfinite(x)) {
+            return false;
+        }
+        result = Rational(x);
+        return true;
+    }
+
+    static std::string to_string(const Rational &x) {
+        return x.str();
+    }
+};
+
+/*
+ * A value with its derivatives by up to N variables. Constants are the doubles they are read as,
+ * so the value is the same as in double, and have no derivatives.
+ */
+template<size_t N>
+struct Numeric_traits<Dual<N>> {
+    static bool parse(std::string_view digits, bool negative, Dual<N> &result) {
+        double value = Infix_lexer::parse_number(digits);
+        result = Dual<N>::constant(negative ? -value : value);
+        return true;
+    }
+
+    static bool apply(char operator_, const Dual<N> &x, const Dual<N> &y, Dual<N> &result) {
+        switch (operator_) {
+            case '+' : Dual<N>::plus(x, y, result); break;
+            case '-' : Dual<N>::minus(x, y, result); break;
+            case '*' : Dual<N>::multiply(x, y, result); break;
+            case '/' : Dual<N>::divide(x, y, result); break;
+            default : Dual<N>::exponent(x, y, result); break;
+        }
+        return true;
+    }
+
+    static bool call(const Function_registry::function &f, const Dual<N> *arguments, size_t count,
+                     Dual<N> &result) {
+        Dual<N>::call(f, arguments, count, result);
+        return true;
+    }
+
+    static double to_double(const Dual<N> &x) {
+        return x.value;
+    }
+
+    static bool from_double(double x, Dual<N> &result) {
+        result = Dual<N>::constant(x);
+        return true;
+    }
+
+    // The value and then the gradient, e.g.; "156.25 [0, 125, 27.89]".
+    static std::string to_string(const Dual<N> &x) {
+        std::string text = Numeric_traits<double>::to_string(x.value) + " [";
+        for (size_t k = 0; k < N; ++k) {
+            text += (k ? ", " : "") + Numeric_traits<double>::to_string(x.gradient[k]);
+        }
+        return text + "]";
+    }
+};
+
+/*
+ * Bounds. A whole number is taken as exact, while any other is widened by an ulp, since it was
+ * rounded from its decimal digits or, in a compiled program, from folding constants.
+ */
+template<>
+struct Numeric_traits<Interval> {
+    static bool parse(std::string_view digits, bool negative, Interval &result) {
+        double value = Infix_lexer::parse_number(digits);
+        return from_double(negative ? -value : value, result);
+    }
+
+    static bool apply(char operator_, const Interval &x, const Interval &y, Interval &result) {
+        switch (operator_) {
+            case '+' : result = Interval::plus(x, y); break;
+            case '-' : result = Interval::minus(x, y); break;
+            case '*' : result = Interval::multiply(x, y); break;
+            case '/' : result = Interval::divide(x, y); break;
+            default : result = Interval::exponent(x, y); break;
+        }
+        return true;
+    }
+
+    static bool call(const Function_registry::function &f, const Interval *arguments, size_t count,
+                     Interval &result) {
+        result = Interval::call(f, arguments, count);
+        return true;
+    }
+
+    static double to_double(const Interval &x) {
+        return x.midpoint();
+    }
+
+    static bool from_double(double x, Interval &result) {
+        result = x == std::floor(x) or not std::isfinite(x) ? Interval::point(x)
+                                                            : Interval::rounded(x, x);
+        return true;
+    }
+
+    static std::string to_string(const Interval &x) {
+        return x.to_string();
+    }
+};
+
+/*
+ * A Numeric_expression compiles an equation like Compiled_expression, then evaluates it in the
+ * Number type: double or long double for speed and range, Fixed_decimal for exact decimal sums at
+ * integer speed, or Rational for exact results at any size. Numbers are read from their digits in
+ * the equation, not from a double, so 1.1 is exactly eleven tenths to the exact types. The program
+ * is not optimized, since folding constants in double would lose that. Functions are called in
+ * double, as few of them have exact results.
+ *
+ * It may instead take the program of a Compiled_expression, optimized and with its constants in
+ * double, so that one parse serves every number type. That suits the types that compute in
+ * double: Dual<N>, which gives the gradient alongside the value, and Interval, which bounds the
+ * value over a box of variables, in one evaluation each. The optimizer keeps x^2 a power, so an
+ * Interval square is never negative.
+ */
+template<typename Number>
+class Numeric_expression {
+
+public:
+    typedef Numeric_traits<Number> traits;
+
+    // defined is false where the result cannot be represented in Number, e.g.; 1/0 as a Rational.
+    struct result {
+        Number value;
+        bool defined;
+    };
+
+    explicit Numeric_expression(std::string_view equation) {
+        std::vector<Infix_lexer::token> tokens;
+        Infix_lexer lexer{equation};
+        compile_error = lexer.scan(tokens);
+        compile_error_at = lexer.error_offset();
+        if (compile_error not_eq Infix_lexer::none) {
+            return;
+        }
+        names = lexer.variables();
+        std::vector<size_t> slots;
+        for (size_t i = 0; i < names.size(); ++i) {
+            slots.push_back(i);
+        }
+        program = Compiled_expression::postfix(tokens, slots);
+        for (auto &i : program) {
+            if (i.type == Infix_lexer::number) {
+                auto &token = tokens[i.index];
+                Number value{};
+                representable = traits::parse(token.text, token.operator_ == '-', value) and
+                                representable;
+                constants.push_back(value);
+                i.index = uint32_t(constants.size() - 1);
+            }
+        }
+    }
+
+    // Takes over the program of compiled, whose constants are converted from double.
+    explicit Numeric_expression(const Compiled_expression &compiled)
+            : program(compiled.program),
+              names(compiled.names),
+              compile_error(compiled.compile_error),
+              compile_error_at(compiled.compile_error_at) {
+        for (double constant : compiled.constants) {
+            Number value{};
+            representable = traits::from_double(constant, value) and representable;
+            constants.push_back(value);
+        }
+    }
+
+    bool valid() const {
+        return compile_error == Infix_lexer::none;
+    }
+
+    Infix_lexer::error_kind error() const {
+        return compile_error;
+    }
+
+    size_t error_offset() const {
+        return compile_error_at;
+    }
+
+    // Variables in order of first appearance.
+    const std::vector<std::string> &variables() const {
+        return names;
+    }
+
+    // values[i] is the value of variables()[i].
+    result evaluate(const Number *values = nullptr) const {
+        if (not valid() or not representable or (values == nullptr and not names.empty())) {
+            return {Number{}, false};
+        }
+        // A per-thread stack that only grows, as in Compiled_expression::evaluate().
+        thread_local std::vector<Number> stack;
+        stack.clear();
+        for (auto &i : program) {
+            if (i.type == Infix_lexer::number) {
+                stack.push_back(constants[i.index]);
+            } else if (i.type == Infix_lexer::variable) {
+                stack.push_back(values[i.index]);
+            } else if (i.type == Infix_lexer::function_name) {
+                if (not call(i, stack)) {
+                    return {Number{}, false};
+                }
+            } else {
+                Number right = std::move(stack.back());
+                stack.pop_back();
+                if (not traits::apply(i.operator_, stack.back(), right, stack.back())) {
+                    return {Number{}, false};
+                }
+            }
+        }
+        return {std::move(stack.back()), true};
+    }
+
+private:
+    // Replaces the arguments of a function on the stack with its result.
+    static bool call(const Compiled_expression::instruction &i, std::vector<Number> &stack) {
+        if constexpr (Numeric_calls<traits>::value) {
+            size_t first = stack.size() - i.arguments;
+            Number value{};
+            if (not traits::call(Function_registry::at(i.index), &stack[first], i.arguments,
+                                 value)) {
+                return false;
+            }
+            stack.resize(first);
+            stack.push_back(std::move(value));
+            return true;
+        }
+        thread_local std::vector<double> arguments;
+        arguments.resize(i.arguments);
+        size_t first = stack.size() - i.arguments;
+        for (size_t k = 0; k < i.arguments; ++k) {
+            arguments[k] = traits::to_double(stack[first + k]);
+        }
+        stack.resize(first + 1);
+        double value = Function_registry::at(i.index).apply(arguments.data(), i.arguments);
+        return traits::from_double(value, stack.back());
+    }
+
+    std::vector<Compiled_expression::instruction> program;
+    std::vector<Number> constants;
+    std::vector<std::string> names;
+    bool representable{true};    // False when a constant does not fit in Number.
+    Infix_lexer::error_kind compile_error{Infix_lexer::none};
+    size_t compile_error_at{0};
+};
+
+#endif //INC_9_CALCULATOR_NUMERIC_EXPRESSION_H
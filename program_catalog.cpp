@@ -0,0 +1,415 @@
+//
+// Compiled expressions saved to and loaded from one file.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "function_registry.h"
+#include "program_catalog.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PROGRAM_CATALOG_MMAP 1
+#endif
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+/*
+ * The file is a header followed by six arrays, each aligned for its elements and sized by a count
+ * in the header, so their offsets follow from the counts alone:
+ *
+ *     constants       double, for all expressions in turn
+ *     records         one per expression: its name, error and where its parts start
+ *     functions       names of the functions called, which instructions refer to by number
+ *     variables       names of the variables of all expressions in turn
+ *     instructions    postfix programs of all expressions in turn, as in Compiled_expression
+ *     strings         the bytes of every name, referred to by offset and length
+ *
+ * Constant, variable and instruction numbers within a record are relative to its own first.
+ */
+namespace {
+
+const char magic[8] = {'C', 'A', 'L', 'C', 'P', 'R', 'O', 'G'};
+const uint32_t byte_order{0x01020304};
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t expressions;
+    uint32_t functions;
+    uint32_t constants;
+    uint32_t instructions;
+    uint32_t variables;
+    uint32_t strings;          // Bytes in the string pool.
+};
+
+struct text {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct record {
+    text name;
+    uint32_t first_constant;
+    uint32_t constants;
+    uint32_t first_instruction;
+    uint32_t instructions;
+    uint32_t first_variable;
+    uint32_t variables;
+    uint32_t error;            // An Infix_lexer::error_kind.
+    uint32_t reserved;
+    uint64_t error_offset;
+};
+
+struct stored_instruction {
+    uint8_t type;              // An Infix_lexer::token_type.
+    char operator_;
+    uint16_t reserved;
+    uint32_t index;
+    uint32_t arguments;
+};
+
+static_assert(sizeof(file_header) == 40 and sizeof(text) == 8 and sizeof(record) == 48 and
+              sizeof(stored_instruction) == 12, "The catalog format has fixed sizes.");
+
+// Where each array starts, and where the file ends. 64 bits, so no count can overflow them.
+struct layout {
+    uint64_t constants;
+    uint64_t records;
+    uint64_t functions;
+    uint64_t variables;
+    uint64_t instructions;
+    uint64_t strings;
+    uint64_t end;
+
+    explicit layout(const file_header &header) {
+        constants = sizeof(file_header);
+        records = constants + uint64_t(header.constants) * sizeof(double);
+        functions = records + uint64_t(header.expressions) * sizeof(record);
+        variables = functions + uint64_t(header.functions) * sizeof(text);
+        instructions = variables + uint64_t(header.variables) * sizeof(text);
+        strings = instructions + uint64_t(header.instructions) * sizeof(stored_instruction);
+        end = strings + header.strings;
+    }
+};
+
+template<typename T>
+void append(string &out, const vector<T> &items) {
+    out.append(reinterpret_cast<const char *>(items.data()), items.size() * sizeof(T));
+}
+
+bool fits(size_t count) {
+    return count <= std::numeric_limits<uint32_t>::max();
+}
+
+// A range of count items from first lies within total items.
+bool within(uint32_t first, uint32_t count, uint32_t total) {
+    return uint64_t(first) + count <= total;
+}
+
+} // namespace
+
+bool Program_catalog::save(const string &path, const vector<string> &names,
+                           const vector<Compiled_expression> &expressions) {
+    if (names.size() not_eq expressions.size() or not fits(names.size())) {
+        return false;
+    }
+    vector<double> constants;
+    vector<record> records;
+    vector<text> functions;
+    vector<text> variables;
+    vector<stored_instruction> instructions;
+    string strings;
+    vector<long> function_numbers;    // By registry number, the catalog number or -1.
+    auto store = [&strings](string_view name) {
+        text stored{uint32_t(strings.size()), uint32_t(name.size())};
+        strings.append(name);
+        return stored;
+    };
+    for (size_t e = 0; e < expressions.size(); ++e) {
+        auto &compiled = expressions[e];
+        record next{};
+        next.name = store(names[e]);
+        next.error = uint32_t(compiled.compile_error);
+        next.error_offset = compiled.compile_error_at;
+        next.first_constant = uint32_t(constants.size());
+        next.constants = uint32_t(compiled.constants.size());
+        constants.insert(constants.end(), compiled.constants.begin(), compiled.constants.end());
+        next.first_variable = uint32_t(variables.size());
+        next.variables = uint32_t(compiled.names.size());
+        for (auto &name : compiled.names) {
+            variables.push_back(store(name));
+        }
+        next.first_instruction = uint32_t(instructions.size());
+        next.instructions = uint32_t(compiled.program.size());
+        for (auto &i : compiled.program) {
+            stored_instruction stored{uint8_t(i.type), i.operator_, 0, i.index, i.arguments};
+            if (i.type == Infix_lexer::function_name) {
+                if (function_numbers.size() <= i.index) {
+                    function_numbers.resize(i.index + 1, -1);
+                }
+                if (function_numbers[i.index] < 0) {
+                    function_numbers[i.index] = long(functions.size());
+                    functions.push_back(store(Function_registry::at(i.index).name));
+                }
+                stored.index = uint32_t(function_numbers[i.index]);
+            }
+            instructions.push_back(stored);
+        }
+        records.push_back(next);
+    }
+    if (not fits(constants.size()) or not fits(variables.size()) or
+        not fits(instructions.size()) or not fits(strings.size())) {
+        return false;
+    }
+    file_header header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.byte_order = byte_order;
+    header.expressions = uint32_t(records.size());
+    header.functions = uint32_t(functions.size());
+    header.constants = uint32_t(constants.size());
+    header.instructions = uint32_t(instructions.size());
+    header.variables = uint32_t(variables.size());
+    header.strings = uint32_t(strings.size());
+    string out(reinterpret_cast<const char *>(&header), sizeof(header));
+    append(out, constants);
+    append(out, records);
+    append(out, functions);
+    append(out, variables);
+    append(out, instructions);
+    out += strings;
+    // Written beside the old file and renamed over it, so a reader never maps half a catalog.
+    string written{path + ".tmp"};
+    FILE *file = std::fopen(written.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool saved = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    saved = std::fclose(file) == 0 and saved;
+    if (not saved or std::rename(written.c_str(), path.c_str()) not_eq 0) {
+        std::remove(written.c_str());
+        return false;
+    }
+    return true;
+}
+
+Program_catalog::~Program_catalog() {
+    close();
+}
+
+void Program_catalog::close() {
+#ifdef PROGRAM_CATALOG_MMAP
+    if (mapped) {
+        munmap(mapped, data_size);
+    }
+#endif
+    mapped = nullptr;
+    data = nullptr;
+    data_size = 0;
+    copied.clear();
+    functions.clear();
+    index.clear();
+}
+
+bool Program_catalog::open(const string &path) {
+    close();
+#ifdef PROGRAM_CATALOG_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status{};
+    if (fstat(fd, &status) not_eq 0 or size_t(status.st_size) < sizeof(file_header)) {
+        ::close(fd);
+        return false;
+    }
+    data_size = size_t(status.st_size);
+    mapped = mmap(nullptr, data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        mapped = nullptr;
+        data_size = 0;
+        return false;
+    }
+    data = static_cast<const char *>(mapped);
+#else
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    char buffer[65536];
+    size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        copied.append(buffer, read);
+    }
+    std::fclose(file);
+    data = copied.data();
+    data_size = copied.size();
+#endif
+    if (not check()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Everything expression() relies on is checked here, once: that the arrays fit the file, that
+ * every name and range lies within its array, and that every program is well formed postfix, so a
+ * damaged file is refused rather than evaluated out of bounds.
+ */
+bool Program_catalog::check() {
+    if (data_size < sizeof(file_header)) {
+        return false;
+    }
+    auto &header = *reinterpret_cast<const file_header *>(data);
+    if (std::memcmp(header.magic, magic, sizeof(magic)) not_eq 0 or header.version not_eq version or
+        header.byte_order not_eq byte_order) {
+        return false;
+    }
+    layout at{header};
+    if (at.end not_eq data_size) {
+        return false;
+    }
+    auto named = [&header](const text &name) {
+        return within(name.offset, name.length, header.strings);
+    };
+    auto records = reinterpret_cast<const record *>(data + at.records);
+    auto names = reinterpret_cast<const text *>(data + at.functions);
+    auto variables = reinterpret_cast<const text *>(data + at.variables);
+    auto instructions = reinterpret_cast<const stored_instruction *>(data + at.instructions);
+    const char *strings = data + at.strings;
+    for (uint32_t f = 0; f < header.functions; ++f) {
+        if (not named(names[f])) {
+            return false;
+        }
+        functions.push_back(Function_registry::find({strings + names[f].offset, names[f].length}));
+    }
+    for (uint32_t v = 0; v < header.variables; ++v) {
+        if (not named(variables[v])) {
+            return false;
+        }
+    }
+    for (uint32_t e = 0; e < header.expressions; ++e) {
+        auto &r = records[e];
+        bool valid = r.error == Infix_lexer::none;
+        if (not named(r.name) or r.error > Infix_lexer::argument_count or
+            not within(r.first_constant, r.constants, header.constants) or
+            not within(r.first_variable, r.variables, header.variables) or
+            not within(r.first_instruction, r.instructions, header.instructions) or
+            (valid and r.instructions == 0)) {
+            return false;
+        }
+        size_t depth{0};
+        for (uint32_t k = 0; k < r.instructions; ++k) {
+            auto &i = instructions[r.first_instruction + k];
+            switch (i.type) {
+                case Infix_lexer::number :
+                case Infix_lexer::variable :
+                    if (i.index >= (i.type == Infix_lexer::number ? r.constants : r.variables)) {
+                        return false;
+                    }
+                    ++depth;
+                    break;
+                case Infix_lexer::arithmetic_operator :
+                    if (depth < 2 or std::strchr("+-*/^", i.operator_) == nullptr or
+                        i.operator_ == '\0') {
+                        return false;
+                    }
+                    --depth;
+                    break;
+                case Infix_lexer::function_name :
+                    if (i.index >= header.functions or i.arguments == 0 or i.arguments > depth) {
+                        return false;
+                    }
+                    depth -= i.arguments - 1;
+                    break;
+                default :
+                    return false;
+            }
+        }
+        if (valid and depth not_eq 1) {
+            return false;
+        }
+        index.emplace(string_view{strings + r.name.offset, r.name.length}, e);
+    }
+    return true;
+}
+
+size_t Program_catalog::size() const {
+    return data ? reinterpret_cast<const file_header *>(data)->expressions : 0;
+}
+
+string_view Program_catalog::name(size_t i) const {
+    layout at{*reinterpret_cast<const file_header *>(data)};
+    auto &r = reinterpret_cast<const record *>(data + at.records)[i];
+    return {data + at.strings + r.name.offset, r.name.length};
+}
+
+long Program_catalog::find(string_view name) const {
+    auto found = index.find(name);
+    return found == index.end() ? -1 : long(found->second);
+}
+
+// The program is copied out of the file as it stands. Only the function numbers are resolved.
+Compiled_expression Program_catalog::expression(size_t i) const {
+    layout at{*reinterpret_cast<const file_header *>(data)};
+    auto &r = reinterpret_cast<const record *>(data + at.records)[i];
+    auto constants = reinterpret_cast<const double *>(data + at.constants) + r.first_constant;
+    auto variables = reinterpret_cast<const text *>(data + at.variables) + r.first_variable;
+    auto instructions = reinterpret_cast<const stored_instruction *>(data + at.instructions) +
+                        r.first_instruction;
+    const char *strings = data + at.strings;
+    Compiled_expression compiled;
+    compiled.compile_error = Infix_lexer::error_kind(r.error);
+    compiled.compile_error_at = size_t(r.error_offset);
+    compiled.names.reserve(r.variables);
+    for (uint32_t v = 0; v < r.variables; ++v) {
+        compiled.names.emplace_back(strings + variables[v].offset, variables[v].length);
+    }
+    if (compiled.compile_error not_eq Infix_lexer::none) {
+        return compiled;
+    }
+    compiled.constants.assign(constants, constants + r.constants);
+    compiled.program.reserve(r.instructions);
+    for (uint32_t k = 0; k < r.instructions; ++k) {
+        auto &stored = instructions[k];
+        Compiled_expression::instruction next{Infix_lexer::token_type(stored.type),
+                                              stored.operator_, stored.index, stored.arguments};
+        if (next.type == Infix_lexer::function_name) {
+            long function = functions[stored.index];
+            if (function < 0) {
+                compiled.compile_error = Infix_lexer::unknown_function;
+                break;
+            }
+            auto &called = Function_registry::at(size_t(function));
+            if (stored.arguments < called.min_arguments or
+                stored.arguments > called.max_arguments) {
+                compiled.compile_error = Infix_lexer::argument_count;
+                break;
+            }
+            next.index = uint32_t(function);
+        }
+        compiled.program.push_back(next);
+    }
+    if (compiled.compile_error not_eq Infix_lexer::none) {
+        compiled.program.clear();
+        compiled.constants.clear();
+        compiled.compile_error_at = 0;
+        return compiled;
+    }
+    compiled.measure_depth();
+    compiled.thread();
+    return compiled;
+}
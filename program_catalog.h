@@ -0,0 +1,79 @@
+//
+// Compiled expressions saved to and loaded from one file.
+//
+
+#ifndef INC_9_CALCULATOR_PROGRAM_CATALOG_H
+#define INC_9_CALCULATOR_PROGRAM_CATALOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "compiled_expression.h"
+
+/*
+ * A Program_catalog is a file of named compiled expressions: their postfix programs, constants and
+ * variable names. It is loaded by mapping the file into memory. open() checks the file once, and
+ * expression() then rebuilds a Compiled_expression from its program without scanning or parsing
+ * the equation again.
+ *
+ * The format is versioned and relocatable: every reference is an index or an offset within the
+ * file, never a pointer. Functions are saved by name and looked up in Function_registry when the
+ * catalog is opened, so the file does not depend on the order in which functions were registered.
+ * Numbers are written in the byte order of the machine that saved them, and a catalog from a
+ * machine of the other order is refused.
+ */
+class Program_catalog {
+
+public:
+    static constexpr uint32_t version{1};
+
+    Program_catalog() = default;
+
+    ~Program_catalog();
+
+    // The mapping is owned by this object.
+    Program_catalog(const Program_catalog &) = delete;
+
+    Program_catalog &operator=(const Program_catalog &) = delete;
+
+    /*
+     * Writes expressions[i] under names[i], replacing the file at path as a whole. Invalid
+     * expressions are saved with their error. Returns false when the file cannot be written.
+     */
+    static bool save(const std::string &path, const std::vector<std::string> &names,
+                     const std::vector<Compiled_expression> &expressions);
+
+    // Maps a saved catalog. Returns false when it cannot be read, or is damaged or of another
+    // version, in which case the catalog is empty.
+    bool open(const std::string &path);
+
+    size_t size() const;
+
+    // The name of expression i, which refers into the mapped file.
+    std::string_view name(size_t i) const;
+
+    // The number of the expression of that name, or -1 when there is none.
+    long find(std::string_view name) const;
+
+    /*
+     * Expression i, as it was saved. A call of a function that is no longer registered, or no
+     * longer takes that many arguments, makes it invalid with the error of an equation that made
+     * that call.
+     */
+    Compiled_expression expression(size_t i) const;
+
+private:
+    const char *data{nullptr};
+    size_t data_size{0};
+    void *mapped{nullptr};
+    std::string copied;    // The file, where it cannot be mapped.
+    std::vector<long> functions;    // Function_registry numbers, or -1 for a name not registered.
+    std::unordered_map<std::string_view, size_t> index;
+    void close();
+    bool check();
+};
+
+#endif //INC_9_CALCULATOR_PROGRAM_CATALOG_H
@@ -0,0 +1,77 @@
+//
+// A stack that lives inside its owner until it outgrows a fixed capacity.
+//
+
+#ifndef INC_9_CALCULATOR_SMALL_STACK_H
+#define INC_9_CALCULATOR_SMALL_STACK_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Small_stack keeps its first N items in an inline array, so pushing and popping never touch the
+ * heap for ordinary equations. Deeper stacks spill to a vector that is kept, not freed, by clear().
+ * The interface follows the subset of std::list used by Infix_calculator: the front is the top.
+ */
+template<typename T, size_t N>
+class Small_stack {
+
+public:
+    T &front() {
+        return items()[count - 1];
+    }
+
+    void pop_front() {
+        --count;
+    }
+
+    // The n items nearest the front, oldest first, and their removal.
+    T *front_items(size_t n) {
+        return items() + count - n;
+    }
+
+    void pop_front(size_t n) {
+        count -= n;
+    }
+
+    void emplace_front(const T &item) {
+        if (count == capacity()) {
+            grow();
+        }
+        items()[count++] = item;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    void clear() {
+        count = 0;
+    }
+
+private:
+    T inline_items[N];
+    std::vector<T> spilled;
+    size_t count{0};
+
+    T *items() {
+        return spilled.empty() ? inline_items : spilled.data();
+    }
+
+    size_t capacity() const {
+        return spilled.empty() ? N : spilled.size();
+    }
+
+    void grow() {
+        if (spilled.empty()) {
+            spilled.assign(inline_items, inline_items + N);
+        }
+        spilled.resize(spilled.size() * 2);
+    }
+};
+
+#endif //INC_9_CALCULATOR_SMALL_STACK_H
@@ -0,0 +1,86 @@
+//
+// A fixed set of worker threads that steal queued tasks from each other.
+//
+
+#include <algorithm>
+#include "work_stealing_pool.h"
+
+using std::function;
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+
+/*
+ * Each worker owns a queue. Tasks are dealt round-robin; a worker takes the oldest task from its
+ * own queue and, when that is empty, the oldest task from another worker's queue. A worker that
+ * finishes its share early therefore keeps busy instead of waiting on a worker stuck on a long
+ * task. Tasks run roughly in the order they were submitted, which callers that write results in
+ * that order rely on: the oldest task is the one they wait for.
+ */
+Work_stealing_pool::Work_stealing_pool(size_t threads) {
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; ++i) {
+        queues.emplace_back(new task_queue);
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&Work_stealing_pool::work, this, i);
+    }
+}
+
+Work_stealing_pool::~Work_stealing_pool() {
+    {
+        lock_guard<mutex> guard{idle_lock};
+        stopping = true;
+    }
+    idle.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+size_t Work_stealing_pool::size() const {
+    return workers.size();
+}
+
+void Work_stealing_pool::submit(function<void()> task) {
+    auto &queue = *queues[next_queue++ % queues.size()];
+    ++queued;
+    {
+        lock_guard<mutex> guard{queue.lock};
+        queue.tasks.push_back(std::move(task));
+    }
+    // Taking the lock orders the count above before any waiting worker's check of it.
+    lock_guard<mutex> guard{idle_lock};
+    idle.notify_one();
+}
+
+bool Work_stealing_pool::take(size_t index, function<void()> &task) {
+    for (size_t i = 0; i < queues.size(); ++i) {
+        auto &queue = *queues[(index + i) % queues.size()];
+        lock_guard<mutex> guard{queue.lock};
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        --queued;
+        return true;
+    }
+    return false;
+}
+
+void Work_stealing_pool::work(size_t index) {
+    function<void()> task;
+    while (true) {
+        if (take(index, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+        unique_lock<mutex> guard{idle_lock};
+        idle.wait(guard, [this] { return stopping or queued > 0; });
+        if (stopping and queued == 0) {
+            return;
+        }
+    }
+}
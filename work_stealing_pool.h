@@ -0,0 +1,50 @@
+//
+// A fixed set of worker threads that steal queued tasks from each other.
+//
+
+#ifndef INC_9_CALCULATOR_WORK_STEALING_POOL_H
+#define INC_9_CALCULATOR_WORK_STEALING_POOL_H
+
+#include <cstddef>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+class Work_stealing_pool {
+
+public:
+    explicit Work_stealing_pool(size_t threads);
+
+    // Finishes every queued task before joining the workers.
+    ~Work_stealing_pool();
+
+    Work_stealing_pool(const Work_stealing_pool &) = delete;
+
+    Work_stealing_pool &operator=(const Work_stealing_pool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    size_t size() const;
+
+private:
+    struct task_queue {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+    std::vector<std::unique_ptr<task_queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued{0};
+    std::atomic<size_t> next_queue{0};
+    std::mutex idle_lock;
+    std::condition_variable idle;
+    bool stopping{false};
+    void work(size_t index);
+    bool take(size_t index, std::function<void()> &task);
+};
+
+#endif //INC_9_CALCULATOR_WORK_STEALING_POOL_H